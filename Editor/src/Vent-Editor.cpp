@@ -6,9 +6,12 @@ int main(int argc, char const *argv[])
 
     try
     {
-        renderer = std::make_unique<Renderer>();
+        ApplicationInfo info{"Vent-Engine Editor", 800, 800};
+        parseCommandLine(info, argc, argv);
 
-        Vent_GUI gui{renderer->window};
+        renderer = std::make_unique<Renderer>(info);
+
+        Vent_GUI gui{renderer->window, renderer->getMainRenderPass()};
 
         float delta = 0.0f;
         uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
@@ -26,7 +29,9 @@ int main(int argc, char const *argv[])
 
             uint32_t index = renderer->onPreUpdate(delta);
             vk::CommandBuffer cmd = renderer->onPreDraw(index);
+            const uint32_t gui_scope = renderer->getGpuProfiler().begin(cmd, "ImGui");
             gui.update(cmd);
+            renderer->getGpuProfiler().end(cmd, gui_scope);
             renderer->onPostDraw(cmd, index);
             renderer->onPostUpdate(index);
 
@@ -2,6 +2,8 @@
 
 #include <vk/Vulkan_Base.hpp>
 
+#include <algorithm>
+
 void Vent_GUI::UpdateFontsTexture()
 {
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Updating ImGui Font Textures");
@@ -61,58 +63,6 @@ static void check_vk_result(VkResult err)
         abort();
 }
 
-void Vent_GUI::createImGuiRenderPass()
-{
-    vk::AttachmentDescription attachment;
-    // Backbuffer format.
-    attachment.format = context->swapchain_dimensions.format;
-    // Not multisampled.
-    attachment.samples = vk::SampleCountFlagBits::e1;
-    // When starting the frame, we want tiles to be cleared.
-    attachment.loadOp = vk::AttachmentLoadOp::eLoad;
-    // When ending the frame, we want tiles to be written out.
-    attachment.storeOp = vk::AttachmentStoreOp::eStore;
-    // Don't care about stencil since we're not using it.
-    attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-
-    // The image layout will be undefined when the render pass begins.
-    attachment.initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
-    // After the render pass is complete, we will transition to ePresentSrcKHR layout.
-    attachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-
-    // We have one subpass. This subpass has one color attachment.
-    // While executing this subpass, the attachment will be in attachment optimal layout.
-    vk::AttachmentReference color_ref(0, vk::ImageLayout::eColorAttachmentOptimal);
-
-    // We will end up with two transitions.
-    // The first one happens right before we start subpass #0, where
-    // eUndefined is transitioned into eColorAttachmentOptimal.
-    // The final layout in the render pass attachment states ePresentSrcKHR, so we
-    // will get a final transition from eColorAttachmentOptimal to ePresetSrcKHR.
-    vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, {}, {}, 1, &color_ref);
-
-    // Create a dependency to external events.
-    // We need to wait for the WSI semaphore to signal.
-    // Only pipeline stages which depend on eColorAttachmentOutput will
-    // actually wait for the semaphore, so we must also wait for that pipeline stage.
-    vk::SubpassDependency dependency;
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-
-    // Since we changed the image layout, we need to make the memory visible to
-    // color attachment to modify.
-    dependency.srcAccessMask = {};
-    dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-
-    // Finally, create the renderpass.
-    vk::RenderPassCreateInfo rp_info({}, attachment, subpass, dependency);
-
-    vkAssert(context->device.createRenderPass(rp_info, {}, imgui_render_pass), "Failed to create Render Pass for ImGui");
-}
-
 void Vent_GUI::createImGuiDescriporPool()
 {
     vk::DescriptorPoolSize pool_sizes[] =
@@ -133,7 +83,7 @@ void Vent_GUI::createImGuiDescriporPool()
     vkAssert(context->device.createDescriptorPool(descriptor_pool_create_info, {}, imgui_descriptor_pool), "Failed to create DescriporPool for ImGui");
 }
 
-Vent_GUI::Vent_GUI(const Vent_Window &window)
+Vent_GUI::Vent_GUI(const Vent_Window &window, const vk::RenderPass render_pass)
 {
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "initializing ImGui");
     IMGUI_CHECKVERSION();
@@ -153,7 +103,6 @@ Vent_GUI::Vent_GUI(const Vent_Window &window)
     }
 
     this->createImGuiDescriporPool();
-    this->createImGuiRenderPass();
 
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "initializing ImGui VK Info ");
     ImGui_ImplVulkan_InitInfo vulkanInitInfo = {};
@@ -166,12 +115,14 @@ Vent_GUI::Vent_GUI(const Vent_Window &window)
     vulkanInitInfo.DescriptorPool = static_cast<VkDescriptorPool>(imgui_descriptor_pool);
     vulkanInitInfo.Subpass = 0;
     vulkanInitInfo.MinImageCount = 2;
-    vulkanInitInfo.ImageCount = context->swapchain_image_views.size();
+    // ImGui cycles its own vertex buffers, there have to be at least as many as frames in flight
+    vulkanInitInfo.ImageCount = std::max(static_cast<uint32_t>(context->swapchain_image_views.size()), context->frames_in_flight);
     vulkanInitInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     vulkanInitInfo.Allocator = nullptr;
     vulkanInitInfo.CheckVkResultFn = check_vk_result;
 
-    if (!ImGui_ImplVulkan_Init(&vulkanInitInfo, imgui_render_pass))
+    // ImGui draws inside the renderer's main pass, its pipeline has to be compatible with that
+    if (!ImGui_ImplVulkan_Init(&vulkanInitInfo, static_cast<VkRenderPass>(render_pass)))
     {
         SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to initializing ImGui Vulkan");
         return;
@@ -205,11 +156,6 @@ Vent_GUI::~Vent_GUI()
         context->device.destroyDescriptorPool(imgui_descriptor_pool);
     }
 
-    if (imgui_render_pass)
-    {
-        context->device.destroyRenderPass(imgui_render_pass);
-    }
-
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplSDL2_Shutdown();
 
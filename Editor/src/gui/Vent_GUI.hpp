@@ -16,16 +16,14 @@ class Vent_GUI
 private:
     ImGuiContext *m_context;
     vk::DescriptorPool imgui_descriptor_pool;
-    vk::RenderPass imgui_render_pass;
 
     void UpdateFontsTexture();
 
     void createImGuiDescriporPool();
 
-    void createImGuiRenderPass();
-
 public:
-    Vent_GUI(const Vent_Window &window);
+    /// Draws into render_pass, the pass Renderer::onPreDraw leaves open
+    Vent_GUI(const Vent_Window &window, vk::RenderPass render_pass);
     ~Vent_GUI();
 
     void update(const vk::CommandBuffer &buffer);
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Frustum culling of the frame's draw list, in two dispatches.
+// Pass 0: every visible instance appends its object to its batch's instance range.
+// Pass 1: every batch writes its indirect command. Compacting, only batches with visible instances
+// are appended to their run's commands, and the run's draw count is the number appended.
+
+#include "cull.glsl"
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+
+	if (cull.pass == 0)
+	{
+		if (index < cull.instanceCount && insideFrustum(worldSphere(instances[index])))
+		{
+			appendInstance(instances[index]);
+		}
+	}
+	else if (index < cull.batchCount)
+	{
+		writeCommand(index);
+	}
+}
@@ -0,0 +1,134 @@
+// Shared by cull.comp.glsl and cull_occlusion.comp.glsl: the records, set 0, the frustum test and pass 1.
+// Every phase owns a region of the visible instances, commands and counts, the frustum-only cull has just phase 0.
+
+layout (local_size_x = 64) in;
+
+struct ObjectData
+{
+	mat4 model;
+	mat4 normal;
+};
+
+struct CullInstance
+{
+	vec4 sphere;
+	uint object;
+	uint batch;
+	uint padding0;
+	uint padding1;
+};
+
+struct CullBatch
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint run;
+	uint runFirst;
+	uint padding;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Objects
+{
+	ObjectData objects[];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Instances
+{
+	CullInstance instances[];
+};
+
+layout (std430, set = 0, binding = 2) buffer Batches
+{
+	CullBatch batches[];
+};
+
+layout (std430, set = 0, binding = 3) writeonly buffer Visible
+{
+	uint visible[];
+};
+
+layout (std430, set = 0, binding = 4) writeonly buffer Commands
+{
+	DrawCommand commands[];
+};
+
+layout (std430, set = 0, binding = 5) buffer Counts
+{
+	uint counts[];
+};
+
+layout (push_constant) uniform Cull
+{
+	vec4 planes[6];
+	uint instanceCount;
+	uint batchCount;
+	uint pass;
+	uint compact;
+	uint phase;
+	uint runCount;
+	uint pyramidWidth;
+	uint pyramidHeight;
+} cull;
+
+// World space bounding sphere of an instance, it grows with the largest axis scale
+vec4 worldSphere(CullInstance instance)
+{
+	mat4 model = objects[instance.object].model;
+
+	vec3 center = (model * vec4(instance.sphere.xyz, 1.0)).xyz;
+	float scale = sqrt(max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)), dot(model[2].xyz, model[2].xyz)));
+	return vec4(center, instance.sphere.w * scale);
+}
+
+bool insideFrustum(vec4 sphere)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(cull.planes[i].xyz, sphere.xyz) + cull.planes[i].w < -sphere.w)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Appends the instance's object to its batch's instance range of the current phase
+void appendInstance(CullInstance instance)
+{
+	uint slot = atomicAdd(batches[instance.batch].instanceCount, 1);
+	visible[cull.phase * cull.instanceCount + batches[instance.batch].firstInstance + slot] = instance.object;
+}
+
+void writeCommand(uint index)
+{
+	CullBatch batch = batches[index];
+
+	// The next phase counts from zero again, only this invocation touches the batch now
+	batches[index].instanceCount = 0;
+
+	// Without a draw count, every batch keeps its slot and culled ones draw zero instances
+	uint slot = index;
+	if (cull.compact != 0)
+	{
+		if (batch.instanceCount == 0)
+		{
+			return;
+		}
+		slot = batch.runFirst + atomicAdd(counts[cull.phase * cull.runCount + batch.run], 1);
+	}
+
+	commands[cull.phase * cull.batchCount + slot] = DrawCommand(batch.indexCount, batch.instanceCount, batch.firstIndex, batch.vertexOffset,
+																cull.phase * cull.instanceCount + batch.firstInstance);
+}
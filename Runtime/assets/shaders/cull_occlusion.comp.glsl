@@ -0,0 +1,117 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Two-phase occlusion culling, each phase runs pass 0 and pass 1 of cull.comp.glsl.
+// Early phase: the instances visible last frame that are inside the frustum, drawn to seed the depth buffer.
+// Late phase: every instance inside the frustum is tested against the Hi-Z pyramid built from the early depth.
+// The ones that pass become the visible set of the next frame, those not drawn early are drawn now.
+
+#include "cull.glsl"
+
+// 1 for the objects visible after the latest late phase, indexed by object
+layout (std430, set = 1, binding = 0) buffer History
+{
+	uint history[];
+};
+
+layout (set = 1, binding = 1) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+} camera;
+
+// Farthest depth (reverse-Z: smallest) of every texel's footprint, level 0 is the depth buffer itself
+layout (set = 1, binding = 2) uniform sampler2D pyramid;
+
+bool occluded(vec4 sphere)
+{
+	mat4 viewProjection = camera.projection * camera.view;
+
+	// Screen rectangle and nearest depth of the sphere's bounding cube
+	vec2 lower = vec2(1.0);
+	vec2 upper = vec2(-1.0);
+	float nearest = 0.0;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = viewProjection * vec4(corner, 1.0);
+
+		// Reaches behind the camera, the projection says nothing
+		if (clip.w <= 0.0)
+		{
+			return false;
+		}
+
+		vec3 ndc = clip.xyz / clip.w;
+		lower = min(lower, ndc.xy);
+		upper = max(upper, ndc.xy);
+		nearest = max(nearest, ndc.z);
+	}
+
+	lower = clamp(lower * 0.5 + 0.5, 0.0, 1.0);
+	upper = clamp(upper * 0.5 + 0.5, 0.0, 1.0);
+
+	// The level where the rectangle covers at most 2x2 texels
+	vec2 size = (upper - lower) * vec2(cull.pyramidWidth, cull.pyramidHeight);
+	int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), textureQueryLevels(pyramid) - 1);
+
+	ivec2 levelSize = textureSize(pyramid, level);
+	ivec2 first = min(ivec2(lower * vec2(levelSize)), levelSize - 1);
+	ivec2 last = min(ivec2(upper * vec2(levelSize)), levelSize - 1);
+
+	float farthest = 1.0;
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			farthest = min(farthest, texelFetch(pyramid, ivec2(x, y), level).r);
+		}
+	}
+
+	// Everything of the object lies behind the farthest occluder over its rectangle
+	return nearest < farthest;
+}
+
+void cullInstance(uint index)
+{
+	CullInstance instance = instances[index];
+	vec4 sphere = worldSphere(instance);
+
+	bool inside = insideFrustum(sphere);
+	bool drawnEarly = history[instance.object] != 0;
+
+	if (cull.phase == 0)
+	{
+		if (inside && drawnEarly)
+		{
+			appendInstance(instance);
+		}
+		return;
+	}
+
+	bool visibleNow = inside && !occluded(sphere);
+	history[instance.object] = visibleNow ? 1 : 0;
+
+	if (visibleNow && !drawnEarly)
+	{
+		appendInstance(instance);
+	}
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+
+	if (cull.pass == 0)
+	{
+		if (index < cull.instanceCount)
+		{
+			cullInstance(index);
+		}
+	}
+	else if (index < cull.batchCount)
+	{
+		writeCommand(index);
+	}
+}
@@ -0,0 +1,43 @@
+#version 450
+
+// Depth pre-pass: writes depth only, no fragment shader. The position is computed exactly like model.vert.glsl,
+// both declare it invariant, so the shaded pass after it finds the same depth values and only shades the front-most fragments.
+
+layout (location = 0) in vec3 inPos;
+
+layout (set = 0, binding = 0) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+} camera;
+
+struct ObjectData
+{
+	mat4 model;
+	mat4 normal;
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Objects
+{
+	ObjectData objects[];
+};
+
+layout (std430, set = 0, binding = 2) readonly buffer Instances
+{
+	uint instances[];
+};
+
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
+void main()
+{
+	ObjectData object = objects[instances[gl_InstanceIndex]];
+
+	vec4 worldPos = object.model * vec4(inPos, 1.0);
+
+	gl_Position = camera.projection * camera.view * worldPos;
+}
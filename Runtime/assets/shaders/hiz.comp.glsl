@@ -0,0 +1,41 @@
+#version 450
+
+// One level of the Hi-Z pyramid: every texel keeps the farthest depth (reverse-Z: the smallest) of the
+// source texels it covers. Level 0 reads the depth buffer at the same size, i.e. copies it.
+// Odd sizes round down, the texels next to the leftover source row or column cover three source texels.
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (set = 0, binding = 0) uniform sampler2D source;
+
+layout (set = 0, binding = 1, r32f) uniform writeonly image2D destination;
+
+layout (push_constant) uniform Reduce
+{
+	uvec2 sourceSize;
+	uvec2 size;
+} reduce;
+
+void main()
+{
+	uvec2 position = gl_GlobalInvocationID.xy;
+	if (any(greaterThanEqual(position, reduce.size)))
+	{
+		return;
+	}
+
+	// Source texels [first, last) this texel covers
+	uvec2 first = position * reduce.sourceSize / reduce.size;
+	uvec2 last = ((position + 1) * reduce.sourceSize + reduce.size - 1) / reduce.size;
+
+	float farthest = 1.0;
+	for (uint y = first.y; y < last.y; y++)
+	{
+		for (uint x = first.x; x < last.x; x++)
+		{
+			farthest = min(farthest, texelFetch(source, ivec2(x, y), 0).r);
+		}
+	}
+
+	imageStore(destination, ivec2(position), vec4(farthest));
+}
@@ -4,39 +4,54 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inNormal;
 
-layout (binding = 0) uniform UBO 
+layout (set = 0, binding = 0) uniform Camera
 {
 	mat4 projection;
 	mat4 view;
-	mat4 trans;
 	vec4 viewPos;
-	float lodBias;
-} ubo;
+} camera;
+
+struct ObjectData
+{
+	mat4 model;
+	mat4 normal;
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Objects
+{
+	ObjectData objects[];
+};
+
+// Object index of every instance, an instanced draw's instances are consecutive entries
+layout (std430, set = 0, binding = 2) readonly buffer Instances
+{
+	uint instances[];
+};
 
 layout (location = 0) out vec2 outUV;
-layout (location = 1) out float outLodBias;
-layout (location = 2) out vec3 outNormal;
-layout (location = 3) out vec3 outViewVec;
-layout (location = 4) out vec3 outLightVec;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
 
+// Invariant, depth.vert.glsl has to come to the same depth
 out gl_PerVertex 
 {
-    vec4 gl_Position;   
+    invariant vec4 gl_Position;   
 };
 
 void main() 
 {
+	// gl_InstanceIndex includes the draw's firstInstance
+	ObjectData object = objects[instances[gl_InstanceIndex]];
+
 	outUV = inUV;
-	outLodBias = ubo.lodBias;
 
-	vec3 worldPos = vec3(ubo.view * vec4(inPos, 1.0));
+	vec4 worldPos = object.model * vec4(inPos, 1.0);
 
-	gl_Position = ubo.projection * ubo.view * ubo.trans * vec4(inPos.xyz, 1.0);
+	gl_Position = camera.projection * camera.view * worldPos;
 
-    vec4 pos = ubo.view * vec4(inPos, 1.0);
-	outNormal = mat3(inverse(transpose(ubo.view))) * inNormal;
+	outNormal = mat3(object.normal) * inNormal;
 	vec3 lightPos = vec3(0.0);
-	vec3 lPos = mat3(ubo.view) * lightPos.xyz;
-    outLightVec = lPos - pos.xyz;
-    outViewVec = ubo.viewPos.xyz - pos.xyz;		
-}
\ No newline at end of file
+    outLightVec = lightPos - worldPos.xyz;
+    outViewVec = camera.viewPos.xyz - worldPos.xyz;		
+}
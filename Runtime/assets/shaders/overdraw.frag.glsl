@@ -0,0 +1,9 @@
+#version 450
+
+layout (location = 0) out vec4 outFragColor;
+
+// Blended additively, one fragment adds one step: a pixel turns fully red after 8 layers and white after 32
+void main() 
+{
+	outFragColor = vec4(0.125, 0.03125, 0.03125, 1.0);
+}
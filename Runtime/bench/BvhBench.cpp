@@ -0,0 +1,197 @@
+// Microbenchmark for Bvh: build and refit time, and frustum, ray and region queries against linear scans.
+// Usage: vent_bench_bvh [iterations]
+
+#include "render/Bvh.hpp"
+#include "render/FrustumCuller.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/// Same scene as the culling benchmark: scaled unit boxes spread over a cube around the camera
+static void fill(FrustumCuller &culler, std::vector<Aabb> &boxes, const size_t count, const float offset)
+{
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 4.0f);
+
+    culler.resize(count);
+    boxes.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng) + offset, position(rng), position(rng)));
+        world = glm::scale(world, glm::vec3(scale(rng), scale(rng), scale(rng)));
+        culler.setBounds(static_cast<uint32_t>(i), world, glm::vec3(-1.0f), glm::vec3(1.0f));
+        boxes[i] = culler.getBounds(static_cast<uint32_t>(i));
+    }
+}
+
+template <typename Fn>
+static double best_of(const int iterations, Fn &&fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+/// Reference for Bvh::raycast: nearest box entry over every box
+static uint32_t raycast_linear(const std::vector<Aabb> &boxes, const glm::vec3 &origin, const glm::vec3 &direction, float &distance)
+{
+    const glm::vec3 inverse = 1.0f / direction;
+    uint32_t hit = Bvh::NO_HIT;
+    for (uint32_t i = 0; i < boxes.size(); i++)
+    {
+        const glm::vec3 t0 = (boxes[i].min() - origin) * inverse;
+        const glm::vec3 t1 = (boxes[i].max() - origin) * inverse;
+        const glm::vec3 lower = glm::min(t0, t1);
+        const glm::vec3 upper = glm::max(t0, t1);
+        const float entry = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+        const float exit = std::min(std::min(upper.x, upper.y), upper.z);
+        if (entry <= exit && entry < distance)
+        {
+            distance = entry;
+            hit = i;
+        }
+    }
+    return hit;
+}
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+
+    const glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 2000.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    // A narrow frustum, like a shadow cascade or a zoomed camera, where the tree skips the most
+    const glm::mat4 narrow_projection = glm::perspectiveRH_ZO(glm::radians(10.0f), 1.0f, 0.1f, 2000.0f);
+    const Frustum narrow = Frustum::fromMatrix(narrow_projection * view);
+
+    constexpr uint32_t query_count = 1000;
+
+    std::printf("Bvh, best of %d runs, %u rays and regions\n", iterations, query_count);
+    std::printf("%10s %6s %9s %9s %6s | %-21s | %-21s | %-21s | %-21s | %s\n", "objects", "nodes", "build ms", "refit ms", "depth", "frustum ms (linear)",
+                "narrow ms (linear)", "ray us (linear)", "region us (linear)", "mismatches");
+
+    for (const size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        FrustumCuller culler;
+        std::vector<Aabb> boxes, moved;
+        fill(culler, boxes, count, 0.0f);
+
+        FrustumCuller moved_culler;
+        fill(moved_culler, moved, count, 5.0f);
+
+        Bvh bvh;
+        const double build = best_of(iterations, [&]
+                                     { bvh.build(boxes); });
+
+        // Every object moved, the worst case for a refit
+        const double refit = best_of(iterations, [&]
+                                     { bvh.refit(moved); });
+        bvh.build(boxes);
+
+        size_t mismatches = 0;
+
+        std::vector<uint8_t> visible(count);
+        std::vector<uint32_t> found;
+        double frustum_ms[2][2];
+        const Frustum *frustums[2] = {&frustum, &narrow};
+        for (int f = 0; f < 2; f++)
+        {
+            frustum_ms[f][1] = best_of(iterations, [&]
+                                       { culler.cull(*frustums[f], visible.data()); });
+            frustum_ms[f][0] = best_of(iterations, [&]
+                                       {
+                found.clear();
+                bvh.cull(*frustums[f], found); });
+
+            std::vector<uint8_t> from_tree(count, 0);
+            for (const uint32_t i : found)
+            {
+                from_tree[i] = 1;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                mismatches += from_tree[i] != visible[i];
+            }
+        }
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+
+        std::vector<glm::vec3> origins(query_count), directions(query_count);
+        std::vector<Aabb> regions(query_count);
+        for (uint32_t i = 0; i < query_count; i++)
+        {
+            origins[i] = glm::vec3(position(rng), position(rng), position(rng));
+            directions[i] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+            regions[i] = {glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(20.0f)};
+        }
+
+        // Compared by distance, boxes entered at the same distance may be reported either way
+        std::vector<float> tree_hits(query_count), linear_hits(query_count);
+        const double ray_tree = best_of(iterations, [&]
+                                        {
+            for (uint32_t i = 0; i < query_count; i++)
+            {
+                float distance = 4000.0f;
+                bvh.raycast(origins[i], directions[i], distance);
+                tree_hits[i] = distance;
+            } });
+        const double ray_linear = best_of(1, [&]
+                                          {
+            for (uint32_t i = 0; i < query_count; i++)
+            {
+                float distance = 4000.0f;
+                raycast_linear(boxes, origins[i], directions[i], distance);
+                linear_hits[i] = distance;
+            } });
+        for (uint32_t i = 0; i < query_count; i++)
+        {
+            mismatches += tree_hits[i] != linear_hits[i];
+        }
+
+        size_t tree_found = 0, linear_found = 0;
+        const double region_tree = best_of(iterations, [&]
+                                           {
+            tree_found = 0;
+            for (const auto &region : regions)
+            {
+                found.clear();
+                bvh.query(region, found);
+                tree_found += found.size();
+            } });
+        const double region_linear = best_of(1, [&]
+                                             {
+            linear_found = 0;
+            for (const auto &region : regions)
+            {
+                for (const auto &box : boxes)
+                {
+                    linear_found += box.intersects(region);
+                }
+            } });
+        mismatches += tree_found != linear_found;
+
+        const double per_query = 1000.0 / query_count;
+        std::printf("%10zu %6zu %9.2f %9.2f %6u | %8.3f (%8.3f)   | %8.3f (%8.3f)   | %8.2f (%9.2f)  | %8.2f (%9.2f)  | %zu\n", count, bvh.getNodeCount(), build, refit,
+                    bvh.getDepth(), frustum_ms[0][0], frustum_ms[0][1], frustum_ms[1][0], frustum_ms[1][1], ray_tree * per_query, ray_linear * per_query,
+                    region_tree * per_query, region_linear * per_query, mismatches);
+    }
+
+    return 0;
+}
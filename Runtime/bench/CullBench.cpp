@@ -0,0 +1,86 @@
+// Microbenchmark for FrustumCuller: scalar reference against the SIMD path, on one thread and over the job system.
+// Usage: vent_bench_culling [iterations]
+
+#include "jobs/JobSystem.hpp"
+#include "render/FrustumCuller.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/// Unit boxes spread over a cube around the camera, so roughly a fifth is inside its 90 degree frustum
+static void fill(FrustumCuller &culler, const size_t count)
+{
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 4.0f);
+
+    culler.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng), position(rng)));
+        world = glm::scale(world, glm::vec3(scale(rng), scale(rng), scale(rng)));
+        culler.setBounds(static_cast<uint32_t>(i), world, glm::vec3(-1.0f), glm::vec3(1.0f));
+    }
+}
+
+template <typename Fn>
+static double best_of(const int iterations, Fn &&fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+
+    const glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 2000.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    JobSystem jobs;
+
+    std::printf("FrustumCuller SIMD path: %s, %u job threads, best of %d runs\n", FrustumCuller::simdPath(), jobs.getThreadCount(), iterations);
+    std::printf("%10s %9s %13s %13s %13s %9s %10s\n", "objects", "visible", "scalar ns/obj", "simd ns/obj", "jobs ns/obj", "speedup", "mismatches");
+
+    for (const size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        FrustumCuller culler;
+        fill(culler, count);
+
+        std::vector<uint8_t> reference(count), visible(count), parallel(count);
+
+        const double scalar = best_of(iterations, [&]
+                                      { culler.cullScalar(frustum, reference.data(), 0, count); });
+        const double simd = best_of(iterations, [&]
+                                    { culler.cull(frustum, visible.data()); });
+        const double threaded = best_of(iterations, [&]
+                                        { culler.cull(frustum, parallel.data(), jobs); });
+
+        size_t inside = 0, mismatches = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            inside += reference[i];
+            mismatches += (visible[i] != reference[i]) + (parallel[i] != reference[i]);
+        }
+
+        const double per_object = 1e6 / static_cast<double>(count);
+        std::printf("%10zu %8.1f%% %13.3f %13.3f %13.3f %8.2fx %10zu\n", count, 100.0 * static_cast<double>(inside) / static_cast<double>(count),
+                    scalar * per_object, simd * per_object, threaded * per_object, scalar / threaded, mismatches);
+    }
+
+    return 0;
+}
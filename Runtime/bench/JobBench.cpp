@@ -0,0 +1,118 @@
+// Microbenchmark for JobSystem: parallelFor scaling from 1 to N threads, scheduling overhead and dependency chains.
+// Usage: vent_bench_jobs [max threads]
+
+#include "jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/// Some floating point work per element, so batches are compute bound
+static float work(const uint32_t index)
+{
+    float value = static_cast<float>(index);
+    for (int i = 0; i < 64; i++)
+    {
+        value = std::sqrt(value * 1.0001f + 1.0f);
+    }
+    return value;
+}
+
+template <typename Fn>
+static double best_of(const int iterations, Fn &&fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t max_threads = argc > 1 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[1]))) : hardware;
+
+    constexpr uint32_t count = 1 << 20;
+    std::vector<float> output(count);
+
+    std::printf("parallelFor over %u elements, batches of 1024\n", count);
+    std::printf("%8s %12s %10s %s\n", "threads", "ms", "speedup", "utilization per thread");
+
+    double single_ms = 0.0;
+    for (uint32_t threads = 1; threads <= max_threads; threads++)
+    {
+        JobSystem jobs(threads);
+
+        const auto run = [&jobs, &output] {
+            jobs.parallelFor(count, 1024, [&output](const uint32_t begin, const uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                {
+                    output[i] = work(i);
+                }
+            });
+        };
+
+        run();
+        jobs.resetStats();
+        const double ms = best_of(5, run);
+        if (threads == 1)
+        {
+            single_ms = ms;
+        }
+
+        std::printf("%8u %12.3f %9.2fx ", jobs.getThreadCount(), ms, single_ms / ms);
+        for (const auto &stats : jobs.getStats())
+        {
+            std::printf(" %3.0f%%", stats.utilization * 100.0);
+        }
+        std::printf("\n");
+    }
+
+    JobSystem jobs(max_threads);
+
+    // Empty jobs measure the scheduling cost itself
+    constexpr uint32_t empty_jobs = 100000;
+    const double schedule_ms = best_of(5, [&jobs] {
+        JobCounter counter;
+        for (uint32_t i = 0; i < empty_jobs; i++)
+        {
+            jobs.schedule([] {}, &counter);
+        }
+        jobs.wait(counter);
+    });
+    std::printf("\n%u empty jobs on %u threads: %.1f ns per job\n", empty_jobs, jobs.getThreadCount(), schedule_ms * 1000000.0 / empty_jobs);
+
+    // Each stage waits for the previous one through its counter
+    constexpr uint32_t stages = 1000;
+    std::vector<uint32_t> order;
+    order.reserve(stages);
+    const double chain_ms = best_of(1, [&jobs, &order] {
+        std::vector<JobCounter> counters(stages);
+        for (uint32_t i = 0; i < stages; i++)
+        {
+            jobs.schedule([&order, i] { order.push_back(i); }, &counters[i], i > 0 ? &counters[i - 1] : nullptr);
+        }
+        for (auto &counter : counters)
+        {
+            jobs.wait(counter);
+        }
+    });
+
+    bool ordered = order.size() == stages;
+    for (uint32_t i = 0; ordered && i < stages; i++)
+    {
+        ordered = order[i] == i;
+    }
+    std::printf("%u dependent jobs: %.3f ms, %s\n", stages, chain_ms, ordered ? "in order" : "OUT OF ORDER");
+
+    return ordered ? 0 : 1;
+}
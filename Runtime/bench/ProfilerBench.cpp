@@ -0,0 +1,70 @@
+// Microbenchmark for CpuProfiler: cost of a zone while capturing, while idle, and from several threads.
+// Usage: vent_bench_profiler [zones per thread]
+
+#include "profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/// Records count zones and returns the nanoseconds per zone the calling thread spent
+static double zones(const int count)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        VENT_PROFILE_ZONE("bench zone");
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+/// Average per-thread cost, threads time their own loop. Oversubscribed cores inflate it through preemption.
+static double ns_per_zone(const int threads, const int count)
+{
+    CpuProfiler::start();
+
+    std::vector<double> results(threads);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+    {
+        workers.emplace_back([&results, t, count]() { results[t] = zones(count); });
+    }
+    results[0] = zones(count);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    CpuProfiler::stop();
+
+    double total = 0.0;
+    for (const double result : results)
+    {
+        total += result;
+    }
+    return total / threads;
+}
+
+int main(int argc, char *argv[])
+{
+    // Stays below the per-thread buffer capacity, so no zone gets dropped
+    const int count = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50000;
+
+    zones(count);
+    std::printf("%-24s %10.2f ns/zone\n", "not capturing", zones(count));
+
+    for (const int threads : {1, 2, 4, 8})
+    {
+        ns_per_zone(threads, count); // warm-up, registers the thread buffers
+        std::printf("capturing, %d thread(s) %10.2f ns/zone\n", threads, ns_per_zone(threads, count));
+    }
+
+    std::printf("dropped zones: %llu\n", static_cast<unsigned long long>(CpuProfiler::droppedZones()));
+
+    return CpuProfiler::writeChromeTrace("profiler_bench_trace.json") ? 0 : 1;
+}
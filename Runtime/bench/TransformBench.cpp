@@ -0,0 +1,80 @@
+// Microbenchmark for TransformStorage: SIMD world matrix pass against the scalar reference.
+// Usage: vent_bench_transforms [iterations]
+
+#include "objects/TransformStorage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static void fill(TransformStorage &transforms, const size_t count)
+{
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    transforms.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const glm::quat rotation(glm::vec3(angle(rng), angle(rng), angle(rng)));
+        transforms.add(glm::vec3(position(rng), position(rng), position(rng)), rotation, glm::vec3(scale(rng), scale(rng), scale(rng)));
+    }
+}
+
+template <typename Fn>
+static double best_of(const int iterations, Fn &&fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+
+    std::printf("TransformStorage SIMD path: %s, best of %d runs\n", TransformStorage::simdPath(), iterations);
+    std::printf("%10s %12s %12s %10s %12s %10s\n", "objects", "scalar ms", "simd ms", "speedup", "ns/object", "max error");
+
+    for (const size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        TransformStorage transforms;
+        fill(transforms, count);
+
+        std::vector<glm::mat4> world(count), normal(count);
+        std::vector<glm::mat4> reference_world(count), reference_normal(count);
+
+        const double scalar = best_of(iterations, [&]
+                                      { transforms.computeWorldMatricesScalar(reference_world.data(), reference_normal.data(), 0, count); });
+        const double simd = best_of(iterations, [&]
+                                    { transforms.computeWorldMatrices(world.data(), normal.data()); });
+
+        float max_error = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                for (int r = 0; r < 4; r++)
+                {
+                    max_error = std::max(max_error, std::fabs(world[i][c][r] - reference_world[i][c][r]));
+                    max_error = std::max(max_error, std::fabs(normal[i][c][r] - reference_normal[i][c][r]));
+                }
+            }
+        }
+
+        std::printf("%10zu %12.3f %12.3f %9.2fx %12.2f %10.2e\n", count, scalar, simd, scalar / simd, simd * 1e6 / static_cast<double>(count), max_error);
+    }
+
+    return 0;
+}
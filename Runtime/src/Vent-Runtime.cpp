@@ -1,5 +1,57 @@
 ﻿#include "Vent-Runtime.hpp"
 
+#include "benchmark/FlyThrough.hpp"
+
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+/// Writes RGBA8 pixels as a binary PPM, good enough for comparing headless frames in CI
+static bool writeScreenshot(const std::string &path, const std::vector<uint8_t> &pixels, const uint32_t width, const uint32_t height)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "P6\n"
+		 << width << " " << height << "\n255\n";
+	for (size_t i = 0; i + 3 < pixels.size(); i += 4)
+	{
+		file.write(reinterpret_cast<const char *>(&pixels[i]), 3);
+	}
+
+	return static_cast<bool>(file);
+}
+
+/// Describes the run for the benchmark report, so results of different feature switches can be told apart
+static std::string benchmarkConfiguration(const Renderer &renderer, const int argc, const char *const argv[])
+{
+	std::ostringstream json;
+	json << "{\"headless\": " << (renderer.isHeadless() ? "true" : "false")
+		 << ", \"present_mode\": \"" << vk::to_string(renderer.getPresentMode()) << "\""
+		 << ", \"frames_in_flight\": " << context->frames_in_flight
+		 << ", \"width\": " << context->swapchain_dimensions.width << ", \"height\": " << context->swapchain_dimensions.height
+		 << ", \"args\": [";
+	for (int i = 1; i < argc; i++)
+	{
+		json << (i > 1 ? ", " : "") << '"';
+		for (const char *c = argv[i]; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				json << '\\';
+			}
+			json << *c;
+		}
+		json << '"';
+	}
+	json << "]}";
+	return json.str();
+}
+
 int main(int argc, char *argv[])
 {
 #ifndef NDEBUG
@@ -9,9 +61,110 @@ int main(int argc, char *argv[])
 
 	try
 	{
-		renderer = std::make_unique<Renderer>();
+		ApplicationInfo info{"Vent-Engine Runtime", 800, 800};
+		parseCommandLine(info, argc, argv);
+
+		// Runtime only: --frames N quits after N frames, --screenshot PATH reads the last one back (headless),
+		// --gpu-profile PATH streams GPU timings to PATH.csv and writes the rolling history to PATH.json on exit,
+		// --cpu-trace PATH captures CPU zones from startup and writes them as Chrome trace JSON on exit.
+		// --benchmark flies the scripted Sponza path with a fixed timestep: --warmup N frames, then --frames N recorded ones,
+		// written to --out PATH (vent_benchmark.json)
+		uint64_t max_frames = 0;
+		std::string screenshot;
+		std::string gpu_profile;
+		std::string cpu_trace = "vent_cpu_trace.json";
+		bool trace_from_start = false;
+		// --record-scaling logs the recording time of 10k and 100k draws on 1 to N threads and quits
+		// --verify-gpu-culling compares the last frame's GPU frustum cull with the CPU and exits with 1 on a mismatch, e.g.
+		// Vent-Runtime --headless --gpu-culling --frames 3 --verify-gpu-culling, which runs on lavapipe without a GPU
+		bool benchmark_mode = false;
+		bool record_scaling = false;
+		bool verify_culling = false;
+		BenchmarkSettings benchmark_settings;
+		for (int i = 1; i < argc; i++)
+		{
+			if (std::string_view(argv[i]) == "--benchmark")
+			{
+				benchmark_mode = true;
+			}
+			else if (std::string_view(argv[i]) == "--record-scaling")
+			{
+				record_scaling = true;
+			}
+			else if (std::string_view(argv[i]) == "--verify-gpu-culling")
+			{
+				verify_culling = true;
+			}
+		}
+		for (int i = 1; i + 1 < argc; i++)
+		{
+			const std::string_view arg = argv[i];
+			if (arg == "--frames")
+			{
+				max_frames = std::strtoull(argv[++i], nullptr, 10);
+				benchmark_settings.frames = static_cast<uint32_t>(max_frames);
+			}
+			else if (arg == "--warmup")
+			{
+				benchmark_settings.warmup_frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			}
+			else if (arg == "--out")
+			{
+				benchmark_settings.output = argv[++i];
+			}
+			else if (arg == "--screenshot")
+			{
+				screenshot = argv[++i];
+			}
+			else if (arg == "--gpu-profile")
+			{
+				gpu_profile = argv[++i];
+			}
+			else if (arg == "--cpu-trace")
+			{
+				cpu_trace = argv[++i];
+				trace_from_start = true;
+			}
+		}
+
+		CpuProfiler::setThreadName("Main");
+		if (trace_from_start)
+		{
+			// Started before the renderer, so asset loading is part of the capture
+			CpuProfiler::start();
+		}
+
+		renderer = std::make_unique<Renderer>(info);
+
+		if (record_scaling)
+		{
+			const uint32_t max_threads = JobSystem::get().getThreadCount();
+			renderer->measureRecordingScaling(max_threads, 10000);
+			renderer->measureRecordingScaling(max_threads, 100000);
+			return 0;
+		}
+
+		if (!gpu_profile.empty())
+		{
+			renderer->getGpuProfiler().setCsvOutput(gpu_profile + ".csv");
+		}
 
-		renderer->window.grabMouse(true);
+		if (verify_culling && max_frames == 0)
+		{
+			max_frames = 3;
+		}
+
+		std::optional<FlyThroughBenchmark> benchmark;
+		if (benchmark_mode)
+		{
+			// The benchmark ends the run itself
+			max_frames = 0;
+			benchmark.emplace(benchmark_settings, CameraPath::sponza());
+		}
+		else
+		{
+			renderer->window.grabMouse(true);
+		}
 
 		float delta = 0.0f;
 		uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
@@ -19,25 +172,172 @@ int main(int argc, char *argv[])
 
 		SDL_Event event;
 		bool running = true;
+		uint64_t frame = 0;
 		while (running)
 		{
 			while (SDL_PollEvent(&event))
 			{
 				running = renderer->window.handleEvents(event, renderer->camera);
+
+				// F6 toggles a CPU capture, written when it stops
+				if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F6)
+				{
+					if (CpuProfiler::isCapturing())
+					{
+						CpuProfiler::stop();
+						CpuProfiler::writeChromeTrace(cpu_trace);
+						SDL_Log("CPU trace written to %s", cpu_trace.c_str());
+					}
+					else
+					{
+						CpuProfiler::start();
+					}
+				}
+
+				// F7 cycles shaded -> overdraw -> depth tested overdraw
+				if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F7)
+				{
+					switch (renderer->getRenderMode())
+					{
+					case RenderMode::Shaded:
+						renderer->setRenderMode(RenderMode::Overdraw);
+						break;
+					case RenderMode::Overdraw:
+						renderer->setRenderMode(RenderMode::OverdrawDepthTested);
+						break;
+					default:
+						renderer->setRenderMode(RenderMode::Shaded);
+						break;
+					}
+				}
+
+				// F8 toggles pipeline statistics, turning them off logs the last completed frame's
+				if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F8)
+				{
+					if (!renderer->getGpuProfiler().isStatisticsEnabled())
+					{
+						renderer->setPipelineStatistics(true);
+						continue;
+					}
+
+					renderer->setPipelineStatistics(false);
+					const PipelineStatistics &statistics = renderer->getPipelineStatistics();
+					SDL_Log("Main pass: %llu primitives, %llu vertex invocations, %llu clipped primitives, %llu fragment invocations",
+							static_cast<unsigned long long>(statistics.input_assembly_primitives), static_cast<unsigned long long>(statistics.vertex_shader_invocations),
+							static_cast<unsigned long long>(statistics.clipping_primitives), static_cast<unsigned long long>(statistics.fragment_shader_invocations));
+				}
+
+				// F5 cycles FIFO -> MAILBOX -> IMMEDIATE, recreating the swapchain
+				if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F5)
+				{
+					switch (renderer->getPresentMode())
+					{
+					case vk::PresentModeKHR::eFifo:
+						renderer->setPresentMode(vk::PresentModeKHR::eMailbox);
+						break;
+					case vk::PresentModeKHR::eMailbox:
+						renderer->setPresentMode(vk::PresentModeKHR::eImmediate);
+						break;
+					default:
+						renderer->setPresentMode(vk::PresentModeKHR::eFifo);
+						break;
+					}
+				}
+			}
+
+			frame++;
+			if (max_frames > 0 && frame >= max_frames)
+			{
+				running = false;
+
+				if (!screenshot.empty())
+				{
+					renderer->requestReadback();
+				}
+
+				if (verify_culling)
+				{
+					renderer->requestCullingReadback();
+				}
+			}
+
+			VENT_PROFILE_ZONE("Frame");
+
+			if (benchmark)
+			{
+				benchmark->update(renderer->camera.position, renderer->camera.rotation);
+				delta = benchmark->getTimestep();
 			}
 
 			uint32_t index = renderer->onPreUpdate(delta);
+			const uint64_t recordCounter = SDL_GetPerformanceCounter();
 			vk::CommandBuffer cmd = renderer->onPreDraw(index);
 			renderer->onPostDraw(cmd, index);
+			const uint64_t submitCounter = SDL_GetPerformanceCounter();
 			renderer->onPostUpdate(index);
 
 			uint64_t endCounter = SDL_GetPerformanceCounter();
 			uint64_t counterElapsed = endCounter - lastCounter;
-			delta = (static_cast<float>(counterElapsed)) / static_cast<float>(perfCounterFrequency);
 			lastCounter = endCounter;
 
+			if (benchmark)
+			{
+				// CPU time is recording and submission, GPU time the whole frame command buffer of an earlier frame
+				const double counter_to_ms = 1000.0 / static_cast<double>(perfCounterFrequency);
+				benchmark->record(static_cast<double>(counterElapsed) * counter_to_ms, static_cast<double>(submitCounter - recordCounter) * counter_to_ms,
+								  renderer->getGpuProfiler().latest("GPU frame"));
+				if (benchmark->isFinished())
+				{
+					running = false;
+				}
+			}
+			else
+			{
+				delta = (static_cast<float>(counterElapsed)) / static_cast<float>(perfCounterFrequency);
+			}
+
 			//	SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "FPS %f, %f ms", 1000 / delta, delta);
 		}
+
+		if (benchmark)
+		{
+			if (benchmark->writeJson(benchmarkConfiguration(*renderer, argc, argv)))
+			{
+				SDL_Log("Benchmark written to %s", benchmark_settings.output.c_str());
+			}
+			else
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write %s", benchmark_settings.output.c_str());
+			}
+		}
+
+		if (CpuProfiler::isCapturing())
+		{
+			CpuProfiler::stop();
+			if (!CpuProfiler::writeChromeTrace(cpu_trace))
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write %s", cpu_trace.c_str());
+			}
+		}
+
+		if (!gpu_profile.empty() && !renderer->getGpuProfiler().writeJson(gpu_profile + ".json"))
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write %s.json", gpu_profile.c_str());
+		}
+
+		if (verify_culling && !renderer->verifyGpuCulling())
+		{
+			return 1;
+		}
+
+		std::vector<uint8_t> pixels;
+		if (!screenshot.empty() && renderer->readback(pixels))
+		{
+			if (!writeScreenshot(screenshot, pixels, renderer->window.width, renderer->window.height))
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write %s", screenshot.c_str());
+			}
+		}
 	}
 	catch (const std::exception &e)
 	{
@@ -5,10 +5,100 @@
 
 #include "render/Renderer.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <memory>   
+#include <string_view>
 
 std::unique_ptr<Renderer> renderer;
 
+/// Applies the command line options shared by the Runtime and the Editor:
+/// --frames-in-flight N, --no-vsync (uncapped), --mailbox (low latency), --max-fps N, --headless, --pipeline-stats, --depth-prepass on|off|auto,
+/// --record-threads N, --no-instancing, --direct-draws, --no-culling, --bvh-culling, --gpu-culling, --occlusion-culling
+inline void parseCommandLine(ApplicationInfo &info, const int argc, const char *const argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string_view arg = argv[i];
+
+		if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			info.frames_in_flight = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (arg == "--no-vsync")
+		{
+			info.vsync = false;
+		}
+		else if (arg == "--mailbox")
+		{
+			info.vsync = true;
+			info.low_latency = true;
+		}
+		else if (arg == "--max-fps" && i + 1 < argc)
+		{
+			info.max_fps = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+		}
+		else if (arg == "--headless")
+		{
+			info.headless = true;
+		}
+		else if (arg == "--pipeline-stats")
+		{
+			info.pipeline_statistics = true;
+		}
+		else if (arg == "--depth-prepass" && i + 1 < argc)
+		{
+			const std::string_view mode = argv[++i];
+			if (mode == "on")
+			{
+				info.depth_prepass = DepthPrepass::On;
+			}
+			else if (mode == "auto")
+			{
+				info.depth_prepass = DepthPrepass::Auto;
+			}
+			else if (mode == "off")
+			{
+				info.depth_prepass = DepthPrepass::Off;
+			}
+			else
+			{
+				SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unknown --depth-prepass mode \"%.*s\", expected on, off or auto; ignoring it",
+							static_cast<int>(mode.size()), mode.data());
+			}
+		}
+		else if (arg == "--record-threads" && i + 1 < argc)
+		{
+			info.recording_threads = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (arg == "--no-instancing")
+		{
+			info.instancing = false;
+		}
+		else if (arg == "--direct-draws")
+		{
+			info.indirect_draws = false;
+		}
+		else if (arg == "--no-culling")
+		{
+			info.frustum_culling = false;
+		}
+		else if (arg == "--bvh-culling")
+		{
+			info.bvh_culling = true;
+		}
+		else if (arg == "--gpu-culling")
+		{
+			info.gpu_culling = true;
+		}
+		else if (arg == "--occlusion-culling")
+		{
+			info.gpu_culling = true;
+			info.occlusion_culling = true;
+		}
+	}
+}
+
 
 
 
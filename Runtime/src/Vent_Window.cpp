@@ -1,7 +1,18 @@
 #include "Vent_Window.hpp"
 
-Vent_Window::Vent_Window(const uint32_t &width, const uint32_t &height, const std::string_view &title) : width(width), height(height)
+Vent_Window::Vent_Window(const uint32_t &width, const uint32_t &height, const std::string_view &title, const bool headless) : handle(nullptr), width(width), height(height)
 {
+	if (headless)
+	{
+		// Events only, SDL_QUIT still works and no video driver is needed
+		if (SDL_Init(SDL_INIT_EVENTS))
+		{
+			SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Error initializing SDL: %s", SDL_GetError());
+			exit(1);
+		}
+		return;
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
 	{
 		SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Error initializing SDL: %s", SDL_GetError());
@@ -26,6 +37,11 @@ Vent_Window::~Vent_Window()
 
 void Vent_Window::grabMouse(const bool grab)
 {
+	if (!handle)
+	{
+		return;
+	}
+
 	this->_mouseGrabbed = grab;
 	SDL_ShowCursor(grab ? SDL_DISABLE : SDL_ENABLE);
 	SDL_SetWindowGrab(handle, grab ? SDL_TRUE : SDL_FALSE);
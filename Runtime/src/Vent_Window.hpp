@@ -19,6 +19,15 @@
 #include "objects/Camera.hpp"
 
 
+/// When the main pass draws the objects depth-only first
+enum class DepthPrepass
+{
+    Off,
+    On,
+    /// Decided from the overdraw the pipeline statistics measure without the pre-pass, see Renderer::setDepthPrepass
+    Auto,
+};
+
 struct ApplicationInfo {
     const std::string_view name;
 
@@ -26,7 +35,49 @@ struct ApplicationInfo {
     int width = 1080;
     int height = 720;
 
+    /// FIFO when set, otherwise IMMEDIATE (uncapped, may tear). Falls back along VKBase's present mode chain.
     bool vsync = true;
+
+    /// Prefer MAILBOX: no tearing, but the newest frame replaces the queued one instead of blocking.
+    bool low_latency = false;
+
+    /// Frame limiter for the uncapped present modes, 0 renders as fast as possible.
+    uint32_t max_fps = 0;
+
+    /// Render offscreen without a window, surface or swapchain, e.g. on display-less CI machines.
+    bool headless = false;
+
+    // Renderer
+    /// Frames the CPU may record ahead of the GPU, independent of the swapchain image count.
+    uint32_t frames_in_flight = 2;
+
+    /// Query pipeline statistics of the main pass, when the device supports it.
+    bool pipeline_statistics = false;
+
+    /// Lay down depth with a position-only pass before shading, so only the visible fragments are shaded.
+    DepthPrepass depth_prepass = DepthPrepass::Off;
+
+    /// Jobs recording the draw list into secondary command buffers, 1 records inline on the main thread.
+    uint32_t recording_threads = 1;
+
+    /// Draw objects sharing mesh and material as one instanced draw.
+    bool instancing = true;
+
+    /// Submit the draws from a per-frame buffer of indirect commands, when the device supports it.
+    bool indirect_draws = true;
+
+    /// Frustum cull the objects on the CPU before building the draw list.
+    bool frustum_culling = true;
+
+    /// Frustum cull by walking a BVH over the objects instead of testing each, see ObjectRenderer::setBvhCulling.
+    bool bvh_culling = false;
+
+    /// Frustum cull the objects in a compute pass that writes the indirect draws, needs indirect_draws.
+    bool gpu_culling = false;
+
+    /// Adds two-phase Hi-Z occlusion culling to the GPU cull, implies gpu_culling. Keeps the depth buffer between
+    /// the two passes the frame is drawn in.
+    bool occlusion_culling = false;
 };
 
 class Vent_Window
@@ -36,7 +87,8 @@ public:
 
     uint32_t width, height;
 
-    Vent_Window(const uint32_t &width, const uint32_t &height, const std::string_view &title);
+    /// A headless window has no SDL window (handle is null), only its size is used for the offscreen targets.
+    Vent_Window(const uint32_t &width, const uint32_t &height, const std::string_view &title, bool headless = false);
 
     ~Vent_Window();
 
@@ -52,8 +104,10 @@ public:
 
     bool isMouseGrabbed() { return _mouseGrabbed; }
 
+    bool isHeadless() const { return handle == nullptr; }
+
     void grabMouse(bool grab);
 
 private:
-    bool _mouseGrabbed;
+    bool _mouseGrabbed = false;
 };
@@ -0,0 +1,175 @@
+#include "FlyThrough.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+CameraPath::CameraPath(std::vector<glm::vec3> path_points, const float loop_duration) : points(std::move(path_points)), duration(loop_duration)
+{
+    if (points.size() < 4)
+    {
+        throw std::runtime_error("Camera path needs at least 4 points");
+    }
+}
+
+CameraPath CameraPath::sponza()
+{
+    // In the unscaled Sponza.gltf, meters: the nave runs along x, the galleries sit at about 6m on both sides
+    return CameraPath({
+                          {-12.0f, 1.8f, 0.0f},
+                          {-6.0f, 2.0f, 1.5f},
+                          {0.0f, 2.5f, 0.0f},
+                          {6.0f, 2.0f, -1.5f},
+                          {11.0f, 2.5f, 0.0f},
+                          {10.0f, 6.0f, 4.0f},
+                          {0.0f, 6.5f, 4.5f},
+                          {-10.0f, 6.0f, 4.0f},
+                          {-13.0f, 3.5f, 0.5f},
+                      },
+                      30.0f);
+}
+
+glm::vec3 CameraPath::evaluate(const float t) const
+{
+    const auto count = static_cast<float>(points.size());
+    const float wrapped = t - std::floor(t);
+    const float position = wrapped * count;
+
+    const auto segment = static_cast<size_t>(position) % points.size();
+    const float u = position - std::floor(position);
+
+    const glm::vec3 &p0 = points[(segment + points.size() - 1) % points.size()];
+    const glm::vec3 &p1 = points[segment];
+    const glm::vec3 &p2 = points[(segment + 1) % points.size()];
+    const glm::vec3 &p3 = points[(segment + 2) % points.size()];
+
+    // Uniform Catmull-Rom, passes through every point
+    const float u2 = u * u;
+    const float u3 = u2 * u;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+}
+
+void CameraPath::sample(const float time, glm::vec3 &position, glm::vec3 &rotation) const
+{
+    const float t = time / duration;
+    position = evaluate(t);
+
+    // Look along the tangent, a short step ahead on the path
+    const glm::vec3 ahead = evaluate(t + 0.002f) - position;
+    const float length = glm::length(ahead);
+    if (length > 0.0f)
+    {
+        const glm::vec3 direction = ahead / length;
+        rotation.x = std::atan2(direction.x, direction.z);
+        rotation.y = std::asin(std::clamp(direction.y, -1.0f, 1.0f));
+    }
+}
+
+FrameTimeSummary FrameTimeSummary::of(std::vector<double> samples)
+{
+    FrameTimeSummary summary;
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const auto count = static_cast<double>(samples.size());
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / count;
+    summary.max = samples.back();
+
+    const auto percentile = [&samples, count](const double p) {
+        const auto rank = static_cast<size_t>(std::ceil(p / 100.0 * count));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+
+    double squares = 0.0;
+    for (const double sample : samples)
+    {
+        squares += (sample - summary.mean) * (sample - summary.mean);
+    }
+    summary.variance = squares / count;
+
+    return summary;
+}
+
+FlyThroughBenchmark::FlyThroughBenchmark(const BenchmarkSettings &benchmark_settings, CameraPath camera_path)
+    : settings(benchmark_settings), path(std::move(camera_path))
+{
+    frame_times.reserve(settings.frames);
+    cpu_times.reserve(settings.frames);
+    gpu_times.reserve(settings.frames);
+}
+
+void FlyThroughBenchmark::update(glm::vec3 &position, glm::vec3 &rotation) const
+{
+    // Warm-up frames fly the path too, the recorded frames start where they ended
+    path.sample(static_cast<float>(frame) * settings.timestep, position, rotation);
+}
+
+void FlyThroughBenchmark::record(const double frame_ms, const double cpu_ms, const double gpu_ms)
+{
+    if (!isWarmingUp() && !isFinished())
+    {
+        frame_times.push_back(frame_ms);
+        cpu_times.push_back(cpu_ms);
+        if (gpu_ms >= 0.0)
+        {
+            gpu_times.push_back(gpu_ms);
+        }
+    }
+
+    frame++;
+}
+
+static void write_summary(std::ofstream &file, const char *name, const std::vector<double> &samples)
+{
+    const FrameTimeSummary summary = FrameTimeSummary::of(samples);
+    file << "  \"" << name << "\": {\"samples\": " << samples.size() << ", \"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+         << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << ", \"variance\": " << summary.variance << "},\n";
+}
+
+bool FlyThroughBenchmark::writeJson(const std::string &configuration) const
+{
+    std::ofstream file(settings.output, std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    file << "{\n";
+    file << "  \"warmup_frames\": " << settings.warmup_frames << ",\n";
+    file << "  \"frames\": " << frame_times.size() << ",\n";
+    file << "  \"timestep\": " << settings.timestep << ",\n";
+    file << "  \"configuration\": " << (configuration.empty() ? "{}" : configuration) << ",\n";
+
+    write_summary(file, "frame_ms", frame_times);
+    write_summary(file, "cpu_ms", cpu_times);
+    write_summary(file, "gpu_ms", gpu_times);
+
+    // GPU times lag the CPU by the frames in flight and may be missing, so they are their own series
+    file << "  \"per_frame\": {\n    \"frame_ms\": [";
+    for (size_t i = 0; i < frame_times.size(); i++)
+    {
+        file << (i > 0 ? ", " : "") << frame_times[i];
+    }
+    file << "],\n    \"cpu_ms\": [";
+    for (size_t i = 0; i < cpu_times.size(); i++)
+    {
+        file << (i > 0 ? ", " : "") << cpu_times[i];
+    }
+    file << "],\n    \"gpu_ms\": [";
+    for (size_t i = 0; i < gpu_times.size(); i++)
+    {
+        file << (i > 0 ? ", " : "") << gpu_times[i];
+    }
+    file << "]\n  }\n}\n";
+
+    return static_cast<bool>(file);
+}
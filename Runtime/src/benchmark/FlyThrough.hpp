@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Closed Catmull-Rom spline the benchmark camera follows, looking along the path.
+class CameraPath
+{
+public:
+    /// Needs at least 4 points. The path loops back from the last point to the first.
+    explicit CameraPath(std::vector<glm::vec3> points, float duration);
+
+    /// Fly-through of the Sponza atrium: along the nave, around the columns and back through the gallery.
+    static CameraPath sponza();
+
+    /// Position and rotation (yaw, pitch, as Camera expects them) at time seconds, wrapping around.
+    void sample(float time, glm::vec3 &position, glm::vec3 &rotation) const;
+
+    [[nodiscard]] float getDuration() const { return duration; }
+
+private:
+    std::vector<glm::vec3> points;
+
+    /// Seconds for one loop
+    float duration;
+
+    [[nodiscard]] glm::vec3 evaluate(float t) const;
+};
+
+/// Summary of one series of per-frame times, in milliseconds
+struct FrameTimeSummary
+{
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+    double variance = 0.0;
+
+    /// Nearest-rank percentiles, population variance. Empty input gives all zeros.
+    static FrameTimeSummary of(std::vector<double> samples);
+};
+
+struct BenchmarkSettings
+{
+    /// Frames rendered before recording starts, so pipelines, caches and clocks settle
+    uint32_t warmup_frames = 120;
+
+    /// Recorded frames
+    uint32_t frames = 1800;
+
+    /// Simulation step per frame, independent of how long frames actually take
+    float timestep = 1.0f / 60.0f;
+
+    /// JSON report
+    std::string output = "vent_benchmark.json";
+};
+
+/// Scripted, fixed-timestep camera fly-through recording per-frame CPU, GPU and frame times.
+///
+/// Per frame: update(camera position, rotation) before rendering, then record(...) once it was submitted.
+/// The camera only depends on the frame number, so every run renders the same frames.
+class FlyThroughBenchmark
+{
+public:
+    FlyThroughBenchmark(const BenchmarkSettings &settings, CameraPath path);
+
+    /// Moves the camera to where the path is at this frame.
+    void update(glm::vec3 &position, glm::vec3 &rotation) const;
+
+    /// Records the frame's times and advances, warm-up frames are dropped.
+    /// gpu_ms is negative when GPU timings are unavailable.
+    void record(double frame_ms, double cpu_ms, double gpu_ms);
+
+    [[nodiscard]] bool isWarmingUp() const { return frame < settings.warmup_frames; }
+
+    [[nodiscard]] bool isFinished() const { return frame >= settings.warmup_frames + settings.frames; }
+
+    [[nodiscard]] float getTimestep() const { return settings.timestep; }
+
+    /// Writes settings, summaries and per-frame samples. configuration is a free-form JSON object
+    /// describing the run (present mode, feature switches, ...), written as is.
+    bool writeJson(const std::string &configuration) const;
+
+private:
+    BenchmarkSettings settings;
+    CameraPath path;
+
+    uint32_t frame = 0;
+
+    std::vector<double> frame_times;
+    std::vector<double> cpu_times;
+    std::vector<double> gpu_times;
+};
@@ -0,0 +1,423 @@
+#include "JobSystem.hpp"
+
+#include "../profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+#include <string>
+
+/// The system and worker index of the calling thread, UINT32_MAX on threads without a deque
+static thread_local JobSystem *current_system = nullptr;
+static thread_local uint32_t current_index = UINT32_MAX;
+
+/// Failed takes before an idle worker goes to sleep
+static constexpr uint32_t IDLE_SPINS = 64;
+
+bool JobSystem::WorkQueue::push(Task *task)
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+    {
+        return false;
+    }
+
+    // Release on both, so a thief reading either sees the task's contents
+    tasks[b & (CAPACITY - 1)].store(task, std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Task *JobSystem::WorkQueue::pop()
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // Empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Task *task = tasks[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // Last task, race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+JobSystem::Task *JobSystem::WorkQueue::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    Task *task = tasks[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return task;
+}
+
+JobSystem::JobSystem(uint32_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const uint32_t worker_threads = thread_count - 1;
+
+    main_thread = std::this_thread::get_id();
+    current_system = this;
+    current_index = 0;
+
+    for (uint32_t i = 0; i <= worker_threads; i++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    stats_start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 1; i <= worker_threads; i++)
+    {
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        const std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // Jobs nobody waited for are dropped
+    for (auto &worker : workers)
+    {
+        while (Task *task = worker->queue.steal())
+        {
+            delete task;
+        }
+    }
+    for (Task *task : shared_queue)
+    {
+        delete task;
+    }
+    for (Task *task : main_queue)
+    {
+        delete task;
+    }
+
+    if (current_system == this)
+    {
+        current_system = nullptr;
+        current_index = UINT32_MAX;
+    }
+}
+
+JobSystem &JobSystem::get()
+{
+    static JobSystem system;
+    return system;
+}
+
+uint32_t JobSystem::currentWorker() const
+{
+    return current_system == this ? current_index : UINT32_MAX;
+}
+
+void JobSystem::push(Task *task)
+{
+    // Counted before it's visible, so takes never drive the count below zero. Pairs with the sleeping
+    // increment in workerLoop: either the worker sees the job or we see the sleeper.
+    queued.fetch_add(1, std::memory_order_seq_cst);
+
+    const uint32_t index = this->currentWorker();
+    if (index == UINT32_MAX || !workers[index]->queue.push(task))
+    {
+        const std::lock_guard lock(shared_mutex);
+        shared_queue.push_back(task);
+        shared_size.fetch_add(1, std::memory_order_release);
+    }
+
+    if (sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        {
+            const std::lock_guard lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+}
+
+JobSystem::Task *JobSystem::take(const uint32_t index)
+{
+    Task *task = nullptr;
+
+    if (index != UINT32_MAX)
+    {
+        task = workers[index]->queue.pop();
+    }
+
+    if (!task && shared_size.load(std::memory_order_acquire) > 0)
+    {
+        const std::lock_guard lock(shared_mutex);
+        if (!shared_queue.empty())
+        {
+            task = shared_queue.front();
+            shared_queue.pop_front();
+            shared_size.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!task)
+    {
+        const auto count = static_cast<uint32_t>(workers.size());
+        const uint32_t start = index == UINT32_MAX ? 0 : index + 1;
+        for (uint32_t i = 0; i < count && !task; i++)
+        {
+            const uint32_t victim = (start + i) % count;
+            if (victim != index)
+            {
+                task = workers[victim]->queue.steal();
+            }
+        }
+
+        if (task && index != UINT32_MAX)
+        {
+            workers[index]->steals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (task)
+    {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+void JobSystem::run(Task *task, const uint32_t index)
+{
+    const auto start = std::chrono::steady_clock::now();
+    task->job();
+    const auto end = std::chrono::steady_clock::now();
+
+    if (index != UINT32_MAX)
+    {
+        Worker &worker = *workers[index];
+        worker.jobs.fetch_add(1, std::memory_order_relaxed);
+        worker.busy_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()), std::memory_order_relaxed);
+    }
+
+    this->release(task->counter);
+    delete task;
+}
+
+void JobSystem::release(JobCounter *counter)
+{
+    if (!counter)
+    {
+        return;
+    }
+
+    // Under the lock, wait() takes it once more before returning, so the counter outlives this
+    std::vector<std::pair<Job, JobCounter *>> ready;
+    {
+        const std::lock_guard lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            ready.swap(counter->dependents);
+        }
+    }
+
+    for (auto &[job, job_counter] : ready)
+    {
+        this->push(new Task{std::move(job), job_counter});
+    }
+}
+
+void JobSystem::schedule(Job job, JobCounter *counter, JobCounter *dependency)
+{
+    if (counter)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (dependency)
+    {
+        // Checked under the lock release takes, so the dependency can't complete in between unnoticed
+        const std::lock_guard lock(dependency->mutex);
+        if (dependency->pending.load(std::memory_order_acquire) != 0)
+        {
+            dependency->dependents.emplace_back(std::move(job), counter);
+            return;
+        }
+    }
+
+    this->push(new Task{std::move(job), counter});
+}
+
+void JobSystem::scheduleOnMainThread(Job job, JobCounter *counter)
+{
+    if (counter)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const std::lock_guard lock(main_mutex);
+    main_queue.push_back(new Task{std::move(job), counter});
+}
+
+void JobSystem::runMainThreadJobs()
+{
+    if (std::this_thread::get_id() != main_thread)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        Task *task;
+        {
+            const std::lock_guard lock(main_mutex);
+            if (main_queue.empty())
+            {
+                return;
+            }
+            task = main_queue.front();
+            main_queue.pop_front();
+        }
+
+        this->run(task, 0);
+    }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    const uint32_t index = this->currentWorker();
+    const bool on_main_thread = std::this_thread::get_id() == main_thread;
+
+    while (!counter.isDone())
+    {
+        if (on_main_thread)
+        {
+            this->runMainThreadJobs();
+        }
+
+        if (Task *task = this->take(index))
+        {
+            this->run(task, index);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // The last release may still hold the lock
+    const std::lock_guard lock(counter.mutex);
+}
+
+void JobSystem::parallelFor(const uint32_t count, const uint32_t batch_size, const std::function<void(uint32_t, uint32_t)> &fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const uint32_t batch = std::max(1u, batch_size);
+
+    // The first batch runs on the calling thread, the rest is up for grabs
+    JobCounter counter;
+    for (uint32_t begin = batch; begin < count; begin += batch)
+    {
+        const uint32_t end = std::min(count, begin + batch);
+        this->schedule([&fn, begin, end] { fn(begin, end); }, &counter);
+    }
+
+    fn(0, std::min(count, batch));
+    this->wait(counter);
+}
+
+void JobSystem::workerLoop(const uint32_t index)
+{
+    current_system = this;
+    current_index = index;
+    CpuProfiler::setThreadName("Worker " + std::to_string(index));
+
+    uint32_t idle = 0;
+    while (true)
+    {
+        if (Task *task = this->take(index))
+        {
+            this->run(task, index);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_seq_cst) > 0; });
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::getStats() const
+{
+    const double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stats_start).count();
+
+    std::vector<WorkerStats> stats;
+    stats.reserve(workers.size());
+    for (const auto &worker : workers)
+    {
+        WorkerStats worker_stats;
+        worker_stats.jobs = worker->jobs.load(std::memory_order_relaxed);
+        worker_stats.steals = worker->steals.load(std::memory_order_relaxed);
+        worker_stats.busy_ms = static_cast<double>(worker->busy_ns.load(std::memory_order_relaxed)) / 1000000.0;
+        worker_stats.utilization = wall_ms > 0.0 ? worker_stats.busy_ms / wall_ms : 0.0;
+        stats.push_back(worker_stats);
+    }
+    return stats;
+}
+
+void JobSystem::resetStats()
+{
+    for (auto &worker : workers)
+    {
+        worker->jobs.store(0, std::memory_order_relaxed);
+        worker->steals.store(0, std::memory_order_relaxed);
+        worker->busy_ns.store(0, std::memory_order_relaxed);
+    }
+    stats_start = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Counts the unfinished jobs it was handed to. Jobs can depend on a counter, they start once it reaches zero.
+/// Only destroy a counter after JobSystem::wait returned for it, isDone alone doesn't guarantee the last job let go.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+
+    JobCounter(const JobCounter &) = delete;
+
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    [[nodiscard]] bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending{0};
+
+    /// Jobs waiting for this counter with their own counters, scheduled by the job that brings it to zero
+    std::mutex mutex;
+    std::vector<std::pair<std::function<void()>, JobCounter *>> dependents;
+};
+
+/// Work-stealing job scheduler.
+///
+/// Every worker owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom, idle workers steal
+/// from the top of the others. The thread that created the system counts as worker 0 and runs jobs while
+/// it waits. Jobs scheduled from any other thread go through a shared queue. Main thread jobs only run
+/// on the creating thread, in runMainThreadJobs or while it waits.
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+
+    /// Busy time and job counts of one worker since the last resetStats
+    struct WorkerStats
+    {
+        uint64_t jobs = 0;
+        uint64_t steals = 0;
+        double busy_ms = 0.0;
+
+        /// Share of the wall time since resetStats spent running jobs
+        double utilization = 0.0;
+    };
+
+    /// thread_count includes the calling thread, 0 sizes the system to the hardware: one thread per core.
+    explicit JobSystem(uint32_t thread_count = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    /// The Runtime's scheduler, created on first use by the thread that is the main thread from then on.
+    static JobSystem &get();
+
+    /// Runs job on any thread. counter, if given, counts it until it finished.
+    /// With a dependency the job only starts once that counter reached zero.
+    void schedule(Job job, JobCounter *counter = nullptr, JobCounter *dependency = nullptr);
+
+    /// Runs job on the main thread, e.g. for work touching Vulkan objects that aren't externally synchronized.
+    void scheduleOnMainThread(Job job, JobCounter *counter = nullptr);
+
+    /// Calls fn(begin, end) for batches of at most batch_size indices of [0, count) as jobs and waits for them.
+    void parallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)> &fn);
+
+    /// Runs other jobs until counter reached zero.
+    void wait(JobCounter &counter);
+
+    /// Runs the queued main thread jobs, call once per frame. Does nothing on other threads.
+    void runMainThreadJobs();
+
+    /// Threads running jobs, including the main thread
+    [[nodiscard]] uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    /// Per thread, index 0 is the main thread.
+    [[nodiscard]] std::vector<WorkerStats> getStats() const;
+
+    void resetStats();
+
+private:
+    struct Task
+    {
+        Job job;
+        JobCounter *counter;
+    };
+
+    /// Chase-Lev deque of fixed capacity, the owner pushes and pops at the bottom, thieves take the top.
+    class WorkQueue
+    {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+
+        /// Owner only, false when full
+        bool push(Task *task);
+
+        /// Owner only
+        Task *pop();
+
+        /// Any thread, null when empty or another thief won
+        Task *steal();
+
+    private:
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::array<std::atomic<Task *>, CAPACITY> tasks{};
+    };
+
+    struct Worker
+    {
+        WorkQueue queue;
+
+        std::atomic<uint64_t> jobs{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    /// Deques are large, workers live on the heap so the vector never moves them
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::thread::id main_thread;
+
+    /// Jobs from threads without a deque and deque overflow
+    std::mutex shared_mutex;
+    std::deque<Task *> shared_queue;
+    std::atomic<uint32_t> shared_size{0};
+
+    std::mutex main_mutex;
+    std::deque<Task *> main_queue;
+
+    /// Jobs in any queue, sleeping workers wait for it to become non-zero
+    std::atomic<uint32_t> queued{0};
+    std::atomic<uint32_t> sleeping{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::chrono::steady_clock::time_point stats_start;
+
+    void workerLoop(uint32_t index);
+
+    void push(Task *task);
+
+    /// Own deque, then the shared queue, then stealing. index is the caller's worker or UINT32_MAX.
+    Task *take(uint32_t index);
+
+    void run(Task *task, uint32_t index);
+
+    void release(JobCounter *counter);
+
+    [[nodiscard]] uint32_t currentWorker() const;
+};
@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 
+#include "SceneGraph.hpp"
+
 class GameObject
 {
 private:
@@ -9,6 +11,36 @@ public:
     glm::vec3 position = glm::vec3();
     glm::vec3 rotation = glm::vec3();
     glm::vec3 scale = glm::vec3(1.0f);
-};
 
+    /// Scene graph node of this object, set once it's added to a scene.
+    SceneGraph *scene = nullptr;
+    uint32_t node = SceneGraph::NO_PARENT;
+
+    void setPosition(const glm::vec3 &value)
+    {
+        position = value;
+        syncTransform();
+    }
 
+    void setRotation(const glm::vec3 &value)
+    {
+        rotation = value;
+        syncTransform();
+    }
+
+    void setScale(const glm::vec3 &value)
+    {
+        scale = value;
+        syncTransform();
+    }
+
+    /// Pushes position, rotation (euler degrees) and scale to the scene graph, marking the node dirty.
+    /// Only needed after writing the fields directly, the setters do this already.
+    void syncTransform()
+    {
+        if (scene)
+        {
+            scene->setLocal(node, position, glm::quat(glm::radians(rotation)), scale);
+        }
+    }
+};
@@ -0,0 +1,110 @@
+#include "SceneGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t SceneGraph::addNode(const uint32_t parent, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    const uint32_t node = size();
+
+    if (parent != NO_PARENT && parent >= node)
+    {
+        throw std::runtime_error("SceneGraph parent has to be added before its children");
+    }
+
+    parents.push_back(parent);
+    locals.add(position, rotation, scale);
+
+    local_matrices.emplace_back(1.0f);
+    local_normals.emplace_back(1.0f);
+    world_matrices.emplace_back(1.0f);
+    normal_matrices.emplace_back(1.0f);
+
+    dirty.push_back(1);
+    first_dirty = std::min(first_dirty, node);
+
+    return node;
+}
+
+void SceneGraph::setLocal(const uint32_t node, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    locals.set(node, position, rotation, scale);
+
+    dirty[node] = 1;
+    first_dirty = std::min(first_dirty, node);
+}
+
+void SceneGraph::update()
+{
+    changed_nodes.clear();
+
+    const uint32_t count = size();
+    if (first_dirty >= count)
+    {
+        return;
+    }
+
+    // Parents come first, so one forward pass pushes the flags down whole subtrees
+    for (uint32_t i = first_dirty; i < count; i++)
+    {
+        if (!dirty[i] && parents[i] != NO_PARENT && dirty[parents[i]])
+        {
+            dirty[i] = 2;
+        }
+    }
+
+    // Local matrices only change for nodes that were set explicitly, build them in contiguous runs
+    uint32_t run_start = first_dirty;
+    for (uint32_t i = first_dirty; i <= count; i++)
+    {
+        if (i < count && dirty[i] == 1)
+        {
+            continue;
+        }
+
+        if (i > run_start)
+        {
+            locals.computeWorldMatrices(local_matrices.data(), local_normals.data(), run_start, i - run_start);
+        }
+        run_start = i + 1;
+    }
+
+    for (uint32_t i = first_dirty; i < count; i++)
+    {
+        if (!dirty[i])
+        {
+            continue;
+        }
+
+        const uint32_t parent = parents[i];
+        if (parent == NO_PARENT)
+        {
+            world_matrices[i] = local_matrices[i];
+            normal_matrices[i] = local_normals[i];
+        }
+        else
+        {
+            // The inverse transpose of a product is the product of the inverse transposes
+            world_matrices[i] = world_matrices[parent] * local_matrices[i];
+            normal_matrices[i] = normal_matrices[parent] * local_normals[i];
+        }
+
+        dirty[i] = 0;
+        changed_nodes.push_back(i);
+    }
+
+    first_dirty = count;
+}
+
+void SceneGraph::clear()
+{
+    parents.clear();
+    locals.clear();
+    local_matrices.clear();
+    local_normals.clear();
+    world_matrices.clear();
+    normal_matrices.clear();
+    dirty.clear();
+    changed_nodes.clear();
+    first_dirty = 0;
+}
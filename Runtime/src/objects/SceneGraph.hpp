@@ -0,0 +1,57 @@
+#pragma once
+
+#include "TransformStorage.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// Transform hierarchy kept as flat arrays in topological order, every parent comes before its children.
+/// Only nodes marked dirty, and everything below them, get their world matrices rebuilt by update().
+class SceneGraph
+{
+private:
+    std::vector<uint32_t> parents;
+
+    /// Local transforms, turned into matrices with the SIMD pass of TransformStorage
+    TransformStorage locals;
+
+    std::vector<glm::mat4> local_matrices;
+    std::vector<glm::mat4> local_normals;
+
+    std::vector<glm::mat4> world_matrices;
+    std::vector<glm::mat4> normal_matrices;
+
+    /// 0 clean, 1 local transform changed, 2 only an ancestor changed
+    std::vector<uint8_t> dirty;
+
+    /// Lowest dirty node, nothing before it has to be looked at. size() if nothing is dirty.
+    uint32_t first_dirty = 0;
+
+    std::vector<uint32_t> changed_nodes;
+
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    /// Appends a node, the parent has to exist already which keeps the arrays topologically sorted.
+    uint32_t addNode(uint32_t parent, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+    void setLocal(uint32_t node, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+    /// Propagates dirty flags down the hierarchy and rebuilds the world matrices of dirty subtrees.
+    void update();
+
+    /// Nodes whose world matrix changed in the last update(), in ascending order.
+    [[nodiscard]] const std::vector<uint32_t> &changed() const { return changed_nodes; }
+
+    [[nodiscard]] uint32_t parent(const uint32_t node) const { return parents[node]; }
+
+    [[nodiscard]] const glm::mat4 &world(const uint32_t node) const { return world_matrices[node]; }
+
+    [[nodiscard]] const glm::mat4 *worldMatrices() const { return world_matrices.data(); }
+
+    [[nodiscard]] const glm::mat4 *normalMatrices() const { return normal_matrices.data(); }
+
+    [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(parents.size()); }
+
+    void clear();
+};
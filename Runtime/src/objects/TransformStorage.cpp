@@ -0,0 +1,243 @@
+#include "TransformStorage.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VENT_TRANSFORM_AVX2
+#define VENT_TRANSFORM_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define VENT_TRANSFORM_SSE
+#endif
+
+uint32_t TransformStorage::add(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    const auto index = static_cast<uint32_t>(size());
+    resize(index + 1);
+    set(index, position, rotation, scale);
+    return index;
+}
+
+void TransformStorage::set(const uint32_t index, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    position_x[index] = position.x;
+    position_y[index] = position.y;
+    position_z[index] = position.z;
+
+    rotation_x[index] = rotation.x;
+    rotation_y[index] = rotation.y;
+    rotation_z[index] = rotation.z;
+    rotation_w[index] = rotation.w;
+
+    scale_x[index] = scale.x;
+    scale_y[index] = scale.y;
+    scale_z[index] = scale.z;
+}
+
+void TransformStorage::resize(const size_t count)
+{
+    position_x.resize(count, 0.0f);
+    position_y.resize(count, 0.0f);
+    position_z.resize(count, 0.0f);
+
+    rotation_x.resize(count, 0.0f);
+    rotation_y.resize(count, 0.0f);
+    rotation_z.resize(count, 0.0f);
+    rotation_w.resize(count, 1.0f);
+
+    scale_x.resize(count, 1.0f);
+    scale_y.resize(count, 1.0f);
+    scale_z.resize(count, 1.0f);
+}
+
+void TransformStorage::clear()
+{
+    resize(0);
+}
+
+const char *TransformStorage::simdPath()
+{
+#if defined(VENT_TRANSFORM_AVX2)
+    return "AVX2";
+#elif defined(VENT_TRANSFORM_SSE)
+    return "SSE";
+#else
+    return "Scalar";
+#endif
+}
+
+void TransformStorage::computeWorldMatricesScalar(glm::mat4 *world, glm::mat4 *normal, const size_t first, const size_t count) const
+{
+    for (size_t i = first; i < first + count; i++)
+    {
+        const float qx = rotation_x[i], qy = rotation_y[i], qz = rotation_z[i], qw = rotation_w[i];
+
+        const float x2 = qx + qx, y2 = qy + qy, z2 = qz + qz;
+        const float xx = qx * x2, yy = qy * y2, zz = qz * z2;
+        const float xy = qx * y2, xz = qx * z2, yz = qy * z2;
+        const float wx = qw * x2, wy = qw * y2, wz = qw * z2;
+
+        // Rotation columns, same convention as glm::mat3_cast
+        const float r[3][3] = {
+            {1.0f - (yy + zz), xy + wz, xz - wy},
+            {xy - wz, 1.0f - (xx + zz), yz + wx},
+            {xz + wy, yz - wx, 1.0f - (xx + yy)}};
+
+        const float s[3] = {scale_x[i], scale_y[i], scale_z[i]};
+
+        float *w = &world[i][0][0];
+        for (int c = 0; c < 3; c++)
+        {
+            w[c * 4 + 0] = r[c][0] * s[c];
+            w[c * 4 + 1] = r[c][1] * s[c];
+            w[c * 4 + 2] = r[c][2] * s[c];
+            w[c * 4 + 3] = 0.0f;
+        }
+        w[12] = position_x[i];
+        w[13] = position_y[i];
+        w[14] = position_z[i];
+        w[15] = 1.0f;
+
+        if (!normal)
+        {
+            continue;
+        }
+
+        float *n = &normal[i][0][0];
+        for (int c = 0; c < 3; c++)
+        {
+            const float inv = 1.0f / s[c];
+            n[c * 4 + 0] = r[c][0] * inv;
+            n[c * 4 + 1] = r[c][1] * inv;
+            n[c * 4 + 2] = r[c][2] * inv;
+            n[c * 4 + 3] = 0.0f;
+        }
+        n[12] = 0.0f;
+        n[13] = 0.0f;
+        n[14] = 0.0f;
+        n[15] = 1.0f;
+    }
+}
+
+#if defined(VENT_TRANSFORM_SSE)
+
+/// Writes one column of 4 consecutive matrices, given the column's x, y, z and w lanes for all 4 of them.
+static inline void store_column(float *matrices, const int column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(matrices + 0 * 16 + column * 4, x);
+    _mm_storeu_ps(matrices + 1 * 16 + column * 4, y);
+    _mm_storeu_ps(matrices + 2 * 16 + column * 4, z);
+    _mm_storeu_ps(matrices + 3 * 16 + column * 4, w);
+}
+
+/// Builds 4 matrices from the already loaded lanes, the SSE loop body and the tail of the AVX2 loop.
+static inline void build_4(float *world, float *normal,
+                           __m128 qx, __m128 qy, __m128 qz, __m128 qw,
+                           __m128 px, __m128 py, __m128 pz,
+                           __m128 sx, __m128 sy, __m128 sz)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    const __m128 x2 = _mm_add_ps(qx, qx), y2 = _mm_add_ps(qy, qy), z2 = _mm_add_ps(qz, qz);
+    const __m128 xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+    const __m128 xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+    const __m128 wx = _mm_mul_ps(qw, x2), wy = _mm_mul_ps(qw, y2), wz = _mm_mul_ps(qw, z2);
+
+    const __m128 r00 = _mm_sub_ps(one, _mm_add_ps(yy, zz)), r01 = _mm_add_ps(xy, wz), r02 = _mm_sub_ps(xz, wy);
+    const __m128 r10 = _mm_sub_ps(xy, wz), r11 = _mm_sub_ps(one, _mm_add_ps(xx, zz)), r12 = _mm_add_ps(yz, wx);
+    const __m128 r20 = _mm_add_ps(xz, wy), r21 = _mm_sub_ps(yz, wx), r22 = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+
+    store_column(world, 0, _mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), zero);
+    store_column(world, 1, _mm_mul_ps(r10, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), zero);
+    store_column(world, 2, _mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), _mm_mul_ps(r22, sz), zero);
+    store_column(world, 3, px, py, pz, one);
+
+    if (!normal)
+    {
+        return;
+    }
+
+    const __m128 ix = _mm_div_ps(one, sx), iy = _mm_div_ps(one, sy), iz = _mm_div_ps(one, sz);
+
+    store_column(normal, 0, _mm_mul_ps(r00, ix), _mm_mul_ps(r01, ix), _mm_mul_ps(r02, ix), zero);
+    store_column(normal, 1, _mm_mul_ps(r10, iy), _mm_mul_ps(r11, iy), _mm_mul_ps(r12, iy), zero);
+    store_column(normal, 2, _mm_mul_ps(r20, iz), _mm_mul_ps(r21, iz), _mm_mul_ps(r22, iz), zero);
+    store_column(normal, 3, zero, zero, zero, one);
+}
+
+#endif
+
+#if defined(VENT_TRANSFORM_AVX2)
+
+/// 8 wide variant of store_column, the transposes are done per 128 bit half.
+static inline void store_column_8(float *matrices, const int column, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    store_column(matrices, column, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+    store_column(matrices + 4 * 16, column, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+}
+
+static inline void build_8(float *world, float *normal,
+                           __m256 qx, __m256 qy, __m256 qz, __m256 qw,
+                           __m256 px, __m256 py, __m256 pz,
+                           __m256 sx, __m256 sy, __m256 sz)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    const __m256 x2 = _mm256_add_ps(qx, qx), y2 = _mm256_add_ps(qy, qy), z2 = _mm256_add_ps(qz, qz);
+    const __m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+    const __m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+    const __m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+    const __m256 r00 = _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), r01 = _mm256_add_ps(xy, wz), r02 = _mm256_sub_ps(xz, wy);
+    const __m256 r10 = _mm256_sub_ps(xy, wz), r11 = _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), r12 = _mm256_add_ps(yz, wx);
+    const __m256 r20 = _mm256_add_ps(xz, wy), r21 = _mm256_sub_ps(yz, wx), r22 = _mm256_sub_ps(one, _mm256_add_ps(xx, yy));
+
+    store_column_8(world, 0, _mm256_mul_ps(r00, sx), _mm256_mul_ps(r01, sx), _mm256_mul_ps(r02, sx), zero);
+    store_column_8(world, 1, _mm256_mul_ps(r10, sy), _mm256_mul_ps(r11, sy), _mm256_mul_ps(r12, sy), zero);
+    store_column_8(world, 2, _mm256_mul_ps(r20, sz), _mm256_mul_ps(r21, sz), _mm256_mul_ps(r22, sz), zero);
+    store_column_8(world, 3, px, py, pz, one);
+
+    if (!normal)
+    {
+        return;
+    }
+
+    const __m256 ix = _mm256_div_ps(one, sx), iy = _mm256_div_ps(one, sy), iz = _mm256_div_ps(one, sz);
+
+    store_column_8(normal, 0, _mm256_mul_ps(r00, ix), _mm256_mul_ps(r01, ix), _mm256_mul_ps(r02, ix), zero);
+    store_column_8(normal, 1, _mm256_mul_ps(r10, iy), _mm256_mul_ps(r11, iy), _mm256_mul_ps(r12, iy), zero);
+    store_column_8(normal, 2, _mm256_mul_ps(r20, iz), _mm256_mul_ps(r21, iz), _mm256_mul_ps(r22, iz), zero);
+    store_column_8(normal, 3, zero, zero, zero, one);
+}
+
+#endif
+
+void TransformStorage::computeWorldMatrices(glm::mat4 *world, glm::mat4 *normal, const size_t first, const size_t count) const
+{
+    size_t i = first;
+    const size_t end = first + count;
+
+#if defined(VENT_TRANSFORM_AVX2)
+    for (; i + 8 <= end; i += 8)
+    {
+        build_8(&world[i][0][0], normal ? &normal[i][0][0] : nullptr,
+                _mm256_loadu_ps(&rotation_x[i]), _mm256_loadu_ps(&rotation_y[i]), _mm256_loadu_ps(&rotation_z[i]), _mm256_loadu_ps(&rotation_w[i]),
+                _mm256_loadu_ps(&position_x[i]), _mm256_loadu_ps(&position_y[i]), _mm256_loadu_ps(&position_z[i]),
+                _mm256_loadu_ps(&scale_x[i]), _mm256_loadu_ps(&scale_y[i]), _mm256_loadu_ps(&scale_z[i]));
+    }
+#endif
+
+#if defined(VENT_TRANSFORM_SSE)
+    for (; i + 4 <= end; i += 4)
+    {
+        build_4(&world[i][0][0], normal ? &normal[i][0][0] : nullptr,
+                _mm_loadu_ps(&rotation_x[i]), _mm_loadu_ps(&rotation_y[i]), _mm_loadu_ps(&rotation_z[i]), _mm_loadu_ps(&rotation_w[i]),
+                _mm_loadu_ps(&position_x[i]), _mm_loadu_ps(&position_y[i]), _mm_loadu_ps(&position_z[i]),
+                _mm_loadu_ps(&scale_x[i]), _mm_loadu_ps(&scale_y[i]), _mm_loadu_ps(&scale_z[i]));
+    }
+#endif
+
+    computeWorldMatricesScalar(world, normal, i, end - i);
+}
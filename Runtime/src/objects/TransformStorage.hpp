@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Object transforms stored as structure-of-arrays, so world matrices can be built
+/// for 4 (SSE) or 8 (AVX2) objects per iteration.
+class TransformStorage
+{
+public:
+    std::vector<float> position_x, position_y, position_z;
+    std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+    std::vector<float> scale_x, scale_y, scale_z;
+
+    uint32_t add(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+    void set(uint32_t index, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+    void resize(size_t count);
+
+    void clear();
+
+    [[nodiscard]] size_t size() const { return position_x.size(); }
+
+    /// Builds T * R * S for the objects [first, first + count) into world[first...], and the matching
+    /// normal matrices (R * S^-1, the inverse transpose for TRS) into normal[first...] if normal is not null.
+    /// Uses the widest SIMD path the build targets, falls back to computeWorldMatricesScalar elsewhere.
+    void computeWorldMatrices(glm::mat4 *world, glm::mat4 *normal, size_t first, size_t count) const;
+
+    void computeWorldMatrices(glm::mat4 *world, glm::mat4 *normal = nullptr) const
+    {
+        computeWorldMatrices(world, normal, 0, size());
+    }
+
+    /// Scalar reference implementation of computeWorldMatrices, used for the tail and for verification.
+    void computeWorldMatricesScalar(glm::mat4 *world, glm::mat4 *normal, size_t first, size_t count) const;
+
+    /// Name of the SIMD path computeWorldMatrices was compiled with.
+    static const char *simdPath();
+};
@@ -0,0 +1,152 @@
+#include "CpuProfiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace CpuProfiler
+{
+    std::atomic<bool> capturing{false};
+
+    struct Zone
+    {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    /// Written only by its own thread, read by the exporter after stop()
+    struct ThreadBuffer
+    {
+        static constexpr uint32_t CAPACITY = 1 << 16;
+
+        std::unique_ptr<Zone[]> zones{new Zone[CAPACITY]};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint64_t> dropped{0};
+
+        uint32_t thread_id = 0;
+        std::string name;
+    };
+
+    /// Owns every thread's buffer, buffers outlive their threads so their zones can still be exported
+    static std::mutex registry_mutex;
+    static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+    /// Tick and clock pairs at start() and stop(), used to convert ticks to time
+    static uint64_t start_ticks = 0;
+    static uint64_t stop_ticks = 0;
+    static Clock::time_point start_time;
+    static Clock::time_point stop_time;
+
+    static ThreadBuffer &thread_buffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            const std::lock_guard lock(registry_mutex);
+            registry.push_back(std::make_unique<ThreadBuffer>());
+            buffer = registry.back().get();
+            buffer->thread_id = static_cast<uint32_t>(registry.size());
+        }
+        return *buffer;
+    }
+
+    void record(const char *name, const uint64_t begin, const uint64_t end)
+    {
+        ThreadBuffer &buffer = thread_buffer();
+
+        // Single producer, the release store publishes the zone to the exporter
+        const uint32_t index = buffer.count.load(std::memory_order_relaxed);
+        if (index >= ThreadBuffer::CAPACITY)
+        {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.zones[index] = {name, begin, end};
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    void start()
+    {
+        {
+            const std::lock_guard lock(registry_mutex);
+            for (auto &buffer : registry)
+            {
+                buffer->count.store(0, std::memory_order_relaxed);
+                buffer->dropped.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        start_time = Clock::now();
+        start_ticks = now();
+        capturing.store(true, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        capturing.store(false, std::memory_order_release);
+        stop_ticks = now();
+        stop_time = Clock::now();
+    }
+
+    void setThreadName(const std::string &name)
+    {
+        thread_buffer().name = name;
+    }
+
+    uint64_t droppedZones()
+    {
+        const std::lock_guard lock(registry_mutex);
+
+        uint64_t dropped = 0;
+        for (const auto &buffer : registry)
+        {
+            dropped += buffer->dropped.load(std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+
+    bool writeChromeTrace(const std::string &path)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        const std::lock_guard lock(registry_mutex);
+
+        // The capture itself calibrates the ticks, long enough captures make that exact enough for tracing
+        const double capture_us = std::chrono::duration<double, std::micro>(stop_time - start_time).count();
+        const double us_per_tick = stop_ticks > start_ticks ? capture_us / static_cast<double>(stop_ticks - start_ticks) : 0.0;
+
+        // Complete events ("X") with microsecond timestamps relative to the capture start
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto &buffer : registry)
+        {
+            if (!buffer->name.empty())
+            {
+                file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread_id
+                     << ", \"args\": {\"name\": \"" << buffer->name << "\"}}";
+                first = false;
+            }
+
+            const uint32_t count = buffer->count.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const Zone &zone = buffer->zones[i];
+                file << (first ? "" : ",\n") << "{\"name\": \"" << zone.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread_id
+                     << ", \"ts\": " << static_cast<double>(zone.begin - start_ticks) * us_per_tick << ", \"dur\": " << static_cast<double>(zone.end - zone.begin) * us_per_tick << "}";
+                first = false;
+            }
+        }
+        file << "\n]}\n";
+
+        return static_cast<bool>(file);
+    }
+}
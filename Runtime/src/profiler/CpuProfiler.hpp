@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+/// Scoped CPU zones recorded into per-thread buffers and exported as Chrome trace JSON
+/// (chrome://tracing, ui.perfetto.dev).
+///
+/// Recording a zone is two timestamp reads and a store into the calling thread's own buffer, no locks
+/// and no shared cache lines. A thread takes the registry lock once, the first time it records.
+/// On x86-64 the timestamps are raw TSC ticks, converted to time against steady_clock on export.
+/// Zones are only recorded between start() and stop(), otherwise they cost a relaxed load.
+namespace CpuProfiler
+{
+    using Clock = std::chrono::steady_clock;
+
+    extern std::atomic<bool> capturing;
+
+    /// Cheapest monotonic timestamp of the platform, in ticks
+    inline uint64_t now()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(Clock::now().time_since_epoch().count());
+#endif
+    }
+
+    /// Drops everything recorded so far and starts a capture. Call from the main thread between frames.
+    void start();
+
+    void stop();
+
+    [[nodiscard]] inline bool isCapturing() { return capturing.load(std::memory_order_relaxed); }
+
+    /// Names the calling thread in the trace.
+    void setThreadName(const std::string &name);
+
+    /// Writes the capture as Chrome trace JSON, call after stop().
+    bool writeChromeTrace(const std::string &path);
+
+    /// Zones dropped because a thread buffer was full.
+    [[nodiscard]] uint64_t droppedZones();
+
+    /// name has to be a string with static storage duration, only the pointer is stored.
+    void record(const char *name, uint64_t begin, uint64_t end);
+}
+
+/// Records the enclosing scope, see VENT_PROFILE_ZONE
+class CpuZone
+{
+private:
+    const char *name;
+    uint64_t begin = 0;
+
+public:
+    explicit CpuZone(const char *zone_name) : name(CpuProfiler::isCapturing() ? zone_name : nullptr)
+    {
+        if (name)
+        {
+            begin = CpuProfiler::now();
+        }
+    }
+
+    ~CpuZone()
+    {
+        if (name)
+        {
+            CpuProfiler::record(name, begin, CpuProfiler::now());
+        }
+    }
+
+    CpuZone(const CpuZone &) = delete;
+
+    CpuZone &operator=(const CpuZone &) = delete;
+};
+
+#define VENT_PROFILE_CONCAT_INNER(a, b) a##b
+#define VENT_PROFILE_CONCAT(a, b) VENT_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef VENT_DISABLE_PROFILER
+#define VENT_PROFILE_ZONE(name)
+#else
+/// Times the rest of the enclosing scope as a zone called name (a string literal)
+#define VENT_PROFILE_ZONE(name) const CpuZone VENT_PROFILE_CONCAT(vent_zone_, __LINE__)(name)
+#endif
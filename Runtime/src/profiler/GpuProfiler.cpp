@@ -0,0 +1,356 @@
+#include "GpuProfiler.hpp"
+
+static uint64_t valid_bits_mask(const uint32_t valid_bits)
+{
+    if (valid_bits == 0)
+    {
+        return 0;
+    }
+
+    return valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+}
+
+static constexpr vk::QueryPipelineStatisticFlags statistic_flags = vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives | vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                                                                  vk::QueryPipelineStatisticFlagBits::eClippingPrimitives | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+GpuProfiler::GpuProfiler(const uint32_t frames_in_flight)
+{
+    // Statistics queries are reset from the command buffer, so they don't depend on timestamps or host resets
+    frames.resize(frames_in_flight);
+    statistics_supported = context->pipeline_statistics_query;
+    if (statistics_supported)
+    {
+        for (auto &frame : frames)
+        {
+            frame.statistics_pool = context->device.createQueryPool({{}, vk::QueryType::ePipelineStatistics, 1, statistic_flags});
+        }
+    }
+
+    const auto queue_families = context->gpu.getQueueFamilyProperties();
+    graphics_mask = valid_bits_mask(queue_families[context->graphics_queue_index].timestampValidBits);
+    if (context->transfer_queue_index >= 0)
+    {
+        transfer_mask = valid_bits_mask(queue_families[context->transfer_queue_index].timestampValidBits);
+    }
+
+    // Pools are reset from the host, so resetting never has to be recorded outside a render pass or on the transfer queue
+    if (graphics_mask == 0 || !context->host_query_reset)
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "GPU timestamps not supported, GPU profiler disabled");
+        return;
+    }
+
+    timestamp_period = static_cast<double>(context->gpu.getProperties().limits.timestampPeriod);
+
+    for (auto &frame : frames)
+    {
+        frame.pool = context->device.createQueryPool({{}, vk::QueryType::eTimestamp, MAX_SCOPES * 2});
+        context->device.resetQueryPool(frame.pool, 0, MAX_SCOPES * 2);
+    }
+
+    upload_pool = context->device.createQueryPool({{}, vk::QueryType::eTimestamp, MAX_UPLOADS * 2});
+    upload_used.resize(MAX_UPLOADS, false);
+    upload_transfer.resize(MAX_UPLOADS, false);
+
+    enabled = true;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (auto &frame : frames)
+    {
+        if (frame.pool)
+        {
+            context->device.destroyQueryPool(frame.pool);
+        }
+
+        if (frame.statistics_pool)
+        {
+            context->device.destroyQueryPool(frame.statistics_pool);
+        }
+    }
+
+    if (upload_pool)
+    {
+        context->device.destroyQueryPool(upload_pool);
+    }
+}
+
+double GpuProfiler::ticks_to_ms(const uint64_t begin, const uint64_t end, const uint64_t mask) const
+{
+    return static_cast<double>((end - begin) & mask) * timestamp_period / 1000000.0;
+}
+
+void GpuProfiler::beginFrame(const uint32_t slot)
+{
+    current = slot;
+    FrameQueries &frame = frames[current];
+
+    if (frame.statistics_recorded)
+    {
+        // In query order: input assembly primitives, vertex invocations, clipping primitives, fragment invocations
+        std::array<uint64_t, 4> data{};
+        const vk::Result result = context->device.getQueryPoolResults(frame.statistics_pool, 0, 1, sizeof(data), data.data(), sizeof(data), vk::QueryResultFlagBits::e64);
+        if (result == vk::Result::eSuccess)
+        {
+            last_statistics = {data[0], data[1], data[2], data[3]};
+            statistics_count++;
+        }
+        frame.statistics_recorded = false;
+    }
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (!frame.scopes.empty())
+    {
+        this->resolve(frame);
+        context->device.resetQueryPool(frame.pool, 0, static_cast<uint32_t>(frame.scopes.size()) * 2);
+    }
+
+    frame.scopes.clear();
+    frame.frame = ++frame_counter;
+    depth = 0;
+}
+
+uint32_t GpuProfiler::begin(const vk::CommandBuffer &cmd, const char *name)
+{
+    if (!enabled)
+    {
+        return INVALID_SCOPE;
+    }
+
+    FrameQueries &frame = frames[current];
+    if (frame.scopes.size() >= MAX_SCOPES)
+    {
+        return INVALID_SCOPE;
+    }
+
+    const auto scope = static_cast<uint32_t>(frame.scopes.size());
+    frame.scopes.push_back({name, depth++});
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.pool, scope * 2);
+    return scope;
+}
+
+void GpuProfiler::end(const vk::CommandBuffer &cmd, const uint32_t scope)
+{
+    if (scope == INVALID_SCOPE)
+    {
+        return;
+    }
+
+    depth--;
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frames[current].pool, scope * 2 + 1);
+}
+
+void GpuProfiler::resolve(FrameQueries &frame)
+{
+    // Value and availability per query, so a scope that was never ended doesn't invalidate the rest
+    const auto query_count = static_cast<uint32_t>(frame.scopes.size()) * 2;
+    std::vector<uint64_t> data(query_count * 2);
+
+    const vk::Result result = context->device.getQueryPoolResults(frame.pool, 0, query_count, data.size() * sizeof(uint64_t), data.data(), sizeof(uint64_t) * 2,
+                                                                  vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    if (result != vk::Result::eSuccess && result != vk::Result::eNotReady)
+    {
+        return;
+    }
+
+    std::vector<GpuTiming> timings;
+    timings.reserve(frame.scopes.size() + pending_uploads.size());
+
+    for (size_t i = 0; i < frame.scopes.size(); i++)
+    {
+        const uint64_t *begin = &data[i * 4];
+        const uint64_t *end = &data[i * 4 + 2];
+
+        if (begin[1] == 0 || end[1] == 0)
+        {
+            continue;
+        }
+
+        timings.push_back({frame.scopes[i].name, ticks_to_ms(begin[0], end[0], graphics_mask), frame.scopes[i].depth});
+    }
+
+    for (auto &upload : pending_uploads)
+    {
+        timings.push_back(std::move(upload));
+    }
+    pending_uploads.clear();
+
+    if (csv.is_open())
+    {
+        for (const auto &timing : timings)
+        {
+            csv << frame.frame << ',' << timing.name << ',' << timing.depth << ',' << timing.milliseconds << '\n';
+        }
+    }
+
+    last_results = timings;
+
+    history.emplace_back(frame.frame, std::move(timings));
+    if (history.size() > HISTORY_SIZE)
+    {
+        history.pop_front();
+    }
+}
+
+void GpuProfiler::beginStatistics(const vk::CommandBuffer &cmd)
+{
+    if (!statistics_enabled)
+    {
+        return;
+    }
+
+    FrameQueries &frame = frames[current];
+    cmd.resetQueryPool(frame.statistics_pool, 0, 1);
+    cmd.beginQuery(frame.statistics_pool, 0, {});
+    frame.statistics_recorded = true;
+}
+
+void GpuProfiler::endStatistics(const vk::CommandBuffer &cmd)
+{
+    if (frames[current].statistics_recorded)
+    {
+        cmd.endQuery(frames[current].statistics_pool, 0);
+    }
+}
+
+vk::QueryPipelineStatisticFlags GpuProfiler::inheritedStatistics() const
+{
+    return frames[current].statistics_recorded ? statistic_flags : vk::QueryPipelineStatisticFlags{};
+}
+
+uint32_t GpuProfiler::beginUpload(const vk::CommandBuffer &cmd, const bool transfer_queue)
+{
+    if (!enabled || (transfer_queue && transfer_mask == 0))
+    {
+        return INVALID_SCOPE;
+    }
+
+    for (uint32_t i = 0; i < MAX_UPLOADS; i++)
+    {
+        if (!upload_used[i])
+        {
+            upload_used[i] = true;
+            upload_transfer[i] = transfer_queue;
+
+            context->device.resetQueryPool(upload_pool, i * 2, 2);
+            cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, upload_pool, i * 2);
+            return i;
+        }
+    }
+
+    return INVALID_SCOPE;
+}
+
+void GpuProfiler::endUpload(const vk::CommandBuffer &cmd, const uint32_t scope)
+{
+    if (scope == INVALID_SCOPE)
+    {
+        return;
+    }
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, upload_pool, scope * 2 + 1);
+}
+
+void GpuProfiler::resolveUpload(const uint32_t scope, const std::string &name)
+{
+    if (scope == INVALID_SCOPE)
+    {
+        return;
+    }
+
+    uint64_t data[2] = {};
+    const vk::Result result = context->device.getQueryPoolResults(upload_pool, scope * 2, 2, sizeof(data), data, sizeof(uint64_t),
+                                                                  vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (result == vk::Result::eSuccess)
+    {
+        pending_uploads.push_back({name, ticks_to_ms(data[0], data[1], upload_transfer[scope] ? transfer_mask : graphics_mask), 0});
+    }
+
+    upload_used[scope] = false;
+}
+
+double GpuProfiler::latest(const std::string &name) const
+{
+    for (const auto &timing : last_results)
+    {
+        if (timing.name == name)
+        {
+            return timing.milliseconds;
+        }
+    }
+
+    return -1.0;
+}
+
+double GpuProfiler::average(const std::string &name) const
+{
+    double total = 0.0;
+    uint32_t count = 0;
+
+    for (const auto &[frame, timings] : history)
+    {
+        for (const auto &timing : timings)
+        {
+            if (timing.name == name)
+            {
+                total += timing.milliseconds;
+                count++;
+            }
+        }
+    }
+
+    return count > 0 ? total / count : 0.0;
+}
+
+void GpuProfiler::setCsvOutput(const std::string &path)
+{
+    if (csv.is_open())
+    {
+        csv.close();
+    }
+
+    if (path.empty())
+    {
+        return;
+    }
+
+    csv.open(path, std::ios::trunc);
+    if (!csv)
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Could not open %s for GPU timings", path.c_str());
+        return;
+    }
+
+    csv << "frame,scope,depth,ms\n";
+}
+
+bool GpuProfiler::writeJson(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    file << "[\n";
+    for (size_t i = 0; i < history.size(); i++)
+    {
+        const auto &[frame, timings] = history[i];
+
+        file << "  {\"frame\": " << frame << ", \"scopes\": [";
+        for (size_t j = 0; j < timings.size(); j++)
+        {
+            file << (j > 0 ? ", " : "") << "{\"name\": \"" << timings[j].name << "\", \"depth\": " << timings[j].depth << ", \"ms\": " << timings[j].milliseconds << "}";
+        }
+        file << "]}" << (i + 1 < history.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// Duration of one named GPU scope
+struct GpuTiming
+{
+    std::string name;
+
+    double milliseconds = 0.0;
+
+    /// Nesting level, 0 for top level scopes
+    uint32_t depth = 0;
+};
+
+/// Pipeline statistics of the main pass
+struct PipelineStatistics
+{
+    uint64_t input_assembly_primitives = 0;
+    uint64_t vertex_shader_invocations = 0;
+    uint64_t clipping_primitives = 0;
+    uint64_t fragment_shader_invocations = 0;
+};
+
+/// Timestamp query profiler. Every frame in flight owns a query pool, which is read back once the
+/// graphics timeline passed that frame, so reading the results never stalls the GPU or the CPU.
+///
+/// Usage per frame: beginFrame(slot), then any number of begin(cmd, name) / end(cmd, scope) pairs.
+/// One-off upload command buffers use beginUpload / endUpload / resolveUpload.
+class GpuProfiler
+{
+public:
+    /// Scopes (query pairs) per frame
+    static constexpr uint32_t MAX_SCOPES = 64;
+
+    /// Upload scopes in flight at once
+    static constexpr uint32_t MAX_UPLOADS = 16;
+
+    /// Returned by begin when the profiler is disabled or out of scopes, end ignores it
+    static constexpr uint32_t INVALID_SCOPE = UINT32_MAX;
+
+    explicit GpuProfiler(uint32_t frames_in_flight);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    /// Resolves the results this slot recorded frames_in_flight frames ago and starts recording into it again.
+    /// The slot's previous frame has to be complete, which acquire guarantees.
+    void beginFrame(uint32_t slot);
+
+    /// name has to outlive the frame, string literals are expected.
+    uint32_t begin(const vk::CommandBuffer &cmd, const char *name);
+
+    void end(const vk::CommandBuffer &cmd, uint32_t scope);
+
+    /// Times a command buffer outside the frame, on the graphics or the transfer queue.
+    uint32_t beginUpload(const vk::CommandBuffer &cmd, bool transfer_queue);
+
+    void endUpload(const vk::CommandBuffer &cmd, uint32_t scope);
+
+    /// Reads the upload timing once the command buffer completed, it shows up with the next resolved frame.
+    void resolveUpload(uint32_t scope, const std::string &name);
+
+    /// Timings of the most recent frame that completed on the GPU.
+    [[nodiscard]] const std::vector<GpuTiming> &results() const { return last_results; }
+
+    /// Duration of a scope in the most recent completed frame, negative if it didn't run.
+    [[nodiscard]] double latest(const std::string &name) const;
+
+    /// Average of a scope over the rolling history, 0 if it never ran.
+    [[nodiscard]] double average(const std::string &name) const;
+
+    /// Appends every resolved frame to a CSV file (frame,scope,depth,ms), empty path stops.
+    void setCsvOutput(const std::string &path);
+
+    /// Writes the rolling history as JSON: [{"frame": n, "scopes": [{"name", "depth", "ms"}]}]
+    bool writeJson(const std::string &path) const;
+
+    [[nodiscard]] bool isEnabled() const { return enabled; }
+
+    /// Pipeline statistics queries need the pipelineStatisticsQuery device feature.
+    [[nodiscard]] bool supportsStatistics() const { return statistics_supported; }
+
+    /// Turns the pipeline statistics query around the main pass on or off, off by default.
+    void setStatisticsEnabled(bool enable) { statistics_enabled = enable && statistics_supported; }
+
+    [[nodiscard]] bool isStatisticsEnabled() const { return statistics_enabled; }
+
+    /// Begins the statistics query, has to be recorded outside a render pass like endStatistics.
+    void beginStatistics(const vk::CommandBuffer &cmd);
+
+    void endStatistics(const vk::CommandBuffer &cmd);
+
+    /// Statistics a secondary command buffer executed in this frame's main pass has to inherit.
+    [[nodiscard]] vk::QueryPipelineStatisticFlags inheritedStatistics() const;
+
+    /// Statistics of the most recent completed frame that recorded them.
+    [[nodiscard]] const PipelineStatistics &statistics() const { return last_statistics; }
+
+    /// Frames whose statistics were read back so far, changes whenever statistics() does.
+    [[nodiscard]] uint64_t statisticsCount() const { return statistics_count; }
+
+private:
+    struct Scope
+    {
+        const char *name;
+        uint32_t depth;
+    };
+
+    struct FrameQueries
+    {
+        vk::QueryPool pool;
+        std::vector<Scope> scopes;
+
+        /// Frame counter when the slot was recorded
+        uint64_t frame = 0;
+
+        vk::QueryPool statistics_pool;
+        bool statistics_recorded = false;
+    };
+
+    bool enabled = false;
+
+    /// Nanoseconds per timestamp tick
+    double timestamp_period = 1.0;
+
+    uint64_t graphics_mask = 0;
+    uint64_t transfer_mask = 0;
+
+    std::vector<FrameQueries> frames;
+
+    uint32_t current = 0;
+
+    uint32_t depth = 0;
+
+    uint64_t frame_counter = 0;
+
+    vk::QueryPool upload_pool;
+    std::vector<bool> upload_used;
+    std::vector<bool> upload_transfer;
+    std::vector<GpuTiming> pending_uploads;
+
+    std::vector<GpuTiming> last_results;
+
+    bool statistics_supported = false;
+    bool statistics_enabled = false;
+    PipelineStatistics last_statistics;
+    uint64_t statistics_count = 0;
+
+    /// Last HISTORY_SIZE resolved frames for averages and the JSON dump
+    static constexpr size_t HISTORY_SIZE = 240;
+    std::deque<std::pair<uint64_t, std::vector<GpuTiming>>> history;
+
+    std::ofstream csv;
+
+    void resolve(FrameQueries &frame);
+
+    [[nodiscard]] double ticks_to_ms(uint64_t begin, uint64_t end, uint64_t mask) const;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/// Axis aligned box as center and half extent, the form FrustumCuller stores and tests.
+struct Aabb
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(0.0f);
+
+    static Aabb fromMinMax(const glm::vec3 &min, const glm::vec3 &max) { return {(min + max) * 0.5f, (max - min) * 0.5f}; }
+
+    [[nodiscard]] glm::vec3 min() const { return center - extent; }
+
+    [[nodiscard]] glm::vec3 max() const { return center + extent; }
+
+    [[nodiscard]] bool intersects(const Aabb &other) const
+    {
+        const glm::vec3 distance = glm::abs(center - other.center);
+        return distance.x <= extent.x + other.extent.x && distance.y <= extent.y + other.extent.y && distance.z <= extent.z + other.extent.z;
+    }
+};
@@ -0,0 +1,428 @@
+#include "Bvh.hpp"
+
+#include "../profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+static constexpr uint32_t ALL_PLANES = 0x3f;
+
+namespace
+{
+    /// Centroid bin of the binned SAH build, grows around the boxes whose center falls into it
+    struct Bin
+    {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+        uint32_t count = 0;
+
+        void grow(const glm::vec3 &box_min, const glm::vec3 &box_max, const uint32_t boxes)
+        {
+            min = glm::min(min, box_min);
+            max = glm::max(max, box_max);
+            count += boxes;
+        }
+
+        /// Half the surface area, the SAH only compares areas
+        [[nodiscard]] float area() const
+        {
+            const glm::vec3 size = max - min;
+            return size.x * size.y + size.y * size.z + size.z * size.x;
+        }
+    };
+
+    uint32_t binIndex(const float center, const float lowest, const float scale, const uint32_t bins)
+    {
+        return std::min(bins - 1, static_cast<uint32_t>((center - lowest) * scale));
+    }
+
+    /// Entry distance of the ray into [min, max] if it enters before limit
+    bool intersectRay(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin, const glm::vec3 &inverse, const float limit, float &entry)
+    {
+        const glm::vec3 t0 = (min - origin) * inverse;
+        const glm::vec3 t1 = (max - origin) * inverse;
+        const glm::vec3 lower = glm::min(t0, t1);
+        const glm::vec3 upper = glm::max(t0, t1);
+
+        entry = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+        const float exit = std::min(std::min(upper.x, upper.y), upper.z);
+        return entry <= exit && entry < limit;
+    }
+}
+
+void Bvh::clear()
+{
+    nodes.clear();
+    primitives.clear();
+    slot_boxes.clear();
+    depth = 0;
+}
+
+void Bvh::build(const std::vector<Aabb> &boxes)
+{
+    VENT_PROFILE_ZONE("Build BVH");
+
+    this->clear();
+    if (boxes.empty())
+    {
+        return;
+    }
+
+    std::vector<BuildBox> build_boxes(boxes.size());
+    for (uint32_t i = 0; i < boxes.size(); i++)
+    {
+        build_boxes[i] = {boxes[i].min(), i, boxes[i].max(), boxes[i].center};
+    }
+
+    // At most 2n - 1 nodes, reserving keeps the pushes from reallocating
+    nodes.reserve(boxes.size() * 2);
+    this->buildNode(0, static_cast<uint32_t>(boxes.size()), 0, build_boxes);
+
+    primitives.resize(boxes.size());
+    slot_boxes.resize(boxes.size());
+    for (size_t i = 0; i < build_boxes.size(); i++)
+    {
+        primitives[i] = build_boxes[i].primitive;
+        slot_boxes[i] = boxes[primitives[i]];
+    }
+}
+
+uint32_t Bvh::buildNode(const uint32_t first, const uint32_t count, const uint32_t level, std::vector<BuildBox> &boxes)
+{
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    depth = std::max(depth, level + 1);
+
+    Bin bounds;
+    glm::vec3 centroid_min(FLT_MAX), centroid_max(-FLT_MAX);
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const BuildBox &box = boxes[i];
+        bounds.grow(box.min, box.max, 1);
+        centroid_min = glm::min(centroid_min, box.center);
+        centroid_max = glm::max(centroid_max, box.center);
+    }
+
+    nodes[index].min = bounds.min;
+    nodes[index].max = bounds.max;
+    nodes[index].first = first;
+    nodes[index].count = count;
+
+    if (count <= MAX_LEAF_SIZE || level + 1 >= MAX_DEPTH)
+    {
+        return index;
+    }
+
+    // Bins along all three axes in one pass over the primitives
+    const glm::vec3 centroid_extent = centroid_max - centroid_min;
+    glm::vec3 scales;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        scales[axis] = centroid_extent[axis] > 0.0f ? static_cast<float>(BIN_COUNT) / centroid_extent[axis] : 0.0f;
+    }
+
+    std::array<std::array<Bin, BIN_COUNT>, 3> axis_bins;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const BuildBox &box = boxes[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            axis_bins[axis][binIndex(box.center[axis], centroid_min[axis], scales[axis], BIN_COUNT)].grow(box.min, box.max, 1);
+        }
+    }
+
+    // Cheapest split between the bins, by the children's area times their primitives
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    uint32_t best_split = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (centroid_extent[axis] <= 0.0f)
+        {
+            continue;
+        }
+        const std::array<Bin, BIN_COUNT> &bins = axis_bins[axis];
+
+        // Splitting after bin b puts bins (b, BIN_COUNT) on the right
+        std::array<float, BIN_COUNT - 1> right_areas;
+        std::array<uint32_t, BIN_COUNT - 1> right_counts;
+        Bin right;
+        for (uint32_t b = BIN_COUNT - 1; b > 0; b--)
+        {
+            right.grow(bins[b].min, bins[b].max, bins[b].count);
+            right_areas[b - 1] = right.area();
+            right_counts[b - 1] = right.count;
+        }
+
+        Bin left;
+        for (uint32_t b = 0; b < BIN_COUNT - 1; b++)
+        {
+            left.grow(bins[b].min, bins[b].max, bins[b].count);
+            if (left.count == 0 || right_counts[b] == 0)
+            {
+                continue;
+            }
+
+            const float cost = left.area() * static_cast<float>(left.count) + right_areas[b] * static_cast<float>(right_counts[b]);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    // Every centroid in the same spot, no split separates them
+    if (best_axis < 0)
+    {
+        return index;
+    }
+
+    const auto middle = std::partition(boxes.begin() + first, boxes.begin() + first + count, [&](const BuildBox &box)
+                                       { return binIndex(box.center[best_axis], centroid_min[best_axis], scales[best_axis], BIN_COUNT) <= best_split; });
+    const auto left_count = static_cast<uint32_t>(middle - (boxes.begin() + first));
+
+    // The left child is index + 1, depth-first order
+    this->buildNode(first, left_count, level + 1, boxes);
+    const uint32_t right = this->buildNode(first + left_count, count - left_count, level + 1, boxes);
+
+    nodes[index].first = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+void Bvh::refit(const std::vector<Aabb> &boxes)
+{
+    VENT_PROFILE_ZONE("Refit BVH");
+
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        slot_boxes[i] = boxes[primitives[i]];
+    }
+
+    // Children always come after their parent, walking backwards sees them first
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node &node = nodes[i];
+        if (node.isLeaf())
+        {
+            node.min = glm::vec3(FLT_MAX);
+            node.max = glm::vec3(-FLT_MAX);
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+            {
+                node.min = glm::min(node.min, slot_boxes[slot].min());
+                node.max = glm::max(node.max, slot_boxes[slot].max());
+            }
+        }
+        else
+        {
+            const Node &left = nodes[i + 1];
+            const Node &right = nodes[node.first];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) const
+{
+    VENT_PROFILE_ZONE("BVH frustum cull");
+
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // Node and the planes it still has to be tested against
+    std::array<std::pair<uint32_t, uint32_t>, MAX_DEPTH * 2> stack;
+    uint32_t size = 0;
+    stack[size++] = {0, ALL_PLANES};
+
+    while (size > 0)
+    {
+        const auto [index, parent_planes] = stack[--size];
+        const Node &node = nodes[index];
+
+        uint32_t planes = parent_planes;
+        bool outside = false;
+        for (uint32_t p = 0; p < 6; p++)
+        {
+            if (!(planes & (1u << p)))
+            {
+                continue;
+            }
+
+            // The corner farthest along the plane's normal decides outside, the nearest one inside
+            const glm::vec4 &plane = frustum.planes[p];
+            const glm::vec3 normal(plane);
+            const glm::vec3 farthest(plane.x >= 0.0f ? node.max.x : node.min.x, plane.y >= 0.0f ? node.max.y : node.min.y, plane.z >= 0.0f ? node.max.z : node.min.z);
+            if (glm::dot(normal, farthest) + plane.w < 0.0f)
+            {
+                outside = true;
+                break;
+            }
+
+            const glm::vec3 nearest(plane.x >= 0.0f ? node.min.x : node.max.x, plane.y >= 0.0f ? node.min.y : node.max.y, plane.z >= 0.0f ? node.min.z : node.max.z);
+            if (glm::dot(normal, nearest) + plane.w >= 0.0f)
+            {
+                planes &= ~(1u << p);
+            }
+        }
+
+        if (outside)
+        {
+            continue;
+        }
+
+        if (!node.isLeaf())
+        {
+            stack[size++] = {node.first, planes};
+            stack[size++] = {index + 1, planes};
+            continue;
+        }
+
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+        {
+            const Aabb &box = slot_boxes[slot];
+
+            bool inside = true;
+            for (uint32_t p = 0; p < 6 && inside; p++)
+            {
+                if (!(planes & (1u << p)))
+                {
+                    continue;
+                }
+
+                // Same test and operation order as FrustumCuller::cullScalar
+                const glm::vec4 &plane = frustum.planes[p];
+                const float distance = plane.x * box.center.x + plane.y * box.center.y + plane.z * box.center.z + plane.w;
+                const float radius = std::fabs(plane.x) * box.extent.x + std::fabs(plane.y) * box.extent.y + std::fabs(plane.z) * box.extent.z;
+                inside = distance + radius >= 0.0f;
+            }
+
+            if (inside)
+            {
+                visible.push_back(primitives[slot]);
+            }
+        }
+    }
+}
+
+uint32_t Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const
+{
+    if (nodes.empty())
+    {
+        return NO_HIT;
+    }
+
+    const glm::vec3 inverse = 1.0f / direction;
+    uint32_t hit = NO_HIT;
+
+    // Node and its entry distance, nodes entered past the nearest hit so far are skipped
+    std::array<std::pair<uint32_t, float>, MAX_DEPTH * 2> stack;
+    uint32_t size = 0;
+
+    float entry;
+    if (!intersectRay(nodes[0].min, nodes[0].max, origin, inverse, distance, entry))
+    {
+        return NO_HIT;
+    }
+    stack[size++] = {0, entry};
+
+    while (size > 0)
+    {
+        const auto [index, node_entry] = stack[--size];
+        if (node_entry >= distance)
+        {
+            continue;
+        }
+
+        const Node &node = nodes[index];
+        if (node.isLeaf())
+        {
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+            {
+                if (intersectRay(slot_boxes[slot].min(), slot_boxes[slot].max(), origin, inverse, distance, entry))
+                {
+                    distance = entry;
+                    hit = primitives[slot];
+                }
+            }
+            continue;
+        }
+
+        // The nearer child is popped first, so its hits can skip the farther one
+        float left_entry, right_entry;
+        const bool left = intersectRay(nodes[index + 1].min, nodes[index + 1].max, origin, inverse, distance, left_entry);
+        const bool right = intersectRay(nodes[node.first].min, nodes[node.first].max, origin, inverse, distance, right_entry);
+
+        if (left && right)
+        {
+            if (left_entry <= right_entry)
+            {
+                stack[size++] = {node.first, right_entry};
+                stack[size++] = {index + 1, left_entry};
+            }
+            else
+            {
+                stack[size++] = {index + 1, left_entry};
+                stack[size++] = {node.first, right_entry};
+            }
+        }
+        else if (left)
+        {
+            stack[size++] = {index + 1, left_entry};
+        }
+        else if (right)
+        {
+            stack[size++] = {node.first, right_entry};
+        }
+    }
+
+    return hit;
+}
+
+void Bvh::query(const Aabb &region, std::vector<uint32_t> &found) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    const glm::vec3 region_min = region.min();
+    const glm::vec3 region_max = region.max();
+
+    std::array<uint32_t, MAX_DEPTH * 2> stack;
+    uint32_t size = 0;
+    stack[size++] = 0;
+
+    while (size > 0)
+    {
+        const uint32_t index = stack[--size];
+        const Node &node = nodes[index];
+
+        if (glm::any(glm::lessThan(node.max, region_min)) || glm::any(glm::greaterThan(node.min, region_max)))
+        {
+            continue;
+        }
+
+        if (!node.isLeaf())
+        {
+            stack[size++] = node.first;
+            stack[size++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++)
+        {
+            if (slot_boxes[slot].intersects(region))
+            {
+                found.push_back(primitives[slot]);
+            }
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Aabb.hpp"
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Bounding volume hierarchy over a set of boxes, for frustum culling, ray picking and region queries
+/// in logarithmic instead of linear time.
+///
+/// Built top-down with a binned surface area heuristic into one flat node array in depth-first order: a node's
+/// left child directly follows it, only the right child's index is stored. Leaves reference a contiguous range
+/// of the primitives, whose boxes are kept in leaf order so a leaf reads consecutive memory. Moving primitives
+/// are handled by refit, which keeps the tree and only recomputes the node boxes; the tree gets worse the further
+/// they move from where it was built, rebuild once they moved a lot.
+class Bvh
+{
+public:
+    static constexpr uint32_t NO_HIT = UINT32_MAX;
+
+    /// 32 bytes, two nodes per cache line
+    struct Node
+    {
+        glm::vec3 min;
+        /// Leaf: first primitive slot, inner node: index of the right child
+        uint32_t first;
+        glm::vec3 max;
+        /// Primitives of a leaf, 0 for inner nodes
+        uint32_t count;
+
+        [[nodiscard]] bool isLeaf() const { return count > 0; }
+    };
+
+    /// Builds the tree over boxes, primitive i is boxes[i] in every query result.
+    void build(const std::vector<Aabb> &boxes);
+
+    /// Takes the new boxes of the same primitives and recomputes every node box bottom-up, keeping the tree.
+    void refit(const std::vector<Aabb> &boxes);
+
+    void clear();
+
+    [[nodiscard]] bool empty() const { return nodes.empty(); }
+
+    [[nodiscard]] size_t getNodeCount() const { return nodes.size(); }
+
+    [[nodiscard]] size_t getPrimitiveCount() const { return primitives.size(); }
+
+    /// Longest root to leaf path, the build stops splitting at MAX_DEPTH
+    [[nodiscard]] uint32_t getDepth() const { return depth; }
+
+    [[nodiscard]] const std::vector<Node> &getNodes() const { return nodes; }
+
+    /// Appends every primitive touching the frustum, with the same box test as FrustumCuller. Subtrees entirely
+    /// inside skip the plane tests, planes a node is entirely inside of aren't tested again below it.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+    /// Nearest primitive whose box the ray hits within [0, distance), NO_HIT if none. direction doesn't need
+    /// to be normalized, distance is in units of it and returns the entry distance of the hit.
+    uint32_t raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const;
+
+    /// Appends every primitive whose box intersects region.
+    void query(const Aabb &region, std::vector<uint32_t> &found) const;
+
+private:
+    static constexpr uint32_t MAX_LEAF_SIZE = 4;
+    static constexpr uint32_t BIN_COUNT = 16;
+
+    /// Bounds the traversal stacks, deeper ranges become one leaf
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+    std::vector<Node> nodes;
+
+    /// Primitive index of every leaf slot
+    std::vector<uint32_t> primitives;
+
+    /// Box of every leaf slot
+    std::vector<Aabb> slot_boxes;
+
+    uint32_t depth = 0;
+
+    /// Corners and center of a box, computed once per build. The build partitions these in place, so every
+    /// node reads its primitives sequentially.
+    struct BuildBox
+    {
+        glm::vec3 min;
+        uint32_t primitive;
+        glm::vec3 max;
+        glm::vec3 center;
+    };
+
+    uint32_t buildNode(uint32_t first, uint32_t count, uint32_t level, std::vector<BuildBox> &boxes);
+};
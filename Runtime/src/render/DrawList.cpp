@@ -0,0 +1,175 @@
+#include "DrawList.hpp"
+
+#include "../profiler/CpuProfiler.hpp"
+
+#include <array>
+#include <cstring>
+
+uint64_t DrawList::makeKey(const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const float depth)
+{
+    // Non-negative floats order like their bit patterns, the top bits are a coarse but monotonic depth
+    uint32_t depth_bits;
+    const float positive = depth > 0.0f ? depth : 0.0f;
+    std::memcpy(&depth_bits, &positive, sizeof(depth_bits));
+    depth_bits >>= 32 - DEPTH_BITS;
+
+    uint64_t key = pipeline & ((1u << PIPELINE_BITS) - 1);
+    key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+    key = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+    key = (key << DEPTH_BITS) | depth_bits;
+    return key;
+}
+
+void DrawList::add(DrawPacket packet)
+{
+    packet.key = makeKey(packet.pipeline, packet.material, packet.mesh, packet.depth);
+    packets.push_back(packet);
+}
+
+void DrawList::sort()
+{
+    VENT_PROFILE_ZONE("Sort draws");
+
+    const size_t count = packets.size();
+    if (count < 2)
+    {
+        return;
+    }
+
+    // One read over the keys fills the histograms of all 8 passes
+    std::array<std::array<uint32_t, 256>, 8> histograms{};
+    for (const auto &packet : packets)
+    {
+        for (uint32_t pass = 0; pass < 8; pass++)
+        {
+            histograms[pass][(packet.key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    scratch.resize(count);
+
+    DrawPacket *source = packets.data();
+    DrawPacket *destination = scratch.data();
+
+    for (uint32_t pass = 0; pass < 8; pass++)
+    {
+        auto &histogram = histograms[pass];
+
+        // All keys share this byte, the pass wouldn't move anything
+        if (histogram[(source[0].key >> (pass * 8)) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (auto &bucket : histogram)
+        {
+            const uint32_t bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            destination[histogram[(source[i].key >> (pass * 8)) & 0xFF]++] = source[i];
+        }
+
+        std::swap(source, destination);
+    }
+
+    // Odd number of passes, the result sits in the scratch buffer
+    if (source != packets.data())
+    {
+        packets.swap(scratch);
+    }
+}
+
+void DrawList::batch(const bool instancing)
+{
+    batches.clear();
+    runs.clear();
+
+    const auto count = static_cast<uint32_t>(packets.size());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (instancing && !batches.empty())
+        {
+            // Sorting put equal state next to each other, so comparing with the batch's first packet is enough.
+            // The ids are compared in full, the key truncates them.
+            DrawBatch &current = batches.back();
+            const DrawPacket &first = packets[current.first_packet];
+            const DrawPacket &packet = packets[i];
+            if (packet.pipeline == first.pipeline && packet.material == first.material && packet.mesh == first.mesh &&
+                packet.first_index == first.first_index && packet.index_count == first.index_count && packet.vertex_offset == first.vertex_offset)
+            {
+                current.instance_count++;
+                continue;
+            }
+        }
+
+        batches.push_back({i, 1});
+    }
+
+    const auto batch_count = static_cast<uint32_t>(batches.size());
+    for (uint32_t i = 0; i < batch_count; i++)
+    {
+        if (!runs.empty())
+        {
+            const DrawPacket &first = packets[batches[runs.back().first_batch].first_packet];
+            const DrawPacket &packet = packets[batches[i].first_packet];
+            if (packet.pipeline == first.pipeline && packet.material == first.material && packet.buffer == first.buffer)
+            {
+                runs.back().batch_count++;
+                continue;
+            }
+        }
+
+        runs.push_back({i, 1});
+    }
+}
+
+BindStats DrawList::countBinds() const
+{
+    BindStats stats;
+    stats.draws = static_cast<uint32_t>(batches.size());
+    stats.draw_calls = stats.draws;
+
+    if (batches.empty())
+    {
+        return stats;
+    }
+
+    // Camera, object and instance buffers are bound once
+    stats.descriptor_sets = 1;
+
+    const DrawPacket *previous = nullptr;
+    for (const auto &draw : batches)
+    {
+        const DrawPacket &packet = packets[draw.first_packet];
+        if (!previous || packet.pipeline != previous->pipeline)
+        {
+            stats.pipelines++;
+        }
+        if (!previous || packet.material != previous->material)
+        {
+            stats.descriptor_sets++;
+        }
+        if (!previous || packet.buffer != previous->buffer)
+        {
+            stats.buffers++;
+        }
+        previous = &packet;
+    }
+    return stats;
+}
+
+BindStats DrawList::countNaiveBinds() const
+{
+    BindStats stats;
+    stats.draws = size();
+    stats.draw_calls = size();
+    stats.pipelines = size();
+    stats.descriptor_sets = size() * 2;
+    stats.buffers = size();
+    return stats;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Everything one draw needs, flat so the list sorts and records without chasing a pointer per object.
+struct DrawPacket
+{
+    /// See DrawList::makeKey
+    uint64_t key = 0;
+
+    /// Indices into the ObjectRenderer's pipeline, material and mesh tables
+    uint32_t pipeline = 0;
+    uint32_t material = 0;
+    uint32_t mesh = 0;
+
+    /// Model whose vertex and index buffers hold the mesh, the meshes of one model share them
+    uint32_t buffer = 0;
+
+    /// Index range of the mesh in the buffers
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    int32_t vertex_offset = 0;
+
+    /// Scene node, also the record in the object buffer
+    uint32_t object = 0;
+
+    /// Squared distance to the camera
+    float depth = 0.0f;
+};
+
+/// Run of sorted packets sharing all state, drawn as one instanced draw. Instance i of the draw is packet
+/// first_packet + i, so the draw's firstInstance is first_packet.
+struct DrawBatch
+{
+    uint32_t first_packet = 0;
+    uint32_t instance_count = 0;
+};
+
+/// Consecutive batches sharing pipeline, material and vertex and index buffers, submitted with one indirect draw call.
+/// The batches may draw different meshes of those buffers.
+struct DrawRun
+{
+    uint32_t first_batch = 0;
+    uint32_t batch_count = 0;
+};
+
+/// State changes recording a draw list takes
+struct BindStats
+{
+    uint32_t draws = 0;
+    uint32_t pipelines = 0;
+    uint32_t descriptor_sets = 0;
+
+    /// Vertex and index buffer pairs
+    uint32_t buffers = 0;
+
+    /// Draw commands issued, fewer than draws when they are submitted indirectly
+    uint32_t draw_calls = 0;
+};
+
+/// Per-frame list of draw packets, radix sorted by their 64-bit keys.
+class DrawList
+{
+public:
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t MESH_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 24;
+
+    /// Pipeline in the top bits, then material, then mesh, so each of them is bound once per run of equal keys.
+    /// The meshes of one model have consecutive ids, so they sort next to each other and share their buffer binds.
+    /// Depth comes last, draws sharing all state go front to back. Ids are truncated to their bit counts.
+    static uint64_t makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    void clear()
+    {
+        packets.clear();
+        batches.clear();
+        runs.clear();
+    }
+
+    void reserve(const size_t count) { packets.reserve(count); }
+
+    /// Computes the packet's key from its other fields and appends it.
+    void add(DrawPacket packet);
+
+    /// Stable LSD radix sort on the keys, 8 bits per pass. Passes where every key has the same byte are skipped.
+    void sort();
+
+    /// Groups the sorted packets into batches, and the batches into runs. With instancing, neighbours drawing the
+    /// same mesh range with the same pipeline and material share one batch, without it every packet is its own.
+    /// Neighbouring batches with the same pipeline, material and buffers share a run, whatever mesh they draw.
+    void batch(bool instancing);
+
+    [[nodiscard]] const std::vector<DrawPacket> &getPackets() const { return packets; }
+
+    [[nodiscard]] const std::vector<DrawBatch> &getBatches() const { return batches; }
+
+    [[nodiscard]] const std::vector<DrawRun> &getRuns() const { return runs; }
+
+    [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(packets.size()); }
+
+    [[nodiscard]] bool empty() const { return packets.empty(); }
+
+    /// Binds recording the batches in order on one command buffer takes, skipping state that is already bound.
+    /// Counts one draw call per batch.
+    [[nodiscard]] BindStats countBinds() const;
+
+    /// Binds of the same packets if every packet is its own draw and rebinds all of its state.
+    [[nodiscard]] BindStats countNaiveBinds() const;
+
+private:
+    std::vector<DrawPacket> packets;
+
+    std::vector<DrawBatch> batches;
+
+    std::vector<DrawRun> runs;
+
+    /// Second buffer of the sort passes, kept to avoid reallocating every frame
+    std::vector<DrawPacket> scratch;
+};
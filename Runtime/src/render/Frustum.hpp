@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+
+/// View frustum as six planes (xyz normal pointing inwards, w distance), a point p is inside when dot(n, p) + w >= 0 for all.
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes;
+
+    /// Extracts the planes from a projection * view matrix with Vulkan's 0..w clip depth, which includes reverse-Z.
+    static Frustum fromMatrix(const glm::mat4 &clip)
+    {
+        const glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        const glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        const glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        const glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+        Frustum frustum;
+        frustum.planes = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2};
+
+        for (auto &plane : frustum.planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    [[nodiscard]] bool intersectsSphere(const glm::vec3 &center, const float radius) const
+    {
+        for (const auto &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,193 @@
+#include "FrustumCuller.hpp"
+
+#include "../jobs/JobSystem.hpp"
+#include "../profiler/CpuProfiler.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VENT_CULL_AVX2
+#define VENT_CULL_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define VENT_CULL_SSE
+#endif
+
+/// Boxes per job, a multiple of every SIMD width so only the last batch has a scalar tail
+static constexpr uint32_t CULL_BATCH_SIZE = 16384;
+
+void FrustumCuller::resize(const size_t count)
+{
+    center_x.resize(count, 0.0f);
+    center_y.resize(count, 0.0f);
+    center_z.resize(count, 0.0f);
+
+    extent_x.resize(count, 0.0f);
+    extent_y.resize(count, 0.0f);
+    extent_z.resize(count, 0.0f);
+}
+
+void FrustumCuller::setBounds(const uint32_t index, const glm::mat4 &world, const glm::vec3 &min, const glm::vec3 &max)
+{
+    const glm::vec3 center = glm::vec3(world * glm::vec4((min + max) * 0.5f, 1.0f));
+    const glm::vec3 extent = (max - min) * 0.5f;
+
+    center_x[index] = center.x;
+    center_y[index] = center.y;
+    center_z[index] = center.z;
+
+    // Arvo: every world axis extent is the local extents projected with the absolute matrix
+    const glm::mat3 absolute(glm::abs(glm::vec3(world[0])), glm::abs(glm::vec3(world[1])), glm::abs(glm::vec3(world[2])));
+    const glm::vec3 world_extent = absolute * extent;
+
+    extent_x[index] = world_extent.x;
+    extent_y[index] = world_extent.y;
+    extent_z[index] = world_extent.z;
+}
+
+const char *FrustumCuller::simdPath()
+{
+#if defined(VENT_CULL_AVX2)
+    return "AVX2";
+#elif defined(VENT_CULL_SSE)
+    return "SSE";
+#else
+    return "Scalar";
+#endif
+}
+
+void FrustumCuller::cullScalar(const Frustum &frustum, uint8_t *visible, const size_t first, const size_t count) const
+{
+    for (size_t i = first; i < first + count; i++)
+    {
+        uint8_t inside = 1;
+        for (const auto &plane : frustum.planes)
+        {
+            // Signed distance of the center, against how far the box reaches towards the plane
+            const float distance = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+            const float radius = std::fabs(plane.x) * extent_x[i] + std::fabs(plane.y) * extent_y[i] + std::fabs(plane.z) * extent_z[i];
+            if (distance + radius < 0.0f)
+            {
+                inside = 0;
+                break;
+            }
+        }
+        visible[i] = inside;
+    }
+}
+
+#if defined(VENT_CULL_SSE)
+
+/// One byte per lane of a 4 bit movemask, 0 or 1
+static constexpr uint32_t expand_mask(const uint32_t mask)
+{
+    return (mask & 1u) | ((mask >> 1) & 1u) << 8 | ((mask >> 2) & 1u) << 16 | ((mask >> 3) & 1u) << 24;
+}
+
+static constexpr uint32_t MASK_BYTES[16] = {expand_mask(0), expand_mask(1), expand_mask(2), expand_mask(3),
+                                            expand_mask(4), expand_mask(5), expand_mask(6), expand_mask(7),
+                                            expand_mask(8), expand_mask(9), expand_mask(10), expand_mask(11),
+                                            expand_mask(12), expand_mask(13), expand_mask(14), expand_mask(15)};
+
+static inline void store_mask(uint8_t *visible, const int mask)
+{
+    std::memcpy(visible, &MASK_BYTES[mask & 0xF], 4);
+}
+
+#endif
+
+void FrustumCuller::cull(const Frustum &frustum, uint8_t *visible, const size_t first, const size_t count) const
+{
+    size_t i = first;
+    const size_t end = first + count;
+
+#if defined(VENT_CULL_AVX2)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+        for (int p = 0; p < 6; p++)
+        {
+            nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+            ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+            nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+            nw[p] = _mm256_set1_ps(frustum.planes[p].w);
+            ax[p] = _mm256_andnot_ps(sign, nx[p]);
+            ay[p] = _mm256_andnot_ps(sign, ny[p]);
+            az[p] = _mm256_andnot_ps(sign, nz[p]);
+        }
+
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 cx = _mm256_loadu_ps(&center_x[i]), cy = _mm256_loadu_ps(&center_y[i]), cz = _mm256_loadu_ps(&center_z[i]);
+            const __m256 ex = _mm256_loadu_ps(&extent_x[i]), ey = _mm256_loadu_ps(&extent_y[i]), ez = _mm256_loadu_ps(&extent_z[i]);
+
+            // All bits set for the boxes entirely behind any of the planes
+            __m256 outside = zero;
+            for (int p = 0; p < 6; p++)
+            {
+                const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), nw[p]);
+                const __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+            }
+
+            const int mask = ~_mm256_movemask_ps(outside);
+            store_mask(&visible[i], mask);
+            store_mask(&visible[i + 4], mask >> 4);
+        }
+    }
+#endif
+
+#if defined(VENT_CULL_SSE)
+    {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+        for (int p = 0; p < 6; p++)
+        {
+            nx[p] = _mm_set1_ps(frustum.planes[p].x);
+            ny[p] = _mm_set1_ps(frustum.planes[p].y);
+            nz[p] = _mm_set1_ps(frustum.planes[p].z);
+            nw[p] = _mm_set1_ps(frustum.planes[p].w);
+            ax[p] = _mm_andnot_ps(sign, nx[p]);
+            ay[p] = _mm_andnot_ps(sign, ny[p]);
+            az[p] = _mm_andnot_ps(sign, nz[p]);
+        }
+
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 cx = _mm_loadu_ps(&center_x[i]), cy = _mm_loadu_ps(&center_y[i]), cz = _mm_loadu_ps(&center_z[i]);
+            const __m128 ex = _mm_loadu_ps(&extent_x[i]), ey = _mm_loadu_ps(&extent_y[i]), ez = _mm_loadu_ps(&extent_z[i]);
+
+            __m128 outside = zero;
+            for (int p = 0; p < 6; p++)
+            {
+                const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)), nw[p]);
+                const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+            }
+
+            store_mask(&visible[i], ~_mm_movemask_ps(outside));
+        }
+    }
+#endif
+
+    cullScalar(frustum, visible, i, end - i);
+}
+
+void FrustumCuller::cull(const Frustum &frustum, uint8_t *visible, JobSystem &jobs) const
+{
+    VENT_PROFILE_ZONE("Frustum cull");
+
+    const auto count = static_cast<uint32_t>(size());
+    if (count <= CULL_BATCH_SIZE)
+    {
+        cull(frustum, visible, 0, count);
+        return;
+    }
+
+    jobs.parallelFor(count, CULL_BATCH_SIZE, [&](const uint32_t begin, const uint32_t end)
+                     { cull(frustum, visible, begin, end - begin); });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Aabb.hpp"
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+/// World space bounding boxes stored as structure-of-arrays (center and half extent), so the frustum test
+/// runs on 4 (SSE) or 8 (AVX2) boxes per iteration.
+class FrustumCuller
+{
+public:
+    std::vector<float> center_x, center_y, center_z;
+    std::vector<float> extent_x, extent_y, extent_z;
+
+    void resize(size_t count);
+
+    void clear() { resize(0); }
+
+    [[nodiscard]] size_t size() const { return center_x.size(); }
+
+    /// Stores the world space box around the local box [min, max] transformed by world.
+    void setBounds(uint32_t index, const glm::mat4 &world, const glm::vec3 &min, const glm::vec3 &max);
+
+    [[nodiscard]] Aabb getBounds(const uint32_t index) const
+    {
+        return {glm::vec3(center_x[index], center_y[index], center_z[index]), glm::vec3(extent_x[index], extent_y[index], extent_z[index])};
+    }
+
+    /// Writes 1 for every box of [first, first + count) touching the frustum into visible[first...], 0 for the others.
+    /// Uses the widest SIMD path the build targets, falls back to cullScalar elsewhere.
+    void cull(const Frustum &frustum, uint8_t *visible, size_t first, size_t count) const;
+
+    void cull(const Frustum &frustum, uint8_t *visible) const { cull(frustum, visible, 0, size()); }
+
+    /// cull split into batches over the job system, returns once every box was tested.
+    void cull(const Frustum &frustum, uint8_t *visible, JobSystem &jobs) const;
+
+    /// Scalar reference implementation of cull, used for the tail and for verification.
+    void cullScalar(const Frustum &frustum, uint8_t *visible, size_t first, size_t count) const;
+
+    /// Name of the SIMD path cull was compiled with.
+    static const char *simdPath();
+};
@@ -0,0 +1,228 @@
+#include "GpuCulling.hpp"
+
+#include "../profiler/CpuProfiler.hpp"
+#include "../profiler/GpuProfiler.hpp"
+
+#include <algorithm>
+
+/// Matches CullInstance in cull.comp.glsl (std430)
+struct CullInstance
+{
+    glm::vec4 sphere;
+    uint32_t object;
+    uint32_t batch;
+    uint32_t padding[2];
+};
+
+/// Matches CullBatch in cull.comp.glsl (std430), instance_count is the counter pass 0 increments
+struct CullBatch
+{
+    uint32_t index_count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t first_instance;
+    uint32_t run;
+    uint32_t run_first;
+    uint32_t padding;
+};
+
+static_assert(sizeof(CullInstance) == 32 && sizeof(CullBatch) == 32, "Cull records have to match cull.comp.glsl");
+
+static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+/// Grows a host-written storage buffer, the contents are rewritten every frame so nothing is copied
+static void grow(std::unique_ptr<VulkanVertexBuffer> &buffer, uint32_t &capacity, const uint32_t count, const vk::DeviceSize stride)
+{
+    if (buffer && count <= capacity)
+    {
+        return;
+    }
+
+    capacity = std::max(capacity, 1000u);
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    buffer = std::make_unique<VulkanVertexBuffer>(context->device, stride * capacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+}
+
+GpuCulling::GpuCulling(const uint32_t frames_in_flight)
+{
+    std::vector<vk::DescriptorSetLayout> layouts(frames_in_flight, context->cull_descriptor_set_layout);
+    const vk::DescriptorSetAllocateInfo alloc_info(context->descriptor_pool, layouts);
+    descriptor_sets = context->device.allocateDescriptorSets(alloc_info);
+
+    instance_buffers.resize(frames_in_flight);
+    batch_buffers.resize(frames_in_flight);
+    instance_capacities.resize(frames_in_flight, 0);
+    batch_capacities.resize(frames_in_flight, 0);
+    instance_counts.resize(frames_in_flight, 0);
+    batch_counts.resize(frames_in_flight, 0);
+    run_counts.resize(frames_in_flight, 0);
+
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        grow(instance_buffers[i], instance_capacities[i], 0, sizeof(CullInstance));
+        grow(batch_buffers[i], batch_capacities[i], 0, sizeof(CullBatch));
+    }
+}
+
+GpuCulling::~GpuCulling()
+{
+    // The sets go back with the pool
+    instance_buffers.clear();
+    batch_buffers.clear();
+    history.reset();
+}
+
+void GpuCulling::setOcclusion(const HiZPyramid *occlusion_pyramid)
+{
+    pyramid = context->occlusion_cull_pipeline ? occlusion_pyramid : nullptr;
+
+    if (pyramid && occlusion_sets.empty())
+    {
+        std::vector<vk::DescriptorSetLayout> layouts(descriptor_sets.size(), context->occlusion_descriptor_set_layout);
+        const vk::DescriptorSetAllocateInfo alloc_info(context->descriptor_pool, layouts);
+        occlusion_sets = context->device.allocateDescriptorSets(alloc_info);
+    }
+}
+
+void GpuCulling::update(const uint32_t frame, const DrawList &list, const std::vector<MeshBounds> &mesh_bounds, const uint32_t object_count)
+{
+    VENT_PROFILE_ZONE("Write cull records");
+
+    if (pyramid && object_count > history_capacity)
+    {
+        // Frames in flight still use the old history, the new one starts out empty: one frame draws everything in the late phase
+        history_capacity = std::max(history_capacity, 1000u);
+        while (history_capacity < object_count)
+        {
+            history_capacity *= 2;
+        }
+
+        if (history)
+        {
+            retire_resource([old = std::shared_ptr<VulkanVertexBuffer>(std::move(history))]() {});
+        }
+        history = std::make_unique<VulkanVertexBuffer>(context->device, sizeof(uint32_t) * history_capacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        std::fill_n(reinterpret_cast<uint32_t *>(history->map()), history_capacity, 0u);
+        history->mark_dirty(0, sizeof(uint32_t) * history_capacity);
+    }
+
+    const auto &packets = list.getPackets();
+    const auto &batches = list.getBatches();
+    const auto &runs = list.getRuns();
+
+    grow(instance_buffers[frame], instance_capacities[frame], list.size(), sizeof(CullInstance));
+    grow(batch_buffers[frame], batch_capacities[frame], static_cast<uint32_t>(batches.size()), sizeof(CullBatch));
+
+    instance_counts[frame] = list.size();
+    batch_counts[frame] = static_cast<uint32_t>(batches.size());
+    run_counts[frame] = static_cast<uint32_t>(runs.size());
+
+    if (batches.empty())
+    {
+        return;
+    }
+
+    auto *instances = reinterpret_cast<CullInstance *>(instance_buffers[frame]->map());
+    auto *batch_records = reinterpret_cast<CullBatch *>(batch_buffers[frame]->map());
+
+    for (uint32_t run = 0; run < runs.size(); run++)
+    {
+        for (uint32_t b = runs[run].first_batch; b < runs[run].first_batch + runs[run].batch_count; b++)
+        {
+            const DrawBatch &batch = batches[b];
+            const DrawPacket &first = packets[batch.first_packet];
+
+            batch_records[b] = {first.index_count, 0, first.first_index, first.vertex_offset, batch.first_packet, run, runs[run].first_batch, 0};
+
+            for (uint32_t p = batch.first_packet; p < batch.first_packet + batch.instance_count; p++)
+            {
+                instances[p] = {mesh_bounds[packets[p].mesh].sphere, packets[p].object, b, {0, 0}};
+            }
+        }
+    }
+
+    instance_buffers[frame]->mark_dirty(0, sizeof(CullInstance) * list.size());
+    batch_buffers[frame]->mark_dirty(0, sizeof(CullBatch) * batches.size());
+}
+
+void GpuCulling::record(const vk::CommandBuffer &cmd, const uint32_t frame, const uint32_t phase, const Frustum &frustum, const vk::Buffer objects,
+                        const vk::Buffer visible, const vk::Buffer camera, const IndirectDrawBuffer &indirect) const
+{
+    if (batch_counts[frame] == 0)
+    {
+        return;
+    }
+
+    const uint32_t scope = context->gpu_profiler ? context->gpu_profiler->begin(cmd, phase == 0 ? "Frustum cull" : "Occlusion cull") : GpuProfiler::INVALID_SCOPE;
+
+    // Both phases share the sets, they can't change once the early phase bound them
+    if (phase == 0)
+    {
+        // Any of the buffers may have grown since the frame slot was last used
+        const std::array<vk::DescriptorBufferInfo, 6> infos = {{{objects, 0, VK_WHOLE_SIZE},
+                                                                {instance_buffers[frame]->get_handle(), 0, VK_WHOLE_SIZE},
+                                                                {batch_buffers[frame]->get_handle(), 0, VK_WHOLE_SIZE},
+                                                                {visible, 0, VK_WHOLE_SIZE},
+                                                                {indirect.getCommands(frame), 0, VK_WHOLE_SIZE},
+                                                                {indirect.getCounts(frame), 0, VK_WHOLE_SIZE}}};
+
+        std::vector<vk::WriteDescriptorSet> writes(infos.size());
+        for (uint32_t i = 0; i < infos.size(); i++)
+        {
+            writes[i] = vk::WriteDescriptorSet(descriptor_sets[frame], i, 0, vk::DescriptorType::eStorageBuffer, {}, infos[i]);
+        }
+
+        const vk::DescriptorBufferInfo history_info(pyramid ? history->get_handle() : nullptr, 0, VK_WHOLE_SIZE);
+        const vk::DescriptorBufferInfo camera_info(camera, 0, VK_WHOLE_SIZE);
+        const vk::DescriptorImageInfo pyramid_info(pyramid ? pyramid->getSampler() : nullptr, pyramid ? pyramid->getView() : nullptr, vk::ImageLayout::eGeneral);
+        if (pyramid)
+        {
+            writes.emplace_back(occlusion_sets[frame], 0, 0, vk::DescriptorType::eStorageBuffer, nullptr, history_info);
+            writes.emplace_back(occlusion_sets[frame], 1, 0, vk::DescriptorType::eUniformBuffer, nullptr, camera_info);
+            writes.emplace_back(occlusion_sets[frame], 2, 0, vk::DescriptorType::eCombinedImageSampler, pyramid_info);
+        }
+        context->device.updateDescriptorSets(writes, {});
+    }
+
+    const vk::Pipeline pipeline = pyramid ? context->occlusion_cull_pipeline : context->cull_pipeline;
+    const vk::PipelineLayout layout = pyramid ? context->occlusion_cull_pipeline_layout : context->cull_pipeline_layout;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, descriptor_sets[frame], {});
+    if (pyramid)
+    {
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 1, occlusion_sets[frame], {});
+    }
+
+    CullPushConstants push_constants;
+    std::copy(frustum.planes.begin(), frustum.planes.end(), push_constants.planes);
+    push_constants.instance_count = instance_counts[frame];
+    push_constants.batch_count = batch_counts[frame];
+    push_constants.compact = context->draw_indirect_count ? 1 : 0;
+    push_constants.phase = phase;
+    push_constants.run_count = run_counts[frame];
+    push_constants.pyramid_width = pyramid ? pyramid->getWidth() : 0;
+    push_constants.pyramid_height = pyramid ? pyramid->getHeight() : 0;
+
+    // Pass 0, the visible instances of every batch
+    push_constants.pass = 0;
+    cmd.pushConstants<CullPushConstants>(layout, vk::ShaderStageFlagBits::eCompute, 0, push_constants);
+    cmd.dispatch((instance_counts[frame] + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    // Pass 1 reads the instance counts pass 0 accumulated
+    const vk::MemoryBarrier counted(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, counted, nullptr, nullptr);
+
+    push_constants.pass = 1;
+    cmd.pushConstants<CullPushConstants>(layout, vk::ShaderStageFlagBits::eCompute, 0, push_constants);
+    cmd.dispatch((batch_counts[frame] + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    if (context->gpu_profiler)
+    {
+        context->gpu_profiler->end(cmd, scope);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+#include "../vk/buffer/VulkanVertexBuffer.hpp"
+#include "../vk/mesh/Vulkan_Mesh.hpp"
+
+#include "DrawList.hpp"
+#include "Frustum.hpp"
+#include "HiZPyramid.hpp"
+#include "IndirectDrawBuffer.hpp"
+
+#include <memory>
+#include <vector>
+
+/// Frustum culls the draw list on the GPU with cull.comp.glsl.
+///
+/// The CPU only writes one record per packet (bounding sphere, object, batch) and one per batch. The compute
+/// pass fills the instance buffer with the visible objects of every batch and writes the indirect commands,
+/// compacted per run with a draw count when the device has drawIndirectCount. Everything stays on the GPU,
+/// the CPU never learns what was culled.
+///
+/// With a Hi-Z pyramid set, culling runs in two phases with cull_occlusion.comp.glsl: the early phase draws what was
+/// visible last frame, the pyramid is built from its depth, and the late phase tests everything against it and draws
+/// what became visible. Each phase has its own region in the instance, command and count buffers.
+class GpuCulling
+{
+public:
+    explicit GpuCulling(uint32_t frames_in_flight);
+    ~GpuCulling();
+
+    GpuCulling(const GpuCulling &) = delete;
+
+    GpuCulling &operator=(const GpuCulling &) = delete;
+
+    /// Culls against pyramid in two phases from now on, null returns to frustum culling only.
+    /// Needs context->occlusion_cull_pipeline.
+    void setOcclusion(const HiZPyramid *pyramid);
+
+    /// Phases a frame is culled and drawn in: 2 with occlusion culling, else 1.
+    [[nodiscard]] uint32_t getPhaseCount() const { return pyramid ? 2 : 1; }
+
+    /// Writes the frame's cull records. mesh_bounds holds the local bounds of every mesh id,
+    /// object_count sizes the visibility history of occlusion culling.
+    void update(uint32_t frame, const DrawList &list, const std::vector<MeshBounds> &mesh_bounds, uint32_t object_count);
+
+    /// Records both dispatches of a phase, outside a render pass. The frame graph orders it against the draws and the
+    /// other phase, from the accesses its pass declares. objects, visible and camera are the frame's object, instance and
+    /// camera buffers. The late phase goes after the pyramid was built from the early phase's depth.
+    void record(const vk::CommandBuffer &cmd, uint32_t frame, uint32_t phase, const Frustum &frustum, vk::Buffer objects, vk::Buffer visible, vk::Buffer camera,
+                const IndirectDrawBuffer &indirect) const;
+
+private:
+    std::vector<vk::DescriptorSet> descriptor_sets;
+
+    /// Set 1 of the occlusion cull per frame, allocated with the first setOcclusion
+    std::vector<vk::DescriptorSet> occlusion_sets;
+
+    const HiZPyramid *pyramid = nullptr;
+
+    /// Whether each object was visible in the latest late phase, shared by all frames since it carries over between them
+    std::unique_ptr<VulkanVertexBuffer> history;
+    uint32_t history_capacity = 0;
+
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> instance_buffers;
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> batch_buffers;
+
+    std::vector<uint32_t> instance_capacities;
+    std::vector<uint32_t> batch_capacities;
+
+    /// Records written by the latest update of each frame
+    std::vector<uint32_t> instance_counts;
+    std::vector<uint32_t> batch_counts;
+    std::vector<uint32_t> run_counts;
+};
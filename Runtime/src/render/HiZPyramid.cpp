@@ -0,0 +1,152 @@
+#include "HiZPyramid.hpp"
+
+#include "../profiler/GpuProfiler.hpp"
+
+#include <algorithm>
+
+static constexpr uint32_t WORKGROUP_SIZE = 8;
+
+HiZPyramid::HiZPyramid()
+{
+    // Only texelFetch reads the pyramid, the sampler is just what the descriptor type asks for
+    vk::SamplerCreateInfo sampler_info;
+    sampler_info.magFilter = vk::Filter::eNearest;
+    sampler_info.minFilter = vk::Filter::eNearest;
+    sampler_info.mipmapMode = vk::SamplerMipmapMode::eNearest;
+    sampler_info.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    sampler_info.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+    sampler_info.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    sampler_info.maxLod = static_cast<float>(MAX_LEVELS);
+    sampler = context->device.createSampler(sampler_info);
+
+    std::vector<vk::DescriptorSetLayout> layouts(MAX_LEVELS, context->hiz_descriptor_set_layout);
+    const vk::DescriptorSetAllocateInfo alloc_info(context->descriptor_pool, layouts);
+    descriptor_sets = context->device.allocateDescriptorSets(alloc_info);
+}
+
+HiZPyramid::~HiZPyramid()
+{
+    this->destroy();
+
+    // The sets go back with the pool
+    retire_resource([sampler = sampler]()
+                    { context->device.destroySampler(sampler); });
+}
+
+void HiZPyramid::destroy()
+{
+    if (!image)
+    {
+        return;
+    }
+
+    retire_resource([view = view, level_views = level_views, depth_view = depth_view]()
+                    {
+        for (const auto &level_view : level_views)
+        {
+            context->device.destroyImageView(level_view);
+        }
+        context->device.destroyImageView(view);
+        context->device.destroyImageView(depth_view); });
+
+    image = nullptr;
+    level_views.clear();
+}
+
+static uint32_t level_count(const uint32_t width, const uint32_t height)
+{
+    uint32_t levels = 1;
+    while (levels < HiZPyramid::MAX_LEVELS && (std::max(width, height) >> levels) > 0)
+    {
+        levels++;
+    }
+    return levels;
+}
+
+RenderGraph::ImageDesc HiZPyramid::describe(const uint32_t width, const uint32_t height)
+{
+    RenderGraph::ImageDesc desc;
+    desc.format = vk::Format::eR32Sfloat;
+    desc.extent = vk::Extent2D(width, height);
+    desc.levels = level_count(width, height);
+    desc.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+    return desc;
+}
+
+void HiZPyramid::bind(const vk::Image depth, const vk::Image pyramid, const uint32_t pyramid_width, const uint32_t pyramid_height)
+{
+    this->destroy();
+
+    image = pyramid;
+    width = pyramid_width;
+    height = pyramid_height;
+    levels = level_count(width, height);
+
+    vk::ImageViewCreateInfo view_info({}, image, vk::ImageViewType::e2D, vk::Format::eR32Sfloat, {}, {vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1});
+    view = context->device.createImageView(view_info);
+
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        view_info.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level, 1, 0, 1);
+        level_views.push_back(context->device.createImageView(view_info));
+    }
+
+    // The depth image's own view may include stencil, which can't be sampled
+    const vk::ImageViewCreateInfo depth_info({}, depth, vk::ImageViewType::e2D, context->depthFormat, {}, {vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1});
+    depth_view = context->device.createImageView(depth_info);
+
+    // Level i reads level i - 1, level 0 the depth buffer
+    std::vector<vk::DescriptorImageInfo> sources(levels);
+    std::vector<vk::DescriptorImageInfo> destinations(levels);
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        sources[level] = level == 0 ? vk::DescriptorImageInfo(sampler, depth_view, vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+                                    : vk::DescriptorImageInfo(sampler, level_views[level - 1], vk::ImageLayout::eGeneral);
+        destinations[level] = vk::DescriptorImageInfo(nullptr, level_views[level], vk::ImageLayout::eGeneral);
+
+        writes.emplace_back(descriptor_sets[level], 0, 0, vk::DescriptorType::eCombinedImageSampler, sources[level]);
+        writes.emplace_back(descriptor_sets[level], 1, 0, vk::DescriptorType::eStorageImage, destinations[level]);
+    }
+    context->device.updateDescriptorSets(writes, {});
+}
+
+void HiZPyramid::build(const vk::CommandBuffer &cmd) const
+{
+    const uint32_t scope = context->gpu_profiler ? context->gpu_profiler->begin(cmd, "Hi-Z pyramid") : GpuProfiler::INVALID_SCOPE;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, context->hiz_pipeline);
+
+    HiZPushConstants push_constants;
+    push_constants.source_width = width;
+    push_constants.source_height = height;
+
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        // Vulkan's mip sizes round down, the shader widens the footprint of the texels covering the leftover row and column
+        push_constants.width = std::max(1u, width >> level);
+        push_constants.height = std::max(1u, height >> level);
+
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, context->hiz_pipeline_layout, 0, descriptor_sets[level], {});
+        cmd.pushConstants<HiZPushConstants>(context->hiz_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, push_constants);
+        cmd.dispatch((push_constants.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (push_constants.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+        // The next level reads this one. The graph makes all of them visible to the cull.
+        if (level + 1 == levels)
+        {
+            break;
+        }
+
+        const vk::ImageMemoryBarrier written(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral,
+                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, {vk::ImageAspectFlagBits::eColor, level, 1, 0, 1});
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, written);
+
+        push_constants.source_width = push_constants.width;
+        push_constants.source_height = push_constants.height;
+    }
+
+    if (context->gpu_profiler)
+    {
+        context->gpu_profiler->end(cmd, scope);
+    }
+}
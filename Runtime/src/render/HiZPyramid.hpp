@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+#include "RenderGraph.hpp"
+
+#include <vector>
+
+/// Hierarchical-Z pyramid of the depth buffer for occlusion culling, built with hiz.comp.glsl.
+///
+/// An R32F image with a full mip chain in eGeneral. Level 0 is a copy of the depth buffer, every further level keeps
+/// the farthest depth of the texels below it, so an object whose nearest depth is behind a texel's value is hidden
+/// over that texel's whole footprint. The image is rebuilt from scratch every frame, its previous contents never matter,
+/// so it is a transient of the frame graph; the pyramid only owns the views and descriptor sets over it.
+class HiZPyramid
+{
+public:
+    static constexpr uint32_t MAX_LEVELS = 16;
+
+    HiZPyramid();
+    ~HiZPyramid();
+
+    HiZPyramid(const HiZPyramid &) = delete;
+
+    HiZPyramid &operator=(const HiZPyramid &) = delete;
+
+    /// The pyramid image for a depth buffer of width x height, for RenderGraph::createImage
+    static RenderGraph::ImageDesc describe(uint32_t width, uint32_t height);
+
+    /// (Re)creates the views and descriptor sets over the graph's images, after every compile. depth needs eSampled usage,
+    /// pyramid is the image describe() asked for.
+    void bind(vk::Image depth, vk::Image pyramid, uint32_t width, uint32_t height);
+
+    /// Reduces the depth the early pass left in eDepthStencilReadOnlyOptimal into every level, outside a render pass.
+    /// The graph transitions the pyramid to eGeneral before and makes the levels visible to the cull after.
+    void build(const vk::CommandBuffer &cmd) const;
+
+    /// All levels, for texelFetch in the cull shader
+    [[nodiscard]] vk::ImageView getView() const { return view; }
+
+    [[nodiscard]] vk::Sampler getSampler() const { return sampler; }
+
+    [[nodiscard]] uint32_t getWidth() const { return width; }
+
+    [[nodiscard]] uint32_t getHeight() const { return height; }
+
+private:
+    vk::Image image;
+
+    vk::ImageView view;
+
+    /// One view per level, written as storage image and read by the next level
+    std::vector<vk::ImageView> level_views;
+
+    /// Depth-only view of the depth image, level 0 reads it
+    vk::ImageView depth_view;
+
+    vk::Sampler sampler;
+
+    /// One per level, allocated once for MAX_LEVELS and rewritten on resize
+    std::vector<vk::DescriptorSet> descriptor_sets;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+
+    /// Hands the views to the retire queue, frames in flight may still read them.
+    void destroy();
+};
@@ -0,0 +1,151 @@
+#include "IndirectDrawBuffer.hpp"
+
+#include "../profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+
+static constexpr vk::BufferUsageFlags INDIRECT_USAGE = vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+
+IndirectDrawBuffer::IndirectDrawBuffer(const uint32_t frames_in_flight)
+{
+    commands.resize(frames_in_flight);
+    counts.resize(frames_in_flight);
+    command_capacities.resize(frames_in_flight, 0);
+    count_capacities.resize(frames_in_flight, 0);
+    phase_commands.resize(frames_in_flight, 0);
+    phase_counts.resize(frames_in_flight, 0);
+
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        this->reserve(i, 1000, 100);
+    }
+}
+
+void IndirectDrawBuffer::reserve(const uint32_t frame, const uint32_t command_count, const uint32_t run_count)
+{
+    // Rewritten every frame, so growing doesn't have to copy
+    if (command_count > command_capacities[frame])
+    {
+        uint32_t capacity = std::max(command_capacities[frame], 1000u);
+        while (capacity < command_count)
+        {
+            capacity *= 2;
+        }
+        commands[frame] = std::make_unique<VulkanVertexBuffer>(context->device, COMMAND_STRIDE * capacity, INDIRECT_USAGE, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        command_capacities[frame] = capacity;
+    }
+
+    if (run_count > count_capacities[frame])
+    {
+        uint32_t capacity = std::max(count_capacities[frame], 100u);
+        while (capacity < run_count)
+        {
+            capacity *= 2;
+        }
+        counts[frame] = std::make_unique<VulkanVertexBuffer>(context->device, sizeof(uint32_t) * capacity, INDIRECT_USAGE, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        count_capacities[frame] = capacity;
+    }
+}
+
+void IndirectDrawBuffer::update(const uint32_t frame, const DrawList &list)
+{
+    VENT_PROFILE_ZONE("Write indirect draws");
+
+    const auto &packets = list.getPackets();
+    const auto &batches = list.getBatches();
+    const auto &runs = list.getRuns();
+
+    this->reserve(frame, static_cast<uint32_t>(batches.size()), static_cast<uint32_t>(runs.size()));
+
+    if (batches.empty())
+    {
+        return;
+    }
+
+    auto *written = reinterpret_cast<vk::DrawIndexedIndirectCommand *>(commands[frame]->map());
+    for (const auto &batch : batches)
+    {
+        const DrawPacket &packet = packets[batch.first_packet];
+        *written++ = vk::DrawIndexedIndirectCommand(packet.index_count, batch.instance_count, packet.first_index, packet.vertex_offset, batch.first_packet);
+    }
+    commands[frame]->mark_dirty(0, COMMAND_STRIDE * batches.size());
+
+    auto *run_counts = reinterpret_cast<uint32_t *>(counts[frame]->map());
+    for (const auto &run : runs)
+    {
+        *run_counts++ = run.batch_count;
+    }
+    counts[frame]->mark_dirty(0, sizeof(uint32_t) * runs.size());
+}
+
+void IndirectDrawBuffer::clearCounts(const uint32_t frame, const DrawList &list, const uint32_t phases)
+{
+    phase_commands[frame] = static_cast<uint32_t>(list.getBatches().size());
+    phase_counts[frame] = static_cast<uint32_t>(list.getRuns().size());
+
+    this->reserve(frame, phase_commands[frame] * phases, phase_counts[frame] * phases);
+
+    const uint32_t count_total = phase_counts[frame] * phases;
+    if (count_total == 0)
+    {
+        return;
+    }
+
+    std::fill_n(reinterpret_cast<uint32_t *>(counts[frame]->map()), count_total, 0u);
+    counts[frame]->mark_dirty(0, sizeof(uint32_t) * count_total);
+}
+
+void IndirectDrawBuffer::draw(const vk::CommandBuffer &buffer, const uint32_t frame, const uint32_t run_index, const DrawRun &run, const uint32_t phase) const
+{
+    const vk::Buffer command_buffer = commands[frame]->get_handle();
+    const vk::DeviceSize offset = COMMAND_STRIDE * (phase * phase_commands[frame] + run.first_batch);
+    const vk::DeviceSize count_offset = sizeof(uint32_t) * (phase * phase_counts[frame] + run_index);
+
+    if (context->draw_indirect_count)
+    {
+        buffer.drawIndexedIndirectCount(command_buffer, offset, counts[frame]->get_handle(), count_offset, run.batch_count, COMMAND_STRIDE);
+    }
+    else if (context->multi_draw_indirect)
+    {
+        buffer.drawIndexedIndirect(command_buffer, offset, run.batch_count, COMMAND_STRIDE);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < run.batch_count; i++)
+        {
+            buffer.drawIndexedIndirect(command_buffer, offset + COMMAND_STRIDE * i, 1, COMMAND_STRIDE);
+        }
+    }
+}
+
+uint32_t IndirectDrawBuffer::drawCalls(const DrawRun &run)
+{
+    return context->draw_indirect_count || context->multi_draw_indirect ? 1 : run.batch_count;
+}
+
+uint32_t IndirectDrawBuffer::readInstanceCount(const uint32_t frame, const DrawList &list, const uint32_t phase) const
+{
+    const auto &runs = list.getRuns();
+    if (runs.empty())
+    {
+        return 0;
+    }
+
+    commands[frame]->invalidate();
+    counts[frame]->invalidate();
+
+    const auto *written = reinterpret_cast<const vk::DrawIndexedIndirectCommand *>(commands[frame]->map()) + phase * phase_commands[frame];
+    const auto *run_counts = reinterpret_cast<const uint32_t *>(counts[frame]->map()) + phase * phase_counts[frame];
+
+    uint32_t instances = 0;
+    for (uint32_t run = 0; run < runs.size(); run++)
+    {
+        // Compacted commands fill the front of the run, without compaction culled batches draw zero instances
+        const uint32_t used = context->draw_indirect_count ? run_counts[run] : runs[run].batch_count;
+        for (uint32_t i = 0; i < used; i++)
+        {
+            instances += written[runs[run].first_batch + i].instanceCount;
+        }
+    }
+    return instances;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+#include "../vk/buffer/VulkanVertexBuffer.hpp"
+
+#include "DrawList.hpp"
+
+#include <memory>
+#include <vector>
+
+/// Per frame in flight buffers of VkDrawIndexedIndirectCommand records and per-run draw counts.
+///
+/// Command i is batch i of the frame's draw list, the commands of a run are consecutive, so one
+/// drawIndexedIndirect(Count) call submits a whole run. Both buffers are storage buffers too, so a
+/// compute pass can write them instead of the CPU.
+class IndirectDrawBuffer
+{
+public:
+    static constexpr vk::DeviceSize COMMAND_STRIDE = sizeof(vk::DrawIndexedIndirectCommand);
+
+    explicit IndirectDrawBuffer(uint32_t frames_in_flight);
+
+    IndirectDrawBuffer(const IndirectDrawBuffer &) = delete;
+
+    IndirectDrawBuffer &operator=(const IndirectDrawBuffer &) = delete;
+
+    /// Grows the frame's buffers to the list, the frame's previous use has to be complete.
+    void reserve(uint32_t frame, uint32_t commands, uint32_t runs);
+
+    /// Writes one command per batch and every run's batch count from the CPU.
+    void update(uint32_t frame, const DrawList &list);
+
+    /// Sizes the frame's buffers for a compute pass writing the commands and zeroes the run counts it increments.
+    /// With several cull phases every phase gets its own copy of the commands and counts, one after another.
+    void clearCounts(uint32_t frame, const DrawList &list, uint32_t phases = 1);
+
+    [[nodiscard]] vk::Buffer getCommands(const uint32_t frame) const { return commands[frame]->get_handle(); }
+
+    [[nodiscard]] vk::Buffer getCounts(const uint32_t frame) const { return counts[frame]->get_handle(); }
+
+    /// Records the indirect draw call(s) of one run. Uses drawIndexedIndirectCount when the device has it,
+    /// else a multi-draw drawIndexedIndirect, else one drawIndexedIndirect per batch.
+    void draw(const vk::CommandBuffer &buffer, uint32_t frame, uint32_t run_index, const DrawRun &run, uint32_t phase = 0) const;
+
+    /// Draw calls draw() records for the run
+    [[nodiscard]] static uint32_t drawCalls(const DrawRun &run);
+
+    /// Instances the frame's commands of a phase draw, read back once the GPU finished the frame and made them visible
+    /// to the host. With a draw count only the commands it counts are read.
+    [[nodiscard]] uint32_t readInstanceCount(uint32_t frame, const DrawList &list, uint32_t phase = 0) const;
+
+private:
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> commands;
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> counts;
+
+    std::vector<uint32_t> command_capacities;
+    std::vector<uint32_t> count_capacities;
+
+    /// Commands and counts of one phase, the offset between phases
+    std::vector<uint32_t> phase_commands;
+    std::vector<uint32_t> phase_counts;
+};
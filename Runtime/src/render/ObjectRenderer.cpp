@@ -1,7 +1,15 @@
 #include "ObjectRenderer.hpp"
 
+#include "../jobs/JobSystem.hpp"
+#include "../profiler/CpuProfiler.hpp"
+#include "../profiler/GpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
 ObjectRenderer::ObjectRenderer()
 {
+    indirect_draws = std::make_unique<IndirectDrawBuffer>(context->frames_in_flight);
 }
 
 ObjectRenderer::~ObjectRenderer()
@@ -13,18 +21,432 @@ ObjectRenderer::~ObjectRenderer()
     objects.clear();
 }
 
-void ObjectRenderer::addModel(std::unique_ptr<Vulkan_Mesh> &model)
+uint32_t ObjectRenderer::materialId(const VulkanImage *material)
+{
+    auto found = std::find(materials.begin(), materials.end(), material);
+    if (found == materials.end())
+    {
+        found = materials.insert(materials.end(), material);
+    }
+    return static_cast<uint32_t>(found - materials.begin());
+}
+
+DrawPacket ObjectRenderer::makePacket(const uint32_t mesh, const uint32_t node)
+{
+    const MeshRange &range = meshes[mesh];
+
+    DrawPacket packet;
+    packet.pipeline = 0;
+    packet.material = this->materialId(objects[range.model]->getMaterial());
+    packet.mesh = mesh;
+    packet.buffer = range.model;
+    packet.first_index = range.first_index;
+    packet.index_count = range.index_count;
+    packet.vertex_offset = range.vertex_offset;
+    packet.object = node;
+    return packet;
+}
+
+uint32_t ObjectRenderer::addPacket(const DrawPacket &packet)
 {
+    packet_templates.push_back(packet);
+
+    const auto instance = static_cast<uint32_t>(packet_templates.size() - 1);
+    this->addCullInstance(instance, packet.object);
+    return instance;
+}
+
+uint32_t ObjectRenderer::addModel(std::unique_ptr<Vulkan_Mesh> &model, const uint32_t parent)
+{
+    model->node = scene.addNode(parent, model->position, glm::quat(glm::radians(model->rotation)), model->scale);
+    model->scene = &scene;
+
+    const auto model_index = static_cast<uint32_t>(objects.size());
+    const auto first_mesh = static_cast<uint32_t>(meshes.size());
+
+    const auto &submeshes = model->getSubmeshes();
+    for (const auto &submesh : submeshes)
+    {
+        meshes.push_back({model_index, submesh.first_index, submesh.index_count, submesh.vertex_offset});
+        mesh_bounds.push_back(submesh.bounds);
+    }
+
+    const uint32_t node = model->node;
     objects.push_back(std::move(model));
+
+    for (uint32_t mesh = first_mesh; mesh < meshes.size(); mesh++)
+    {
+        // Submeshes are culled and picked on their own, so each needs its own object
+        const uint32_t object = submeshes.size() == 1 ? node : scene.addNode(node, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+        this->addPacket(this->makePacket(mesh, object));
+    }
+    return first_mesh;
+}
+
+uint32_t ObjectRenderer::addInstance(const uint32_t mesh, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale, const uint32_t parent)
+{
+    return this->addPacket(this->makePacket(mesh, scene.addNode(parent, position, rotation, scale)));
+}
+
+void ObjectRenderer::addCullInstance(const uint32_t instance, const uint32_t node)
+{
+    culler.resize(packet_templates.size());
+    visible.resize(packet_templates.size(), 1);
+    bvh_stale = true;
+
+    if (node >= node_instances.size())
+    {
+        node_instances.resize(node + 1, NO_INSTANCE);
+    }
+    node_instances[node] = instance;
+}
+
+void ObjectRenderer::updateBounds()
+{
+    for (const uint32_t node : scene.changed())
+    {
+        const uint32_t instance = node < node_instances.size() ? node_instances[node] : NO_INSTANCE;
+        if (instance != NO_INSTANCE)
+        {
+            const MeshBounds &bounds = mesh_bounds[packet_templates[instance].mesh];
+            culler.setBounds(instance, scene.world(node), bounds.min, bounds.max);
+            bvh_moved = true;
+        }
+    }
+}
+
+void ObjectRenderer::updateBvh()
+{
+    if (!bvh_stale && !bvh_moved)
+    {
+        return;
+    }
+
+    instance_boxes.resize(culler.size());
+    for (uint32_t i = 0; i < instance_boxes.size(); i++)
+    {
+        instance_boxes[i] = culler.getBounds(i);
+    }
+
+    // Refitting keeps the tree, which fits worse the farther objects move from where it was built
+    if (bvh_stale)
+    {
+        bvh.build(instance_boxes);
+    }
+    else
+    {
+        bvh.refit(instance_boxes);
+    }
+
+    bvh_stale = false;
+    bvh_moved = false;
+}
+
+uint32_t ObjectRenderer::pick(const glm::vec3 &origin, const glm::vec3 &direction, float &distance)
+{
+    this->updateBvh();
+    return bvh.raycast(origin, direction, distance);
+}
+
+void ObjectRenderer::queryRegion(const Aabb &region, std::vector<uint32_t> &instances)
+{
+    this->updateBvh();
+    bvh.query(region, instances);
+}
+
+void ObjectRenderer::setInstanceMesh(const uint32_t instance, const uint32_t mesh)
+{
+    // Keeps the instance's own pipeline and material
+    DrawPacket &packet = packet_templates[instance];
+    DrawPacket moved = this->makePacket(mesh, packet.object);
+    moved.pipeline = packet.pipeline;
+    moved.material = packet.material;
+    packet = moved;
+
+    const MeshBounds &bounds = mesh_bounds[mesh];
+    culler.setBounds(instance, scene.world(packet.object), bounds.min, bounds.max);
+    bvh_moved = true;
+}
+
+void ObjectRenderer::setInstanceMaterial(const uint32_t instance, const VulkanImage *material)
+{
+    packet_templates[instance].material = this->materialId(material);
+}
+
+void ObjectRenderer::setPipeline(const uint32_t id, const vk::Pipeline pipeline)
+{
+    if (id >= pipelines.size())
+    {
+        pipelines.resize(id + 1);
+    }
+    pipelines[id] = pipeline;
+}
+
+void ObjectRenderer::prepareFrame(std::unique_ptr<Vulkan_3D_Unifrom> &uniform)
+{
+    scene.update();
+
+    // Does nothing once every frame's copy of the object buffer caught up, static objects cost nothing
+    uniform->reserveObjects(scene.size());
+    uniform->updateObjects(scene.worldMatrices(), scene.normalMatrices(), scene.changed());
+
+    frame = context->frame_index;
+
+    this->updateBounds();
+
+    cull_frustum = Frustum::fromMatrix(uniform->camera_ubo.projection * uniform->camera_ubo.view);
+    this->buildDrawList(glm::vec3(uniform->camera_ubo.view_pos), cull_frustum);
+
+    if (this->isGpuCulling())
+    {
+        // The cull pass writes the instances and commands, the CPU only sizes the buffers
+        const uint32_t phases = gpu_culling->getPhaseCount();
+        uniform->reserveInstances(draw_list.size() * phases);
+        gpu_culling->update(frame, draw_list, mesh_bounds, scene.size());
+        indirect_draws->clearCounts(frame, draw_list, phases);
+        return;
+    }
+
+    uniform->updateInstances(instance_objects);
+
+    if (this->isIndirect())
+    {
+        indirect_draws->update(frame, draw_list);
+    }
 }
 
-void ObjectRenderer::render(const vk::CommandBuffer &buffer, std::unique_ptr<Vulkan_3D_Unifrom> &uniform)
+void ObjectRenderer::setGpuCulling(const bool enable)
 {
-    for (size_t i = 0; i < objects.size(); i++)
+    if (!enable || !context->cull_pipeline)
     {
-        const auto &model = objects[i];
-        uniform->updateTransMatrix(model, i);
-        model->bind(buffer, i);
-        model->draw(buffer);
+        gpu_culling.reset();
+        return;
     }
-}
\ No newline at end of file
+
+    if (!gpu_culling)
+    {
+        gpu_culling = std::make_unique<GpuCulling>(context->frames_in_flight);
+    }
+}
+
+void ObjectRenderer::setOcclusionCulling(const HiZPyramid *pyramid)
+{
+    if (gpu_culling)
+    {
+        gpu_culling->setOcclusion(pyramid);
+    }
+}
+
+void ObjectRenderer::cull(const vk::CommandBuffer &buffer, const std::unique_ptr<Vulkan_3D_Unifrom> &uniform, const uint32_t phase) const
+{
+    if (!this->isGpuCulling())
+    {
+        return;
+    }
+
+    gpu_culling->record(buffer, frame, phase, cull_frustum, uniform->object_buffers[frame]->get_handle(), uniform->instance_buffers[frame]->get_handle(),
+                        uniform->camera_buffers[frame]->get_handle(), *indirect_draws);
+
+    if (cull_readback)
+    {
+        const vk::MemoryBarrier host_read(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+        buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, host_read, nullptr, nullptr);
+    }
+}
+
+bool ObjectRenderer::verifyGpuCulling()
+{
+    if (!this->isGpuCulling() || this->isOcclusionCulling() || !cull_readback)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Verifying GPU culling needs frustum-only GPU culling and a cull readback request");
+        return false;
+    }
+
+    context->device.waitIdle();
+    cull_readback = false;
+
+    const uint32_t gpu_visible = indirect_draws->readInstanceCount(frame, draw_list);
+
+    // The shader's test: the local bounding sphere moved by the world matrix, grown with its largest axis scale
+    const glm::mat4 *world = scene.worldMatrices();
+    uint32_t cpu_visible = 0;
+    for (const auto &packet : packet_templates)
+    {
+        const glm::mat4 &model = world[packet.object];
+        const glm::vec4 &sphere = mesh_bounds[packet.mesh].sphere;
+
+        const glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+        const float scale = std::sqrt(std::max({glm::dot(glm::vec3(model[0]), glm::vec3(model[0])), glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                                glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))}));
+        if (cull_frustum.intersectsSphere(center, sphere.w * scale))
+        {
+            cpu_visible++;
+        }
+    }
+
+    // Boxes and spheres may disagree on objects at the frustum's edge, so this one is only reported
+    culler.cull(cull_frustum, visible.data(), JobSystem::get());
+    const auto box_visible = static_cast<uint32_t>(std::count(visible.begin(), visible.end(), static_cast<uint8_t>(1)));
+
+    SDL_Log("GPU culling: %u of %u instances visible, %u on the CPU with the same spheres, %u with the FrustumCuller's boxes", gpu_visible,
+            static_cast<uint32_t>(packet_templates.size()), cpu_visible, box_visible);
+
+    if (gpu_visible != cpu_visible)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_RENDER, "GPU culling disagrees with the CPU by %d instances", static_cast<int>(gpu_visible) - static_cast<int>(cpu_visible));
+        return false;
+    }
+    return true;
+}
+
+void ObjectRenderer::buildDrawList(const glm::vec3 &view_pos, const Frustum &frustum)
+{
+    VENT_PROFILE_ZONE("Build draw list");
+
+    const bool culling = this->isFrustumCulling();
+    const bool bvh_culled = this->isBvhCulling();
+    if (bvh_culled)
+    {
+        this->updateBvh();
+        visible_instances.clear();
+        bvh.cull(frustum, visible_instances);
+    }
+    else if (culling)
+    {
+        culler.cull(frustum, visible.data(), JobSystem::get());
+    }
+
+    draw_list.clear();
+    draw_list.reserve(packet_templates.size());
+
+    const glm::mat4 *world = scene.worldMatrices();
+    const auto add = [&](const uint32_t instance) {
+        DrawPacket packet = packet_templates[instance];
+        const glm::vec3 offset = glm::vec3(world[packet.object][3]) - view_pos;
+        packet.depth = glm::dot(offset, offset);
+        draw_list.add(packet);
+    };
+
+    // The tree hands out the visible instances directly, the scan flags them
+    if (bvh_culled)
+    {
+        for (const uint32_t instance : visible_instances)
+        {
+            add(instance);
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < packet_templates.size(); i++)
+        {
+            if (!culling || visible[i])
+            {
+                add(i);
+            }
+        }
+    }
+
+    draw_list.sort();
+    draw_list.batch(instancing);
+
+    // Sorted order, so the instances of a batch are consecutive entries starting at its first packet
+    instance_objects.clear();
+    for (const auto &packet : draw_list.getPackets())
+    {
+        instance_objects.push_back(packet.object);
+    }
+
+    bind_stats = draw_list.countBinds();
+    naive_bind_stats = draw_list.countNaiveBinds();
+
+    if (this->isIndirect())
+    {
+        bind_stats.draw_calls = 0;
+        for (const auto &run : draw_list.getRuns())
+        {
+            bind_stats.draw_calls += IndirectDrawBuffer::drawCalls(run);
+        }
+    }
+
+    cull_stats.objects = static_cast<uint32_t>(packet_templates.size());
+    cull_stats.visible = draw_list.size();
+
+    instancing_stats.objects = draw_list.size();
+    instancing_stats.draws = static_cast<uint32_t>(draw_list.getBatches().size());
+}
+
+void ObjectRenderer::record(const vk::CommandBuffer &buffer, const std::unique_ptr<Vulkan_3D_Unifrom> &uniform, const uint32_t begin, const uint32_t end,
+                            const uint32_t phase) const
+{
+    if (draw_list.empty())
+    {
+        return;
+    }
+
+    // Camera and object buffers are shared by every draw
+    uniform->bind(buffer);
+
+    const auto &packets = draw_list.getPackets();
+    const auto &batches = draw_list.getBatches();
+    const auto &runs = draw_list.getRuns();
+    const bool indirect = this->isIndirect();
+
+    uint32_t bound_pipeline = UINT32_MAX;
+    uint32_t bound_material = UINT32_MAX;
+    const Vulkan_Mesh *bound_mesh = nullptr;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        // Indirect submission goes by runs, which share all state, direct draws by batches
+        const uint32_t run_index = indirect ? i % static_cast<uint32_t>(runs.size()) : 0;
+        const DrawBatch &batch = indirect ? batches[runs[run_index].first_batch] : batches[i % batches.size()];
+        const DrawPacket &packet = packets[batch.first_packet];
+
+        if (packet.pipeline != bound_pipeline)
+        {
+            buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines[packet.pipeline]);
+            bound_pipeline = packet.pipeline;
+        }
+
+        const Vulkan_Mesh *mesh = objects[packet.buffer].get();
+
+        if (packet.material != bound_material)
+        {
+            if (materials[packet.material])
+            {
+                materials[packet.material]->bind(buffer);
+            }
+            bound_material = packet.material;
+        }
+
+        if (mesh != bound_mesh)
+        {
+            mesh->bind(buffer);
+            bound_mesh = mesh;
+        }
+
+        // Objects come from the instance buffer, the material is set 1
+        if (indirect)
+        {
+            indirect_draws->draw(buffer, frame, run_index, runs[run_index], phase);
+        }
+        else
+        {
+            buffer.drawIndexed(packet.index_count, batch.instance_count, packet.first_index, packet.vertex_offset, batch.first_packet);
+        }
+    }
+}
+
+void ObjectRenderer::render(const vk::CommandBuffer &buffer, std::unique_ptr<Vulkan_3D_Unifrom> &uniform, const uint32_t phase)
+{
+    VENT_PROFILE_ZONE("ObjectRenderer::render");
+
+    const uint32_t scope = context->gpu_profiler ? context->gpu_profiler->begin(buffer, "Object draws") : GpuProfiler::INVALID_SCOPE;
+
+    this->record(buffer, uniform, 0, this->drawCount(), phase);
+
+    if (context->gpu_profiler)
+    {
+        context->gpu_profiler->end(buffer, scope);
+    }
+}
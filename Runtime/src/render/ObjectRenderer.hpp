@@ -5,19 +5,253 @@
 #include "../vk/uniform/Vulkan_3D_Unifrom.hpp"
 #include "../vk/mesh/Vulkan_Mesh.hpp"
 
+#include "../objects/SceneGraph.hpp"
+
+#include "Bvh.hpp"
+#include "DrawList.hpp"
+#include "FrustumCuller.hpp"
+#include "GpuCulling.hpp"
+#include "IndirectDrawBuffer.hpp"
+
 #include <memory>
 #include <vector>
 
+/// Draws per frame before and after grouping repeated meshes into instanced draws
+struct InstancingStats
+{
+    uint32_t objects = 0;
+    uint32_t draws = 0;
+
+    [[nodiscard]] uint32_t saved() const { return objects - draws; }
+};
+
+/// Objects per frame before and after the CPU frustum test
+struct CullStats
+{
+    uint32_t objects = 0;
+    uint32_t visible = 0;
+
+    [[nodiscard]] uint32_t culled() const { return objects - visible; }
+};
+
 class ObjectRenderer
 {
 private:
+    /// The models added, their vertex and index buffers hold the meshes. A packet's buffer id indexes this.
     std::vector<std::unique_ptr<Vulkan_Mesh>> objects;
 
+    /// A submesh of a model, what a mesh id refers to
+    struct MeshRange
+    {
+        uint32_t model = 0;
+        uint32_t first_index = 0;
+        uint32_t index_count = 0;
+        int32_t vertex_offset = 0;
+    };
+
+    /// Every mesh id, the submeshes of a model have consecutive ids
+    std::vector<MeshRange> meshes;
+
+    /// Every object is a node, its node index is also its record in the object buffer
+    SceneGraph scene;
+
+    /// Pipelines packets can refer to, id 0 is the pass's main pipeline
+    std::vector<vk::Pipeline> pipelines;
+
+    /// Distinct materials, a packet's material id indexes this
+    std::vector<const VulkanImage *> materials;
+
+    /// The frame-invariant part of every instance's packet, an instance id indexes this
+    std::vector<DrawPacket> packet_templates;
+
+    DrawList draw_list;
+
+    /// Object index of every sorted packet, uploaded as the frame's instance buffer
+    std::vector<uint32_t> instance_objects;
+
+    bool instancing = true;
+
+    /// Frame in flight prepareFrame wrote the per-frame buffers of
+    uint32_t frame = 0;
+
+    std::unique_ptr<IndirectDrawBuffer> indirect_draws;
+
+    bool indirect_enabled = false;
+
+    /// Local bounds of every mesh id
+    std::vector<MeshBounds> mesh_bounds;
+
+    /// World space box of every instance id, refreshed for the nodes that moved
+    FrustumCuller culler;
+
+    /// Frustum test result of every instance id
+    std::vector<uint8_t> visible;
+
+    /// Instance id of every scene node, NO_INSTANCE for nodes that draw nothing
+    std::vector<uint32_t> node_instances;
+
+    bool frustum_culling = true;
+
+    /// Tree over the culler's boxes, rebuilt once instances were added and refit once some moved
+    Bvh bvh;
+    bool bvh_stale = true;
+    bool bvh_moved = false;
+
+    bool bvh_culling = false;
+
+    /// Scratch of the BVH build and refit, the culler's boxes by instance id
+    std::vector<Aabb> instance_boxes;
+
+    /// Instance ids the BVH found inside the frustum
+    std::vector<uint32_t> visible_instances;
+
+    /// Null until GPU culling is enabled
+    std::unique_ptr<GpuCulling> gpu_culling;
+
+    /// Frustum of the latest prepareFrame, what its cull pass tests against
+    Frustum cull_frustum;
+
+    /// Whether cull passes make their commands visible to the host, for verifyGpuCulling
+    bool cull_readback = false;
+
+    BindStats bind_stats;
+    BindStats naive_bind_stats;
+    InstancingStats instancing_stats;
+    CullStats cull_stats;
+
+    static constexpr uint32_t NO_INSTANCE = UINT32_MAX;
+
+    uint32_t materialId(const VulkanImage *material);
+
+    /// Packet drawing the mesh for the node with the main pipeline and the material of the mesh's model
+    DrawPacket makePacket(uint32_t mesh, uint32_t node);
+
+    /// Adds the packet as a new instance and returns its id.
+    uint32_t addPacket(const DrawPacket &packet);
+
+    /// Registers a new instance with the culler, its box is set once its node's world matrix exists.
+    void addCullInstance(uint32_t instance, uint32_t node);
+
+    /// Refreshes the world boxes of the instances whose node changed in the latest scene update.
+    void updateBounds();
+
+    /// Brings the BVH up to date with the culler's boxes.
+    void updateBvh();
+
+    void buildDrawList(const glm::vec3 &view_pos, const Frustum &frustum);
+
 public:
     ObjectRenderer();
     ~ObjectRenderer();
 
-    void addModel(std::unique_ptr<Vulkan_Mesh> &model);
+    /// Adds the model as a scene node below parent, SceneGraph::NO_PARENT for a root, and returns its first mesh id.
+    /// Every submesh of the model becomes a mesh, with consecutive ids, and an instance: on the model's node if it has
+    /// one submesh, else on a node each below it. Its texture has to be set already, the material is looked up once here.
+    uint32_t addModel(std::unique_ptr<Vulkan_Mesh> &model, uint32_t parent = SceneGraph::NO_PARENT);
+
+    /// Adds another object drawing the given mesh with its model's material and returns its instance id.
+    /// The model's own objects are the instances addModel made for it.
+    uint32_t addInstance(uint32_t mesh, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale,
+                         uint32_t parent = SceneGraph::NO_PARENT);
+
+    /// Moves an instance to another mesh or material, i.e. to another instanced draw from the next frame on.
+    void setInstanceMesh(uint32_t instance, uint32_t mesh);
+
+    void setInstanceMaterial(uint32_t instance, const VulkanImage *material);
+
+    /// Scene node of an instance, for SceneGraph::setLocal
+    [[nodiscard]] uint32_t getInstanceNode(const uint32_t instance) const { return packet_templates[instance].object; }
+
+    /// Mesh an instance draws, e.g. which submesh pick or queryRegion found
+    [[nodiscard]] uint32_t getInstanceMesh(const uint32_t instance) const { return packet_templates[instance].mesh; }
+
+    SceneGraph &getScene() { return scene; }
+
+    /// Groups objects sharing mesh and material into one instanced draw, on by default.
+    void setInstancing(const bool enable) { instancing = enable; }
+
+    [[nodiscard]] bool isInstancing() const { return instancing; }
+
+    /// Submits the draws with one indirect call per run of equal state. Needs drawIndirectFirstInstance,
+    /// without it the draws stay direct.
+    void setIndirect(const bool enable) { indirect_enabled = enable; }
+
+    [[nodiscard]] bool isIndirect() const { return indirect_enabled && context->draw_indirect_first_instance; }
+
+    /// Skips the instances outside the view frustum when building the draw list, on by default.
+    /// Tested with SIMD over the job system, ignored while GPU culling does the test instead.
+    void setFrustumCulling(const bool enable) { frustum_culling = enable; }
+
+    [[nodiscard]] bool isFrustumCulling() const { return frustum_culling && !this->isGpuCulling(); }
+
+    /// Frustum culls by walking the instance BVH instead of testing every instance, off by default. Pays off when
+    /// the frustum sees a small part of the scene, the SIMD scan is faster when it sees most of it.
+    void setBvhCulling(const bool enable) { bvh_culling = enable; }
+
+    [[nodiscard]] bool isBvhCulling() const { return bvh_culling && this->isFrustumCulling(); }
+
+    /// Instance whose world box the ray enters first within distance, Bvh::NO_HIT if none. distance returns the hit's.
+    /// Uses the transforms of the latest prepareFrame. The BVH holds an instance per submesh, so a hit on a model
+    /// loaded from a file names the part of it that was hit.
+    uint32_t pick(const glm::vec3 &origin, const glm::vec3 &direction, float &distance);
+
+    /// Appends every instance whose world box intersects region.
+    void queryRegion(const Aabb &region, std::vector<uint32_t> &instances);
+
+    /// Frustum culls the instances in a compute pass writing the indirect commands, needs indirect submission
+    /// and context->cull_pipeline.
+    void setGpuCulling(bool enable);
+
+    [[nodiscard]] bool isGpuCulling() const { return gpu_culling && this->isIndirect(); }
+
+    /// Adds the Hi-Z occlusion test to GPU culling, after setGpuCulling, null to go back to frustum culling only.
+    /// Frames are then culled and drawn in two phases, see GpuCulling.
+    void setOcclusionCulling(const HiZPyramid *pyramid);
+
+    [[nodiscard]] bool isOcclusionCulling() const { return this->isGpuCulling() && gpu_culling->getPhaseCount() > 1; }
+
+    /// Makes the commands of the cull passes from the next one on readable by the host, for verifyGpuCulling.
+    void requestCullReadback() { cull_readback = true; }
+
+    /// Waits for the device, then compares the instances the latest cull pass found visible with the same frustum test
+    /// on the CPU. Logs both, and the FrustumCuller's box test for reference, and returns whether they agree. Needs GPU
+    /// culling without occlusion culling and requestCullReadback before the frame.
+    bool verifyGpuCulling();
+
+    /// Sets the pipeline packets with the given id bind, e.g. to swap in a debug view.
+    void setPipeline(uint32_t id, vk::Pipeline pipeline);
+
+    /// Pushes changed transforms to the object buffer, builds, sorts and batches the frame's draw list and
+    /// uploads its instance buffer, once per frame before any draw is recorded.
+    void prepareFrame(std::unique_ptr<Vulkan_3D_Unifrom> &uniform);
+
+    /// With GPU culling, records the cull pass of the frame prepareFrame wrote. Outside a render pass, before the draws
+    /// of the same phase.
+    void cull(const vk::CommandBuffer &buffer, const std::unique_ptr<Vulkan_3D_Unifrom> &uniform, uint32_t phase = 0) const;
+
+    /// Entries record takes: runs with indirect submission, batches otherwise.
+    [[nodiscard]] uint32_t drawCount() const
+    {
+        return static_cast<uint32_t>(this->isIndirect() ? draw_list.getRuns().size() : draw_list.getBatches().size());
+    }
+
+    /// Binds the sorted list takes on one command buffer. Every further recording range adds its first draw's binds.
+    [[nodiscard]] const BindStats &getBindStats() const { return bind_stats; }
+
+    /// Binds the same list took when every draw rebound all of its state.
+    [[nodiscard]] const BindStats &getNaiveBindStats() const { return naive_bind_stats; }
+
+    [[nodiscard]] const InstancingStats &getInstancingStats() const { return instancing_stats; }
+
+    [[nodiscard]] const CullStats &getCullStats() const { return cull_stats; }
+
+    /// Records the runs or batches [begin, end) into buffer, binding the shared uniform first and skipping pipeline,
+    /// material and buffer binds that are already current. Indices past drawCount wrap around, which lets benchmarks
+    /// record arbitrarily long lists. Only reads, so threads may record disjoint ranges.
+    /// phase selects the commands of that cull phase with occlusion culling.
+    void record(const vk::CommandBuffer &buffer, const std::unique_ptr<Vulkan_3D_Unifrom> &uniform, uint32_t begin, uint32_t end,
+                uint32_t phase = 0) const;
 
-    void render(const vk::CommandBuffer &buffer, std::unique_ptr<Vulkan_3D_Unifrom> &uniform);
+    /// Records every draw on the calling thread, after prepareFrame.
+    void render(const vk::CommandBuffer &buffer, std::unique_ptr<Vulkan_3D_Unifrom> &uniform, uint32_t phase = 0);
 };
@@ -0,0 +1,101 @@
+#include "ParallelRecorder.hpp"
+
+#include "../jobs/JobSystem.hpp"
+#include "../profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+
+ParallelRecorder::ParallelRecorder(const uint32_t ranges, const uint32_t frames_in_flight)
+{
+    range_pools.resize(std::max(1u, ranges));
+    for (auto &pools : range_pools)
+    {
+        for (uint32_t i = 0; i < frames_in_flight; i++)
+        {
+            // Transient: the buffers are rerecorded every frame after a pool reset
+            pools.pools.push_back(context->device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, static_cast<uint32_t>(context->graphics_queue_index)}));
+        }
+        pools.buffers.resize(frames_in_flight);
+        pools.used.resize(frames_in_flight, 0);
+    }
+
+    recorded.resize(range_pools.size());
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+    for (auto &pools : range_pools)
+    {
+        for (auto &pool : pools.pools)
+        {
+            context->device.destroyCommandPool(pool);
+        }
+    }
+}
+
+void ParallelRecorder::beginFrame(const uint32_t frame_slot)
+{
+    slot = frame_slot;
+    for (auto &pools : range_pools)
+    {
+        context->device.resetCommandPool(pools.pools[slot]);
+        pools.used[slot] = 0;
+    }
+}
+
+vk::CommandBuffer ParallelRecorder::nextBuffer(const uint32_t range)
+{
+    RangePools &pools = range_pools[range];
+    auto &buffers = pools.buffers[slot];
+
+    if (pools.used[slot] == buffers.size())
+    {
+        const vk::CommandBufferAllocateInfo allocate_info(pools.pools[slot], vk::CommandBufferLevel::eSecondary, 1);
+        buffers.push_back(context->device.allocateCommandBuffers(allocate_info).front());
+    }
+
+    return buffers[pools.used[slot]++];
+}
+
+vk::CommandBuffer ParallelRecorder::beginSecondary(const vk::CommandBufferInheritanceInfo &inheritance)
+{
+    const vk::CommandBuffer cmd = nextBuffer(0);
+    cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritance});
+    return cmd;
+}
+
+void ParallelRecorder::recordRange(const uint32_t range, const uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance, const RecordFn &fn)
+{
+    VENT_PROFILE_ZONE("Record draws");
+
+    // Contiguous ranges keep the draw order, executing the secondaries in range order replays the serial list
+    const auto range_count = static_cast<uint32_t>(range_pools.size());
+    const auto begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * range / range_count);
+    const auto end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (range + 1) / range_count);
+
+    const vk::CommandBuffer cmd = nextBuffer(range);
+    cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritance});
+    if (begin < end)
+    {
+        fn(cmd, begin, end);
+    }
+    cmd.end();
+
+    recorded[range] = cmd;
+}
+
+const std::vector<vk::CommandBuffer> &ParallelRecorder::record(const vk::CommandBufferInheritanceInfo &inheritance, const uint32_t count, const RecordFn &fn)
+{
+    JobSystem &jobs = JobSystem::get();
+
+    JobCounter counter;
+    for (uint32_t range = 1; range < range_pools.size(); range++)
+    {
+        jobs.schedule([this, range, count, &inheritance, &fn] { this->recordRange(range, count, inheritance, fn); }, &counter);
+    }
+
+    this->recordRange(0, count, inheritance, fn);
+    jobs.wait(counter);
+
+    return recorded;
+}
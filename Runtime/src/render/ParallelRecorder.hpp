@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+
+#include <functional>
+#include <vector>
+
+/// Records a draw list as several jobs into secondary command buffers.
+///
+/// The list is split into a fixed number of ranges, recorded as jobs on the JobSystem. Every range owns one
+/// command pool per frame in flight, only the job recording that range touches it, so no pool is shared
+/// between threads and resetting a frame's pools is one call per range. The calling thread records the first range.
+class ParallelRecorder
+{
+public:
+    /// Records the draws [begin, end) into cmd, which already began with the render pass inherited.
+    using RecordFn = std::function<void(const vk::CommandBuffer &cmd, uint32_t begin, uint32_t end)>;
+
+    ParallelRecorder(uint32_t ranges, uint32_t frames_in_flight);
+    ~ParallelRecorder();
+
+    ParallelRecorder(const ParallelRecorder &) = delete;
+
+    ParallelRecorder &operator=(const ParallelRecorder &) = delete;
+
+    [[nodiscard]] uint32_t getRangeCount() const { return static_cast<uint32_t>(range_pools.size()); }
+
+    /// Resets the slot's pools, the frame that last used the slot has to be complete.
+    void beginFrame(uint32_t slot);
+
+    /// Splits [0, count) into contiguous ranges, records them as jobs and waits for all of them.
+    /// The secondaries are returned in draw order, ready for executeCommands.
+    const std::vector<vk::CommandBuffer> &record(const vk::CommandBufferInheritanceInfo &inheritance, uint32_t count, const RecordFn &fn);
+
+    /// Begins a secondary on the calling thread, for draws recorded after the parallel ones.
+    vk::CommandBuffer beginSecondary(const vk::CommandBufferInheritanceInfo &inheritance);
+
+private:
+    struct RangePools
+    {
+        /// One pool per frame in flight
+        std::vector<vk::CommandPool> pools;
+
+        /// Secondaries allocated from each pool, reused after the pool reset
+        std::vector<std::vector<vk::CommandBuffer>> buffers;
+        std::vector<uint32_t> used;
+    };
+
+    std::vector<RangePools> range_pools;
+
+    uint32_t slot = 0;
+
+    std::vector<vk::CommandBuffer> recorded;
+
+    void recordRange(uint32_t range, uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance, const RecordFn &fn);
+
+    vk::CommandBuffer nextBuffer(uint32_t range);
+};
@@ -0,0 +1,580 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+static const vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eColorAttachmentWrite |
+                                             vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite |
+                                             vk::AccessFlagBits2::eMemoryWrite;
+
+bool RenderGraph::Usage::writes() const
+{
+    return static_cast<bool>(access & WRITE_ACCESS);
+}
+
+RenderGraph::Usage RenderGraph::Usage::colorAttachment(const vk::ImageLayout initial, const vk::ImageLayout final)
+{
+    return {vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite, initial, final};
+}
+
+RenderGraph::Usage RenderGraph::Usage::depthAttachment(const vk::ImageLayout initial, const vk::ImageLayout final)
+{
+    return {vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+            vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite, initial, final};
+}
+
+RenderGraph::Usage RenderGraph::Usage::sampled(const vk::PipelineStageFlags2 stages, const vk::ImageLayout layout)
+{
+    return {stages, vk::AccessFlagBits2::eShaderSampledRead, layout};
+}
+
+RenderGraph::Usage RenderGraph::Usage::storageRead(const vk::PipelineStageFlags2 stages)
+{
+    return {stages, vk::AccessFlagBits2::eShaderStorageRead, vk::ImageLayout::eGeneral};
+}
+
+RenderGraph::Usage RenderGraph::Usage::storageWrite(const vk::PipelineStageFlags2 stages)
+{
+    return {stages, vk::AccessFlagBits2::eShaderStorageWrite, vk::ImageLayout::eGeneral};
+}
+
+RenderGraph::Usage RenderGraph::Usage::storageReadWrite(const vk::PipelineStageFlags2 stages)
+{
+    return {stages, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite, vk::ImageLayout::eGeneral};
+}
+
+RenderGraph::Usage RenderGraph::Usage::indirectRead()
+{
+    return {vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead};
+}
+
+RenderGraph::Usage RenderGraph::Usage::transferRead()
+{
+    return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal};
+}
+
+RenderGraph::Usage RenderGraph::Usage::transferWrite()
+{
+    return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal};
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::read(const Resource resource, const Usage &usage)
+{
+    graph.add_access(pass, resource, AccessKind::Read, usage);
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::write(const Resource resource, const Usage &usage)
+{
+    graph.add_access(pass, resource, AccessKind::Write, usage);
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::overwrite(const Resource resource, const Usage &usage)
+{
+    graph.add_access(pass, resource, AccessKind::Overwrite, usage);
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::sideEffect()
+{
+    graph.passes[pass].side_effect = true;
+    return *this;
+}
+
+RenderGraph::~RenderGraph()
+{
+    this->clear();
+}
+
+RenderGraph::Resource RenderGraph::importImage(const std::string &name, const vk::ImageAspectFlags aspect, const uint32_t levels, const vk::ImageLayout layout)
+{
+    ResourceInfo resource;
+    resource.name = name;
+    resource.aspect = aspect;
+    resource.levels = levels;
+    resource.layout = layout;
+    resources.push_back(resource);
+    compiled = false;
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string &name, const bool per_frame)
+{
+    ResourceInfo resource;
+    resource.name = name;
+    resource.buffer = true;
+    resource.per_frame = per_frame;
+    resources.push_back(resource);
+    compiled = false;
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createImage(const std::string &name, const ImageDesc &desc)
+{
+    ResourceInfo resource;
+    resource.name = name;
+    resource.transient = true;
+    resource.aspect = desc.aspect;
+    resource.levels = desc.levels;
+    resource.desc = desc;
+    resources.push_back(resource);
+    compiled = false;
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+void RenderGraph::setImage(const Resource resource, const vk::Image image)
+{
+    resources[resource].image = image;
+}
+
+void RenderGraph::markOutput(const Resource resource)
+{
+    resources[resource].output = true;
+    compiled = false;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const std::string &name, Execute execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+    compiled = false;
+    return {*this, static_cast<uint32_t>(passes.size() - 1)};
+}
+
+void RenderGraph::add_access(const uint32_t pass, const Resource resource, const AccessKind kind, const Usage &usage)
+{
+    auto &accesses = passes[pass].accesses;
+    const auto existing = std::find_if(accesses.begin(), accesses.end(), [resource](const Access &access) { return access.resource == resource; });
+    if (existing == accesses.end())
+    {
+        accesses.push_back({resource, kind, usage});
+        return;
+    }
+
+    // One barrier covers both accesses, an image can only be in one layout for the pass
+    if (!resources[resource].buffer && existing->usage.layout != usage.layout)
+    {
+        throw std::runtime_error("Render graph pass " + passes[pass].name + " uses " + resources[resource].name + " in two layouts");
+    }
+
+    existing->usage.stages |= usage.stages;
+    existing->usage.access |= usage.access;
+    if (usage.final_layout != vk::ImageLayout::eUndefined)
+    {
+        existing->usage.final_layout = usage.final_layout;
+    }
+    // Overwriting and then reading its own results still drops what was there before
+    existing->kind = std::max(existing->kind, kind);
+}
+
+void RenderGraph::cull_passes()
+{
+    // Walking back from the outputs, a pass is needed if a needed pass reads what it writes
+    std::vector<uint8_t> live(resources.size());
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        live[i] = resources[i].output;
+    }
+
+    for (size_t i = passes.size(); i-- > 0;)
+    {
+        Pass &pass = passes[i];
+
+        bool needed = pass.side_effect;
+        for (const Access &access : pass.accesses)
+        {
+            needed |= access.kind != AccessKind::Read && live[access.resource];
+        }
+
+        pass.culled = !needed;
+        if (!needed)
+        {
+            continue;
+        }
+
+        // What an overwrite replaces is dead before it, what the pass reads is needed
+        for (const Access &access : pass.accesses)
+        {
+            live[access.resource] = access.kind != AccessKind::Overwrite;
+        }
+    }
+}
+
+void RenderGraph::compile()
+{
+    this->destroy_transients();
+    this->cull_passes();
+
+    stats = {};
+    for (auto &resource : resources)
+    {
+        resource.first_pass = UINT32_MAX;
+        resource.last_pass = 0;
+    }
+
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        stats.passes++;
+        if (passes[i].culled)
+        {
+            stats.culled_passes++;
+            continue;
+        }
+
+        for (const Access &access : passes[i].accesses)
+        {
+            ResourceInfo &resource = resources[access.resource];
+            if (resource.transient && resource.first_pass == UINT32_MAX && access.kind != AccessKind::Overwrite)
+            {
+                throw std::runtime_error("Render graph pass " + passes[i].name + " reads " + resource.name + " before any pass wrote it");
+            }
+
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass = i;
+        }
+    }
+
+    this->create_transients();
+
+    states.assign(resources.size(), State());
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        states[i].layout = resources[i].layout;
+    }
+    frame_used.assign(resources.size(), 0);
+
+    // The first frame waits on nothing, count the barriers of the ones after it
+    std::vector<State> simulated = states;
+    std::vector<uint8_t> used(resources.size());
+    for (int frame = 0; frame < 2; frame++)
+    {
+        this->begin_frame(simulated, used);
+        for (const Pass &pass : passes)
+        {
+            if (pass.culled)
+            {
+                continue;
+            }
+
+            Barriers counted;
+            this->transition(pass, simulated, used, counted);
+            if (frame == 1)
+            {
+                stats.memory_barriers += static_cast<uint32_t>(counted.memory.size());
+                stats.image_barriers += static_cast<uint32_t>(counted.images.size());
+                stats.aliasing_barriers += counted.aliasing_barriers;
+
+                // Every image sharing the memory was used the frame before, so it has accesses to wait for
+                if (counted.aliasing_barriers != counted.aliased_uses)
+                {
+                    throw std::runtime_error("Render graph pass " + pass.name + " reuses transient memory without waiting for its previous images");
+                }
+            }
+        }
+    }
+
+    compiled = true;
+
+    SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Render graph: %u passes (%u culled), %u memory and %u image barriers per frame (%u for aliasing), %u transient images in %u allocations: %.1f MiB (%.1f MiB without aliasing)",
+                 stats.passes, stats.culled_passes, stats.memory_barriers, stats.image_barriers, stats.aliasing_barriers, stats.transient_images, stats.allocations,
+                 static_cast<double>(stats.transient_bytes) / (1024.0 * 1024.0), static_cast<double>(stats.unaliased_bytes) / (1024.0 * 1024.0));
+}
+
+void RenderGraph::create_transients()
+{
+    std::vector<Resource> order;
+    for (Resource i = 0; i < resources.size(); i++)
+    {
+        if (resources[i].transient && resources[i].first_pass != UINT32_MAX)
+        {
+            order.push_back(i);
+        }
+    }
+
+    // Placed by first use, each into the first slot whose images are all dead by then or not yet alive
+    std::sort(order.begin(), order.end(), [this](const Resource a, const Resource b) { return resources[a].first_pass < resources[b].first_pass; });
+
+    for (const Resource i : order)
+    {
+        ResourceInfo &resource = resources[i];
+
+        vk::ImageCreateInfo image_info;
+        image_info.imageType = vk::ImageType::e2D;
+        image_info.format = resource.desc.format;
+        image_info.extent = vk::Extent3D(resource.desc.extent, 1);
+        image_info.mipLevels = resource.desc.levels;
+        image_info.arrayLayers = 1;
+        image_info.samples = vk::SampleCountFlagBits::e1;
+        image_info.tiling = vk::ImageTiling::eOptimal;
+        image_info.usage = resource.desc.usage;
+        image_info.initialLayout = vk::ImageLayout::eUndefined;
+        resource.image = context->device.createImage(image_info);
+
+        const vk::MemoryRequirements requirements = context->device.getImageMemoryRequirements(resource.image);
+        stats.transient_images++;
+        stats.unaliased_bytes += requirements.size;
+
+        uint32_t slot = 0;
+        for (; slot < slots.size(); slot++)
+        {
+            const MemorySlot &candidate = slots[slot];
+            if (!(candidate.requirements.memoryTypeBits & requirements.memoryTypeBits))
+            {
+                continue;
+            }
+
+            const bool disjoint = std::all_of(candidate.resources.begin(), candidate.resources.end(), [&](const Resource other) {
+                return resources[other].last_pass < resource.first_pass || resources[other].first_pass > resource.last_pass;
+            });
+            if (disjoint)
+            {
+                break;
+            }
+        }
+
+        if (slot == slots.size())
+        {
+            slots.emplace_back();
+            slots.back().requirements = requirements;
+        }
+
+        MemorySlot &target = slots[slot];
+        target.requirements.size = std::max(target.requirements.size, requirements.size);
+        target.requirements.alignment = std::max(target.requirements.alignment, requirements.alignment);
+        target.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        target.resources.push_back(i);
+        resource.slot = slot;
+    }
+
+    VmaAllocationCreateInfo allocation_info = {};
+    allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    for (MemorySlot &slot : slots)
+    {
+        const VkMemoryRequirements requirements = slot.requirements;
+        vkAssert(static_cast<vk::Result>(vmaAllocateMemory(context->memory_allocator, &requirements, &allocation_info, &slot.allocation, nullptr)),
+                 "Failed to allocate render graph memory");
+        stats.allocations++;
+        stats.transient_bytes += slot.requirements.size;
+
+        for (const Resource i : slot.resources)
+        {
+            ResourceInfo &resource = resources[i];
+            vkAssert(static_cast<vk::Result>(vmaBindImageMemory(context->memory_allocator, slot.allocation, static_cast<VkImage>(resource.image))),
+                     "Failed to bind render graph memory");
+
+            const vk::ImageViewCreateInfo view_info({}, resource.image, vk::ImageViewType::e2D, resource.desc.format, {},
+                                                   {resource.desc.aspect, 0, resource.desc.levels, 0, 1});
+            resource.view = context->device.createImageView(view_info);
+        }
+    }
+}
+
+void RenderGraph::destroy_transients()
+{
+    std::vector<vk::Image> images;
+    std::vector<vk::ImageView> views;
+    for (auto &resource : resources)
+    {
+        if (resource.transient && resource.image)
+        {
+            images.push_back(resource.image);
+            views.push_back(resource.view);
+            resource.image = nullptr;
+            resource.view = nullptr;
+        }
+        resource.slot = NO_SLOT;
+    }
+
+    std::vector<VmaAllocation> allocations;
+    for (const auto &slot : slots)
+    {
+        allocations.push_back(slot.allocation);
+    }
+    slots.clear();
+
+    if (images.empty())
+    {
+        return;
+    }
+
+    retire_resource([images = std::move(images), views = std::move(views), allocations = std::move(allocations)]() {
+        for (const auto &view : views)
+        {
+            context->device.destroyImageView(view);
+        }
+        for (const auto &image : images)
+        {
+            context->device.destroyImage(image);
+        }
+        for (const auto &allocation : allocations)
+        {
+            vmaFreeMemory(context->memory_allocator, allocation);
+        }
+    });
+}
+
+void RenderGraph::clear()
+{
+    this->destroy_transients();
+    passes.clear();
+    resources.clear();
+    states.clear();
+    frame_used.clear();
+    stats = {};
+    compiled = false;
+}
+
+void RenderGraph::begin_frame(std::vector<State> &frame_states, std::vector<uint8_t> &used) const
+{
+    std::fill(used.begin(), used.end(), 0);
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        if (resources[i].per_frame)
+        {
+            frame_states[i] = State();
+        }
+    }
+}
+
+void RenderGraph::transition(const Pass &pass, std::vector<State> &pass_states, std::vector<uint8_t> &used, Barriers &out) const
+{
+    for (const Access &access : pass.accesses)
+    {
+        const ResourceInfo &resource = resources[access.resource];
+        const Usage &usage = access.usage;
+        State &state = pass_states[access.resource];
+
+        bool discard = access.kind == AccessKind::Overwrite;
+        bool aliased = false;
+        if (resource.transient && !used[access.resource])
+        {
+            // Another image may have used the memory since, it has to be done with it. In this frame or, for the images
+            // placed after this one, in the last.
+            discard = true;
+            for (const Resource other : slots[resource.slot].resources)
+            {
+                if (other != access.resource)
+                {
+                    state.write_stages |= pass_states[other].write_stages | pass_states[other].read_stages;
+                    state.write_access |= pass_states[other].write_access;
+                    aliased = true;
+                }
+            }
+        }
+        used[access.resource] = 1;
+
+        // Aliased memory holds no valid layout, even if this image's last one matches
+        const bool image = !resource.buffer;
+        const bool layout_change = image && usage.layout != vk::ImageLayout::eUndefined && (usage.layout != state.layout || aliased);
+
+        const size_t barrier_count = out.memory.size() + out.images.size();
+
+        if (usage.writes() || layout_change)
+        {
+            // Everything since the last write has to be done, the last write visible
+            const vk::PipelineStageFlags2 src_stages = state.write_stages | state.read_stages;
+            if (layout_change)
+            {
+                out.images.emplace_back(src_stages, state.write_access, usage.stages, usage.access, discard ? vk::ImageLayout::eUndefined : state.layout, usage.layout,
+                                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, resource.image, vk::ImageSubresourceRange(resource.aspect, 0, resource.levels, 0, 1));
+            }
+            else if (src_stages)
+            {
+                out.memory.emplace_back(src_stages, state.write_access, usage.stages, usage.access);
+            }
+
+            if (usage.writes())
+            {
+                state.write_stages = usage.stages;
+                state.write_access = usage.access & WRITE_ACCESS;
+                state.read_stages = {};
+                state.visible_stages = {};
+                state.visible_access = {};
+            }
+            else
+            {
+                // The transition is the write, the barrier made it visible to this pass
+                state.write_stages = usage.stages;
+                state.write_access = {};
+                state.read_stages = usage.stages;
+                state.visible_stages = usage.stages;
+                state.visible_access = usage.access;
+            }
+        }
+        else
+        {
+            // Reads after reads don't wait on each other, only the last write has to be visible to them
+            if (state.write_stages && ((usage.stages & ~state.visible_stages) || (usage.access & ~state.visible_access)))
+            {
+                out.memory.emplace_back(state.write_stages, state.write_access, usage.stages, usage.access);
+                state.visible_stages |= usage.stages;
+                state.visible_access |= usage.access;
+            }
+            state.read_stages |= usage.stages;
+        }
+
+        if (aliased)
+        {
+            out.aliased_uses++;
+            if (out.memory.size() + out.images.size() > barrier_count)
+            {
+                out.aliasing_barriers++;
+            }
+        }
+
+        if (image)
+        {
+            if (usage.layout != vk::ImageLayout::eUndefined)
+            {
+                state.layout = usage.layout;
+            }
+            if (usage.final_layout != vk::ImageLayout::eUndefined)
+            {
+                state.layout = usage.final_layout;
+            }
+        }
+    }
+}
+
+void RenderGraph::execute(const vk::CommandBuffer &cmd)
+{
+    if (!compiled)
+    {
+        throw std::runtime_error("Render graph executed without compiling it");
+    }
+
+    this->begin_frame(states, frame_used);
+
+    for (const Pass &pass : passes)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        barriers.clear();
+        this->transition(pass, states, frame_used, barriers);
+
+        for (const auto &barrier : barriers.images)
+        {
+            if (!barrier.image)
+            {
+                throw std::runtime_error("Render graph pass " + pass.name + " changes the layout of an image it has no handle for");
+            }
+        }
+
+        if (!barriers.memory.empty() || !barriers.images.empty())
+        {
+            vk::DependencyInfo dependency;
+            dependency.setMemoryBarriers(barriers.memory);
+            dependency.setImageMemoryBarriers(barriers.images);
+            cmd.pipelineBarrier2(dependency);
+        }
+
+        pass.execute(cmd);
+    }
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "../vk/Vulkan_Base.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Declarative frame graph: passes say which images and buffers they read and write, the graph derives the rest.
+///
+/// compile() drops the passes nothing depends on, works out when each transient image is alive and lets transients
+/// whose lifetimes don't overlap share one allocation. execute() records the passes in declaration order, each
+/// behind the synchronization2 barriers its accesses need: write after write, write after read and layout changes
+/// wait for every earlier access, reads wait for the last write once per stage. Buffers get global memory barriers,
+/// so passes only name them; images changing layout get image barriers.
+///
+/// Built once and compiled again when its images change size. Resource state carries over from one execute to the
+/// next, so the first pass of a frame waits on the last frame's accesses the same way. Buffers imported per frame
+/// start every execute without state instead, see importBuffer.
+class RenderGraph
+{
+public:
+    using Resource = uint32_t;
+
+    static constexpr Resource INVALID_RESOURCE = UINT32_MAX;
+
+    /// How a pass accesses a resource
+    struct Usage
+    {
+        vk::PipelineStageFlags2 stages;
+        vk::AccessFlags2 access;
+
+        /// Layout an image has to be in when the pass starts. eUndefined if the pass doesn't care, like a render pass
+        /// with an eUndefined initial layout.
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+
+        /// Layout a render pass leaves the image in, eUndefined if it stays in layout. The render pass has to make
+        /// its own final transition visible with an external dependency.
+        vk::ImageLayout final_layout = vk::ImageLayout::eUndefined;
+
+        [[nodiscard]] bool writes() const;
+
+        /// Attachment of a render pass going from initial to final layout, loaded and stored
+        static Usage colorAttachment(vk::ImageLayout initial, vk::ImageLayout final);
+        static Usage depthAttachment(vk::ImageLayout initial, vk::ImageLayout final);
+
+        static Usage sampled(vk::PipelineStageFlags2 stages, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        /// Storage buffers, or storage images in eGeneral
+        static Usage storageRead(vk::PipelineStageFlags2 stages);
+        static Usage storageWrite(vk::PipelineStageFlags2 stages);
+        static Usage storageReadWrite(vk::PipelineStageFlags2 stages);
+
+        /// Indirect commands and draw counts
+        static Usage indirectRead();
+
+        static Usage transferRead();
+        static Usage transferWrite();
+    };
+
+    struct ImageDesc
+    {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        uint32_t levels = 1;
+        vk::ImageUsageFlags usage;
+        vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+    };
+
+    /// Declares the accesses of the pass addPass returned, in any order.
+    class PassBuilder
+    {
+    public:
+        PassBuilder(RenderGraph &graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+        /// Reads the contents earlier passes left
+        PassBuilder &read(Resource resource, const Usage &usage);
+
+        /// Reads and modifies the contents, like an attachment that is loaded and stored
+        PassBuilder &write(Resource resource, const Usage &usage);
+
+        /// Replaces the contents without reading them, like a cleared attachment. Ends the lifetime of what was there,
+        /// the passes that only produced it for this one can be culled.
+        PassBuilder &overwrite(Resource resource, const Usage &usage);
+
+        /// Keeps the pass even if nothing reads what it writes
+        PassBuilder &sideEffect();
+
+    private:
+        RenderGraph &graph;
+        uint32_t pass;
+    };
+
+    /// Records the pass, outside of a render pass. The last pass may leave its render pass open for the caller.
+    using Execute = std::function<void(const vk::CommandBuffer &)>;
+
+    struct Stats
+    {
+        uint32_t passes = 0;
+        uint32_t culled_passes = 0;
+
+        /// Per frame, once the graph runs every frame
+        uint32_t memory_barriers = 0;
+        uint32_t image_barriers = 0;
+
+        /// Of those, the ones making a transient wait for the images it shares memory with
+        uint32_t aliasing_barriers = 0;
+
+        uint32_t transient_images = 0;
+        uint32_t allocations = 0;
+
+        /// Memory of the transient images, and what it would be without aliasing
+        vk::DeviceSize transient_bytes = 0;
+        vk::DeviceSize unaliased_bytes = 0;
+    };
+
+    RenderGraph() = default;
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph &) = delete;
+
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    /// An image owned outside the graph in layout. Barriers changing its layout need the handle, see setImage.
+    Resource importImage(const std::string &name, vk::ImageAspectFlags aspect, uint32_t levels = 1, vk::ImageLayout layout = vk::ImageLayout::eUndefined);
+
+    /// A buffer owned outside the graph. Only its accesses matter, barriers on buffers are global.
+    ///
+    /// per_frame is for buffers with one copy per frame in flight: every execute uses the copy of its frame, whose last
+    /// use the CPU waited for before rewriting it. Their accesses aren't carried over to the next execute, which would
+    /// make its first pass wait on the previous frame's copy.
+    Resource importBuffer(const std::string &name, bool per_frame = false);
+
+    /// An image the graph creates on compile. Its contents don't survive the frame: the first pass using it in a frame
+    /// has to overwrite it, and images alive at different times may share memory.
+    Resource createImage(const std::string &name, const ImageDesc &desc);
+
+    /// Points an imported image at the image behind it, e.g. the swapchain image of this frame.
+    void setImage(Resource resource, vk::Image image);
+
+    /// What the resource holds after the graph is used outside of it or by the next frame, its producers are kept.
+    void markOutput(Resource resource);
+
+    PassBuilder addPass(const std::string &name, Execute execute);
+
+    /// Culls, creates and places the transient images, and checks the accesses. Expects the GPU to be done with the
+    /// transients of a previous compile, e.g. after a device wait idle. Throws if a transient would reuse the memory of
+    /// another without waiting for it in a frame following another one.
+    void compile();
+
+    void execute(const vk::CommandBuffer &cmd);
+
+    /// Drops the passes and resources, the transient images go once the frames in flight are done with them.
+    void clear();
+
+    [[nodiscard]] bool isCompiled() const { return compiled; }
+
+    [[nodiscard]] bool isCulled(uint32_t pass) const { return passes[pass].culled; }
+
+    /// Transient images exist after compile, null if every pass using them was culled
+    [[nodiscard]] vk::Image getImage(Resource resource) const { return resources[resource].image; }
+
+    /// All levels of a transient image
+    [[nodiscard]] vk::ImageView getView(Resource resource) const { return resources[resource].view; }
+
+    [[nodiscard]] const Stats &getStats() const { return stats; }
+
+private:
+    /// Ordered from keeping to replacing the contents, a pass accessing a resource twice counts as the greater
+    enum class AccessKind : uint8_t
+    {
+        Read,
+        Write,
+        Overwrite
+    };
+
+    struct Access
+    {
+        Resource resource;
+        AccessKind kind;
+        Usage usage;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        Execute execute;
+        std::vector<Access> accesses;
+        bool side_effect = false;
+        bool culled = false;
+    };
+
+    /// The accesses since the last write, what the next barrier on the resource has to wait for
+    struct State
+    {
+        vk::PipelineStageFlags2 write_stages;
+        vk::AccessFlags2 write_access;
+
+        /// Stages that read since the last write, a write has to wait for them as well
+        vk::PipelineStageFlags2 read_stages;
+
+        /// Where the last write is visible already, later reads there need no barrier
+        vk::PipelineStageFlags2 visible_stages;
+        vk::AccessFlags2 visible_access;
+
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    };
+
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct ResourceInfo
+    {
+        std::string name;
+        bool buffer = false;
+        bool transient = false;
+        bool output = false;
+
+        /// State starts empty every execute
+        bool per_frame = false;
+
+        vk::ImageAspectFlags aspect;
+        uint32_t levels = 1;
+        ImageDesc desc;
+
+        /// Layout of an imported image before the first execute
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+
+        vk::Image image;
+        vk::ImageView view;
+
+        /// Kept passes using it first and last, in declaration order
+        uint32_t first_pass = UINT32_MAX;
+        uint32_t last_pass = 0;
+
+        /// Memory slot of a transient
+        uint32_t slot = NO_SLOT;
+    };
+
+    /// One allocation shared by transients with disjoint lifetimes
+    struct MemorySlot
+    {
+        VmaAllocation allocation = nullptr;
+        vk::MemoryRequirements requirements;
+        std::vector<Resource> resources;
+    };
+
+    struct Barriers
+    {
+        std::vector<vk::MemoryBarrier2> memory;
+        std::vector<vk::ImageMemoryBarrier2> images;
+
+        /// First uses of transients sharing memory, and how many of them got a barrier
+        uint32_t aliased_uses = 0;
+        uint32_t aliasing_barriers = 0;
+
+        void clear()
+        {
+            memory.clear();
+            images.clear();
+            aliased_uses = 0;
+            aliasing_barriers = 0;
+        }
+    };
+
+    std::vector<Pass> passes;
+    std::vector<ResourceInfo> resources;
+    std::vector<MemorySlot> slots;
+
+    /// Per resource, after the last execute
+    std::vector<State> states;
+
+    /// Per resource, whether the current frame used it already
+    std::vector<uint8_t> frame_used;
+
+    /// Of the pass being recorded, kept to reuse the allocations
+    Barriers barriers;
+
+    bool compiled = false;
+
+    Stats stats;
+
+    void add_access(uint32_t pass, Resource resource, AccessKind kind, const Usage &usage);
+
+    void cull_passes();
+
+    void create_transients();
+
+    void destroy_transients();
+
+    /// Forgets which resources the frame used and the state of the per-frame ones
+    void begin_frame(std::vector<State> &frame_states, std::vector<uint8_t> &used) const;
+
+    /// Appends the barriers pass needs to out and moves the resource states past it
+    void transition(const Pass &pass, std::vector<State> &pass_states, std::vector<uint8_t> &used, Barriers &out) const;
+};
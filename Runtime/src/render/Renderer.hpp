@@ -3,17 +3,34 @@
 #include "../vk/Vulkan_Base.hpp"
 #include "../vk/mesh/Vulkan_Mesh.hpp"
 
+#include "HiZPyramid.hpp"
 #include "ObjectRenderer.hpp"
+#include "ParallelRecorder.hpp"
+#include "RenderGraph.hpp"
 
 #include "../vk/uniform/Vulkan_3D_Unifrom.hpp"
 
+#include "../jobs/JobSystem.hpp"
+#include "../profiler/CpuProfiler.hpp"
+#include "../profiler/GpuProfiler.hpp"
+
+/// What the main pass draws
+enum class RenderMode
+{
+    Shaded,
+    /// Additive fragment count of every rasterized fragment, regardless of depth
+    Overdraw,
+    /// Additive fragment count of the fragments passing the depth test, i.e. the shaded ones
+    OverdrawDepthTested,
+};
+
 class Renderer
 {
 public:
-    Vent_Window window{800, 800, "Vent-Engine Runtime"};
+    Vent_Window window;
     Camera camera{};
 
-    Renderer();
+    explicit Renderer(const ApplicationInfo &info = ApplicationInfo{"Vent-Engine Runtime", 800, 800});
 
     ~Renderer();
 
@@ -21,10 +38,95 @@ public:
 
     void onPostUpdate(uint32_t &index);
 
+    /// Begins the main pass and records the objects. Further draws of the pass go into the returned buffer:
+    /// the primary, or with recording threads a main thread secondary that onPostDraw executes.
     vk::CommandBuffer onPreDraw(uint32_t &swapchain_index);
 
     void onPostDraw(const vk::CommandBuffer &cmd,uint32_t &swapchain_index);
 
+    [[nodiscard]] const FrameStats &getFrameStats() const { return stats; }
+
+    /// Recreates the swapchain with the given present mode, or the closest supported one.
+    void setPresentMode(vk::PresentModeKHR mode);
+
+    [[nodiscard]] vk::PresentModeKHR getPresentMode() const { return context->present_mode; }
+
+    /// Caps the frame rate while presenting with an uncapped mode, 0 disables the limiter.
+    void setMaxFps(uint32_t fps) { max_fps = fps; }
+
+    [[nodiscard]] bool isHeadless() const { return context->headless; }
+
+    /// Timestamp scopes of the frames, add your own between onPreDraw and onPostDraw.
+    GpuProfiler &getGpuProfiler() { return *gpu_profiler; }
+
+    void setRenderMode(RenderMode mode) { render_mode = mode; }
+
+    [[nodiscard]] RenderMode getRenderMode() const { return render_mode; }
+
+    /// Binds of the latest frame's sorted draw list and what rebinding everything per draw would have taken.
+    [[nodiscard]] const BindStats &getBindStats() const { return objectRenderer->getBindStats(); }
+
+    [[nodiscard]] const BindStats &getNaiveBindStats() const { return objectRenderer->getNaiveBindStats(); }
+
+    /// Groups objects sharing mesh and material into instanced draws.
+    void setInstancing(bool enable) { objectRenderer->setInstancing(enable); }
+
+    /// Submits the object draws through indirect commands, see ObjectRenderer::setIndirect.
+    void setIndirectDraws(bool enable) { objectRenderer->setIndirect(enable); }
+
+    /// Frustum culls the objects on the CPU before the draw list is built, see ObjectRenderer::setFrustumCulling.
+    void setFrustumCulling(bool enable) { objectRenderer->setFrustumCulling(enable); }
+
+    /// Walks the object BVH for the frustum test, see ObjectRenderer::setBvhCulling.
+    void setBvhCulling(bool enable) { objectRenderer->setBvhCulling(enable); }
+
+    [[nodiscard]] const CullStats &getCullStats() const { return objectRenderer->getCullStats(); }
+
+    /// Object whose bounding box the world space ray hits first within distance, Bvh::NO_HIT if none.
+    /// Every submesh of a model is an object of its own, e.g. one wall of Sponza rather than the whole level.
+    uint32_t pickObject(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) { return objectRenderer->pick(origin, direction, distance); }
+
+    /// Appends the objects whose bounding box intersects region, per submesh like pickObject.
+    void queryObjects(const Aabb &region, std::vector<uint32_t> &objects) { objectRenderer->queryRegion(region, objects); }
+
+    /// With GPU culling, keeps the cull results of the next frame for verifyGpuCulling.
+    void requestCullingReadback() { objectRenderer->requestCullReadback(); }
+
+    /// Checks the latest frame's GPU frustum cull against the CPU, see ObjectRenderer::verifyGpuCulling.
+    bool verifyGpuCulling() { return objectRenderer->verifyGpuCulling(); }
+
+    /// Mesh id of an object pickObject or queryObjects returned
+    [[nodiscard]] uint32_t getObjectMesh(const uint32_t object) const { return objectRenderer->getInstanceMesh(object); }
+
+    /// Objects and draws of the latest frame, the difference is what instancing saved.
+    [[nodiscard]] const InstancingStats &getInstancingStats() const { return objectRenderer->getInstancingStats(); }
+
+    /// Pipeline statistics around the main pass, ignored when the device lacks pipelineStatisticsQuery.
+    void setPipelineStatistics(bool enable) { gpu_profiler->setStatisticsEnabled(enable); }
+
+    /// Statistics of the latest completed frame that queried them.
+    [[nodiscard]] const PipelineStatistics &getPipelineStatistics() const { return gpu_profiler->statistics(); }
+
+    /// Draws the objects depth-only with a position-only pipeline before shading them, in the shaded render mode.
+    /// Auto measures the overdraw of a frame without it and turns it on above AUTO_PREPASS_OVERDRAW fragments per pixel,
+    /// set it again after loading another scene. Auto needs pipeline statistics queries and stays off without them.
+    void setDepthPrepass(DepthPrepass mode);
+
+    [[nodiscard]] bool isDepthPrepass() const { return prepass_active; }
+
+    /// Times recording draw_count draws into secondaries split into 1 to max_threads jobs and logs the speedups.
+    /// Nothing is submitted, it only measures the CPU side. Waits for the device to idle first.
+    void measureRecordingScaling(uint32_t max_threads, uint32_t draw_count);
+
+    /// The render pass onPreDraw leaves open for the caller's draws, pipelines drawn there have to be compatible with it.
+    [[nodiscard]] vk::RenderPass getMainRenderPass() const { return main_render_pass; }
+
+    /// Headless only: copies the color target of the next submitted frame into host memory.
+    void requestReadback();
+
+    /// Waits for the requested readback and returns the RGBA8 pixels, false if none was requested.
+    bool readback(std::vector<uint8_t> &pixels);
+
 private:
     VKBase vkbase{window};
 
@@ -32,13 +134,102 @@ private:
 
     std::unique_ptr<ObjectRenderer> objectRenderer;
 
-    std::unique_ptr<VulkanImage> depth_image;
+    /// Cull, draw phases and Hi-Z build of a frame, rebuilt with the framebuffers. Owns the depth buffer and the pyramid.
+    RenderGraph frame_graph;
 
+    /// Transient images of frame_graph, the pyramid is INVALID_RESOURCE without occlusion culling
+    RenderGraph::Resource depth_target = RenderGraph::INVALID_RESOURCE;
+    RenderGraph::Resource pyramid_target = RenderGraph::INVALID_RESOURCE;
+
+    /// The render pass frame_graph leaves open for the caller: the late pass with occlusion culling
+    vk::RenderPass main_render_pass;
+
+    /// Framebuffer and clear values of the frame being recorded, for the graph's draw passes
+    vk::Framebuffer frame_framebuffer;
+    std::array<vk::ClearValue, 2> clear_values;
+
+    /// Null without occlusion culling, rebuilt from the depth buffer between the two draw phases
+    std::unique_ptr<HiZPyramid> hiz;
+
+    std::unique_ptr<GpuProfiler> gpu_profiler;
+
+    /// Null while recording inline on the main thread
+    std::unique_ptr<ParallelRecorder> recorder;
+
+    /// With a recorder, onPreDraw hands out this main thread secondary for draws after the object draws
+    vk::CommandBuffer overlay;
+
+    uint32_t render_pass_scope = GpuProfiler::INVALID_SCOPE;
+
+    /// Spans the whole frame command buffer
+    uint32_t frame_scope = GpuProfiler::INVALID_SCOPE;
+
+    RenderMode render_mode = RenderMode::Shaded;
+
+    /// Headless color targets, one per frame in flight, standing in for the swapchain images.
+    std::vector<std::unique_ptr<VulkanImage>> offscreen_images;
+
+    std::unique_ptr<VulkanVertexBuffer> readback_buffer;
+
+    bool readback_requested = false;
+
+    /// Graphics timeline value of the frame that copied into readback_buffer, 0 if there is none.
+    uint64_t readback_value = 0;
+
+    FrameStats stats;
+
+    uint64_t last_frame_counter = 0;
+
+    uint32_t max_fps = 0;
+
+    /// Performance counter the frame limiter waits for before starting the next frame.
+    uint64_t limiter_deadline = 0;
+
+    /// Fragments per pixel above which the automatic depth pre-pass turns on
+    static constexpr double AUTO_PREPASS_OVERDRAW = 1.5;
+
+    DepthPrepass depth_prepass = DepthPrepass::Off;
+
+    bool prepass_active = false;
+
+    /// Statistics count the automatic pre-pass decides at, 0 once decided
+    uint64_t prepass_decision = 0;
+
+    /// Statistics were only turned on for the automatic pre-pass
+    bool prepass_statistics = false;
+
+    void limit_frame_rate();
+
+    /// Settles the automatic depth pre-pass once the statistics of a frame without it are back.
+    void update_depth_prepass();
+
+    /// Pipeline of the current render mode
+    [[nodiscard]] vk::Pipeline main_pipeline() const;
+
+    /// Pipeline, viewport and scissor of the main pass, every secondary has to set them again.
+    void bind_pass_state(const vk::CommandBuffer &cmd) const;
+
+    /// Viewport and scissor only, for buffers recording draw packets which bind their pipelines themselves.
+    void set_viewport(const vk::CommandBuffer &cmd) const;
+
+    /// Begins the render pass of rp_begin and records the object draws of the cull phase, inline or across the recorder,
+    /// the depth pre-pass first when it is active.
+    void draw_objects(const vk::CommandBuffer &cmd, const vk::RenderPassBeginInfo &rp_begin, uint32_t phase);
 
     bool resize(const uint32_t,const uint32_t);
 
+    void recreate_swapchain();
+
+    void collect_frame_latencies();
+
     void init_framebuffers();
 
+    /// Declares and compiles frame_graph for the current swapchain size, before the framebuffers use its depth buffer.
+    void build_frame_graph();
+
+    /// Begin info of render_pass on the frame's framebuffer, with clear_values
+    [[nodiscard]] vk::RenderPassBeginInfo pass_begin(vk::RenderPass render_pass) const;
+
     void teardown_framebuffers();
 
     void loadModels();
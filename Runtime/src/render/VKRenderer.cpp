@@ -1,26 +1,98 @@
 #include "Renderer.hpp"
 
-Renderer::Renderer()
+Renderer::Renderer(const ApplicationInfo &info) : window(static_cast<uint32_t>(info.width), static_cast<uint32_t>(info.height), info.name, info.headless)
 {
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Loading VK Renderer");
+
+	// Created here, so the renderer's thread is the job system's main thread
+	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Job system running on %u threads", JobSystem::get().getThreadCount());
+
 	vkbase.initVulkan();
 
-	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Creating VK Swapchain");
-	vkbase.createSwapchain();
+	if (info.vsync)
+	{
+		context->requested_present_mode = info.low_latency ? vk::PresentModeKHR::eMailbox : vk::PresentModeKHR::eFifo;
+	}
+	else
+	{
+		context->requested_present_mode = vk::PresentModeKHR::eImmediate;
+	}
+	max_fps = info.max_fps;
+
+	if (context->headless)
+	{
+		SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Rendering headless into %ux%u offscreen targets", context->swapchain_dimensions.width, context->swapchain_dimensions.height);
+	}
+	else
+	{
+		SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Creating VK Swapchain");
+		vkbase.createSwapchain();
+		SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Present mode: %s", vk::to_string(context->present_mode).c_str());
+	}
+
+	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Creating %u Frames in Flight", info.frames_in_flight);
+	vkbase.createFrames(info.frames_in_flight);
+
+	// Before any upload, so texture uploads are timed as well
+	gpu_profiler = std::make_unique<GpuProfiler>(context->frames_in_flight);
+	context->gpu_profiler = gpu_profiler.get();
+	if (info.pipeline_statistics)
+	{
+		if (!gpu_profiler->supportsStatistics())
+		{
+			SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Pipeline statistics queries not supported");
+		}
+		gpu_profiler->setStatisticsEnabled(true);
+	}
+
+	if (info.recording_threads > 1)
+	{
+		recorder = std::make_unique<ParallelRecorder>(info.recording_threads, context->frames_in_flight);
+	}
 
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Creating VK RenderPass");
+	// Occlusion culling draws in two passes, the second continues on the depth of the first
+	context->keep_depth = info.occlusion_culling;
 	vkbase.createRenderPass();
 
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Loading Shader Uniform");
 	this->loadUniform();
 
 	objectRenderer = std::make_unique<ObjectRenderer>();
+	objectRenderer->setInstancing(info.instancing);
+	objectRenderer->setIndirect(info.indirect_draws);
+	objectRenderer->setFrustumCulling(info.frustum_culling);
+	objectRenderer->setBvhCulling(info.bvh_culling);
+	if (info.indirect_draws && !context->draw_indirect_first_instance)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "drawIndirectFirstInstance not supported, drawing directly");
+	}
 
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Loading Models");
 	this->loadModels();
 
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Creating VK Pipeline");
 	vkbase.createPipeline("assets/shaders/model.vert.glsl.spv", "assets/shaders/model.frag.glsl.spv");
+	vkbase.createOverdrawPipelines("assets/shaders/model.vert.glsl.spv", "assets/shaders/overdraw.frag.glsl.spv");
+	vkbase.createDepthPrepassPipelines("assets/shaders/depth.vert.glsl.spv", "assets/shaders/model.vert.glsl.spv", "assets/shaders/model.frag.glsl.spv");
+	this->setDepthPrepass(info.depth_prepass);
+
+	if (info.gpu_culling)
+	{
+		vkbase.createCullPipeline("assets/shaders/cull.comp.glsl.spv");
+		objectRenderer->setGpuCulling(true);
+		if (!objectRenderer->isGpuCulling())
+		{
+			SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "GPU culling needs indirect draws, drawing everything");
+		}
+	}
+
+	if (info.occlusion_culling && objectRenderer->isGpuCulling())
+	{
+		vkbase.createOcclusionPipelines("assets/shaders/cull_occlusion.comp.glsl.spv", "assets/shaders/hiz.comp.glsl.spv");
+		hiz = std::make_unique<HiZPyramid>();
+		objectRenderer->setOcclusionCulling(hiz.get());
+	}
 
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Init FrameBuffers");
 	this->init_framebuffers();
@@ -28,21 +100,31 @@ Renderer::Renderer()
 
 void Renderer::loadModels()
 {
-	vk::DescriptorBufferInfo buffer_descriptor(uniform->getBuffer(), 0, sizeof(Vulkan_3D_Unifrom::ubo_vs));
+	VENT_PROFILE_ZONE("Load models");
+
+	JobSystem &jobs = JobSystem::get();
+
+	// Decoding touches no Vulkan object, it overlaps with the mesh import
+	ImageData texture;
+	JobCounter decoded;
+	jobs.schedule([&texture] { texture = VulkanImage::decode("assets/textures/5792855332885324923.jpg"); }, &decoded);
+
 	std::unique_ptr<Vulkan_Mesh> model = std::make_unique<Vulkan_Mesh>("assets/meshes/Sponza.gltf");
-	model->setTexture(buffer_descriptor, "assets/textures/5792855332885324923.jpg");
+
+	jobs.wait(decoded);
+	model->setTexture(texture);
 
 	objectRenderer->addModel(model);
 }
 
 void Renderer::loadUniform()
 {
-	uniform = std::make_unique<Vulkan_3D_Unifrom>(camera);
+	uniform = std::make_unique<Vulkan_3D_Unifrom>(camera, context->frames_in_flight);
 }
 
 bool Renderer::resize(const uint32_t, const uint32_t)
 {
-	if (!context->device)
+	if (!context->device || context->headless)
 	{
 		return false;
 	}
@@ -56,31 +138,226 @@ bool Renderer::resize(const uint32_t, const uint32_t)
 		return false;
 	}
 
+	this->recreate_swapchain();
+	return true;
+}
+
+void Renderer::recreate_swapchain()
+{
 	context->device.waitIdle();
 	this->teardown_framebuffers();
 
-	vkbase.createSwapchain();
+	if (!context->headless)
+	{
+		vkbase.createSwapchain();
+	}
 	this->init_framebuffers();
-	return true;
+}
+
+void Renderer::setPresentMode(const vk::PresentModeKHR mode)
+{
+	if (mode == context->requested_present_mode || context->headless)
+	{
+		return;
+	}
+
+	context->requested_present_mode = mode;
+	this->recreate_swapchain();
+
+	SDL_Log("Present mode: %s", vk::to_string(context->present_mode).c_str());
+}
+
+void Renderer::limit_frame_rate()
+{
+	// FIFO already paces to the display, only the uncapped modes need the limiter
+	if (max_fps == 0 || context->present_mode == vk::PresentModeKHR::eFifo || context->present_mode == vk::PresentModeKHR::eFifoRelaxed)
+	{
+		limiter_deadline = 0;
+		return;
+	}
+
+	const uint64_t frequency = SDL_GetPerformanceFrequency();
+	const uint64_t period = frequency / max_fps;
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	if (limiter_deadline == 0 || now > limiter_deadline + period)
+	{
+		// First limited frame or far behind, restart the schedule instead of rushing to catch up
+		limiter_deadline = now + period;
+		return;
+	}
+
+	// Sleep for the bulk of the remaining time, the scheduler is too coarse for the last 2 ms
+	const uint64_t sleep_margin = frequency / 500;
+	if (limiter_deadline > now + sleep_margin)
+	{
+		SDL_Delay(static_cast<uint32_t>((limiter_deadline - now - sleep_margin) * 1000 / frequency));
+	}
+
+	while ((now = SDL_GetPerformanceCounter()) < limiter_deadline)
+	{
+	}
+
+	limiter_deadline += period;
 }
 
 void Renderer::init_framebuffers()
 {
 	vk::Device device = context->device;
 
-	depth_image = std::make_unique<VulkanImage>(context->depthFormat, context->swapchain_dimensions.width, context->swapchain_dimensions.height);
+	this->build_frame_graph();
+
+	std::vector<vk::ImageView> color_views = context->swapchain_image_views;
+
+	if (context->headless)
+	{
+		// One color target per frame in flight, so frames can overlap like they do on swapchain images
+		for (uint32_t i = 0; i < context->frames_in_flight; i++)
+		{
+			offscreen_images.push_back(std::make_unique<VulkanImage>(context->swapchain_dimensions.format, context->swapchain_dimensions.width, context->swapchain_dimensions.height,
+																	 vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc));
+			color_views.push_back(offscreen_images.back()->getTexture().view);
+		}
+	}
 
 	// Create framebuffer for each swapchain image view
-	for (auto &image_view : context->swapchain_image_views)
+	for (auto &image_view : color_views)
 	{
 		// Build the framebuffer.
-		std::array<vk::ImageView, 2> views = {image_view, depth_image->getTexture().view};
+		std::array<vk::ImageView, 2> views = {image_view, frame_graph.getView(depth_target)};
 		vk::FramebufferCreateInfo fb_info({}, context->render_pass, views.size(), views.data(), context->swapchain_dimensions.width, context->swapchain_dimensions.height, 1);
 
 		context->swapchain_framebuffers.push_back(device.createFramebuffer(fb_info));
 	}
 }
 
+void Renderer::build_frame_graph()
+{
+	frame_graph.clear();
+
+	const vk::Extent2D extent(context->swapchain_dimensions.width, context->swapchain_dimensions.height);
+	const bool occlusion = hiz && objectRenderer->isOcclusionCulling();
+	const vk::PipelineStageFlags2 compute = vk::PipelineStageFlagBits2::eComputeShader;
+
+	// The render passes transition the color target themselves, the graph only orders the passes writing it
+	const RenderGraph::Resource color = frame_graph.importImage("Color", vk::ImageAspectFlagBits::eColor);
+	frame_graph.markOutput(color);
+	const vk::ImageLayout color_final = context->headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+
+	RenderGraph::ImageDesc depth_desc;
+	depth_desc.format = context->depthFormat;
+	depth_desc.extent = extent;
+	// The Hi-Z pyramid samples it
+	depth_desc.usage = occlusion ? vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled : vk::ImageUsageFlagBits::eDepthStencilAttachment;
+	depth_desc.aspect = vk::ImageAspectFlagBits::eDepth;
+	if (vk::Format::eD16UnormS8Uint <= context->depthFormat)
+	{
+		depth_desc.aspect |= vk::ImageAspectFlagBits::eStencil;
+	}
+	depth_target = frame_graph.createImage("Depth", depth_desc);
+	pyramid_target = RenderGraph::INVALID_RESOURCE;
+
+	// What the cull writes on the GPU. The buffers the host wrote before the submit need no declaration.
+	// All but the history have a copy per frame in flight, so frames don't wait on each other's copies.
+	const bool gpu_culling = objectRenderer->isGpuCulling();
+	RenderGraph::Resource commands = RenderGraph::INVALID_RESOURCE;
+	RenderGraph::Resource instances = RenderGraph::INVALID_RESOURCE;
+	RenderGraph::Resource batches = RenderGraph::INVALID_RESOURCE;
+	RenderGraph::Resource history = RenderGraph::INVALID_RESOURCE;
+	if (gpu_culling)
+	{
+		commands = frame_graph.importBuffer("Indirect commands", true);
+		instances = frame_graph.importBuffer("Instances", true);
+		batches = frame_graph.importBuffer("Cull batches", true);
+
+		RenderGraph::PassBuilder cull = frame_graph.addPass("Frustum cull", [this](const vk::CommandBuffer &cmd) { objectRenderer->cull(cmd, uniform, 0); });
+		cull.write(batches, RenderGraph::Usage::storageReadWrite(compute))
+			.write(commands, RenderGraph::Usage::storageReadWrite(compute))
+			.write(instances, RenderGraph::Usage::storageWrite(compute));
+
+		if (occlusion)
+		{
+			// The next frame's early phase draws what the late phase found visible
+			history = frame_graph.importBuffer("Visibility history");
+			frame_graph.markOutput(history);
+			cull.read(history, RenderGraph::Usage::storageRead(compute));
+		}
+	}
+
+	const auto reads_draws = [&](RenderGraph::PassBuilder &pass) {
+		if (gpu_culling)
+		{
+			pass.read(commands, RenderGraph::Usage::indirectRead()).read(instances, RenderGraph::Usage::storageRead(vk::PipelineStageFlagBits2::eVertexShader));
+		}
+	};
+
+	// The profiler's main pass scope and statistics span every object draw. The last draw pass stays open for the caller.
+	const auto draw_pass = [this](const vk::RenderPass render_pass, const uint32_t phase, const bool first, const bool last) {
+		return [this, render_pass, phase, first, last](const vk::CommandBuffer &cmd) {
+			if (first)
+			{
+				render_pass_scope = gpu_profiler->begin(cmd, "Main pass");
+				gpu_profiler->beginStatistics(cmd);
+			}
+
+			this->draw_objects(cmd, this->pass_begin(render_pass), phase);
+			if (!last)
+			{
+				cmd.endRenderPass();
+			}
+		};
+	};
+
+	if (!occlusion)
+	{
+		main_render_pass = context->render_pass;
+		RenderGraph::PassBuilder main_pass = frame_graph.addPass("Main pass", draw_pass(main_render_pass, 0, true, true));
+		main_pass.overwrite(color, RenderGraph::Usage::colorAttachment(vk::ImageLayout::eUndefined, color_final))
+			.overwrite(depth_target, RenderGraph::Usage::depthAttachment(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal));
+		reads_draws(main_pass);
+	}
+	else
+	{
+		// Phase 0 draws what was visible last frame, the pyramid of its depth decides which of the rest phase 1 draws
+		RenderGraph::PassBuilder early = frame_graph.addPass("Early pass", draw_pass(context->early_render_pass, 0, true, false));
+		early.overwrite(color, RenderGraph::Usage::colorAttachment(vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal))
+			.overwrite(depth_target, RenderGraph::Usage::depthAttachment(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal));
+		reads_draws(early);
+
+		// Each level samples the one before, in eGeneral
+		pyramid_target = frame_graph.createImage("Hi-Z pyramid", HiZPyramid::describe(extent.width, extent.height));
+		frame_graph.addPass("Hi-Z pyramid", [this](const vk::CommandBuffer &cmd) { hiz->build(cmd); })
+			.read(depth_target, RenderGraph::Usage::sampled(compute, vk::ImageLayout::eDepthStencilReadOnlyOptimal))
+			.overwrite(pyramid_target, RenderGraph::Usage::storageWrite(compute))
+			.read(pyramid_target, RenderGraph::Usage::sampled(compute, vk::ImageLayout::eGeneral));
+
+		frame_graph.addPass("Occlusion cull", [this](const vk::CommandBuffer &cmd) { objectRenderer->cull(cmd, uniform, 1); })
+			.read(pyramid_target, RenderGraph::Usage::sampled(compute, vk::ImageLayout::eGeneral))
+			.write(history, RenderGraph::Usage::storageReadWrite(compute))
+			.write(batches, RenderGraph::Usage::storageReadWrite(compute))
+			.write(commands, RenderGraph::Usage::storageReadWrite(compute))
+			.write(instances, RenderGraph::Usage::storageWrite(compute));
+
+		main_render_pass = context->late_render_pass;
+		RenderGraph::PassBuilder late = frame_graph.addPass("Late pass", draw_pass(main_render_pass, 1, false, true));
+		late.write(color, RenderGraph::Usage::colorAttachment(vk::ImageLayout::eColorAttachmentOptimal, color_final))
+			.write(depth_target, RenderGraph::Usage::depthAttachment(vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::ImageLayout::eDepthStencilAttachmentOptimal));
+		reads_draws(late);
+	}
+
+	frame_graph.compile();
+
+	if (pyramid_target != RenderGraph::INVALID_RESOURCE)
+	{
+		hiz->bind(frame_graph.getImage(depth_target), frame_graph.getImage(pyramid_target), extent.width, extent.height);
+	}
+}
+
+vk::RenderPassBeginInfo Renderer::pass_begin(const vk::RenderPass render_pass) const
+{
+	return vk::RenderPassBeginInfo(render_pass, frame_framebuffer, {{0, 0}, {context->swapchain_dimensions.width, context->swapchain_dimensions.height}}, clear_values);
+}
+
 void Renderer::teardown_framebuffers()
 {
 	// Wait until device is idle before teardown.
@@ -92,7 +369,39 @@ void Renderer::teardown_framebuffers()
 	}
 
 	context->swapchain_framebuffers.clear();
-	depth_image.reset();
+	frame_graph.clear();
+	offscreen_images.clear();
+	readback_buffer.reset();
+	readback_value = 0;
+}
+
+void Renderer::requestReadback()
+{
+	if (!context->headless)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Readback is only supported in headless mode");
+		return;
+	}
+
+	readback_requested = true;
+}
+
+bool Renderer::readback(std::vector<uint8_t> &pixels)
+{
+	if (readback_value == 0)
+	{
+		return false;
+	}
+
+	wait_timeline(context->graphics_timeline, readback_value);
+	readback_buffer->invalidate();
+
+	const uint8_t *data = readback_buffer->map();
+	pixels.assign(data, data + readback_buffer->get_size());
+	readback_buffer->unmap();
+
+	readback_value = 0;
+	return true;
 }
 
 Renderer::~Renderer()
@@ -100,6 +409,22 @@ Renderer::~Renderer()
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Shutting down Vulkan");
 	context->device.waitIdle();
 
+	if (objectRenderer)
+	{
+		const BindStats &binds = objectRenderer->getBindStats();
+		const BindStats &naive_binds = objectRenderer->getNaiveBindStats();
+		SDL_Log("Binds for %u draws: %u pipelines, %u descriptor sets, %u buffers (%u, %u, %u without sorting and skipping)", binds.draws, binds.pipelines,
+				binds.descriptor_sets, binds.buffers, naive_binds.pipelines, naive_binds.descriptor_sets, naive_binds.buffers);
+		SDL_Log("%u draw calls for %u draws (%s)", binds.draw_calls, binds.draws, objectRenderer->isIndirect() ? "indirect" : "direct");
+	}
+
+	const auto job_stats = JobSystem::get().getStats();
+	for (size_t i = 0; i < job_stats.size(); i++)
+	{
+		SDL_Log("Job thread %zu: %llu jobs, %llu stolen, %.1f%% busy", i, static_cast<unsigned long long>(job_stats[i].jobs),
+				static_cast<unsigned long long>(job_stats[i].steals), job_stats[i].utilization * 100.0);
+	}
+
 	this->teardown_framebuffers();
 
 	if (objectRenderer)
@@ -107,23 +432,47 @@ Renderer::~Renderer()
 		objectRenderer.reset();
 	}
 
+	hiz.reset();
+
 	if (uniform)
 	{
 		uniform.reset();
 	}
 
-	for (auto &per_frame : context->per_frame)
+	if (stats.frames > 0)
 	{
-		vkbase.teardown_per_frame(per_frame);
+		const double frames = static_cast<double>(stats.frames);
+		SDL_Log("%u frames in flight: %.3f ms/frame (%.1f fps), %.3f ms latency, %.3f ms timeline wait over %llu frames",
+				context->frames_in_flight, stats.frame_time_ms / frames, 1000.0 * frames / stats.frame_time_ms,
+				stats.latency_ms / frames, stats.timeline_wait_ms / frames, static_cast<unsigned long long>(stats.frames));
+		SDL_Log("%.1f draws/frame, %.1f saved by instancing", static_cast<double>(stats.draws) / frames, static_cast<double>(stats.draws_saved) / frames);
+		SDL_Log("%.1f objects/frame culled on the CPU", static_cast<double>(stats.objects_culled) / frames);
 	}
 
-	context->per_frame.clear();
-
-	for (auto semaphore : context->recycled_semaphores)
+	if (gpu_profiler)
 	{
-		context->device.destroySemaphore(semaphore);
+		for (const auto &timing : gpu_profiler->results())
+		{
+			SDL_Log("GPU %*s%s: %.3f ms average", static_cast<int>(timing.depth * 2), "", timing.name.c_str(), gpu_profiler->average(timing.name));
+		}
+
+		if (gpu_profiler->isStatisticsEnabled())
+		{
+			const PipelineStatistics &statistics = gpu_profiler->statistics();
+			SDL_Log("Main pass (depth pre-pass %s): %llu primitives, %llu vertex invocations, %llu clipped primitives, %llu fragment invocations",
+					prepass_active ? "on" : "off", static_cast<unsigned long long>(statistics.input_assembly_primitives),
+					static_cast<unsigned long long>(statistics.vertex_shader_invocations),
+					static_cast<unsigned long long>(statistics.clipping_primitives), static_cast<unsigned long long>(statistics.fragment_shader_invocations));
+		}
+
+		context->gpu_profiler = nullptr;
+		gpu_profiler.reset();
 	}
 
+	recorder.reset();
+
+	vkbase.destroyFrames();
+
 	vkbase.destroyPipeline();
 
 	vkbase.destroyRenderpass();
@@ -135,21 +484,37 @@ Renderer::~Renderer()
 
 vk::Result Renderer::present_image(uint32_t &index)
 {
-	vk::PresentInfoKHR present(context->per_frame[index].swapchain_release_semaphore, context->swapchain, index);
+	if (context->headless)
+	{
+		return vk::Result::eSuccess;
+	}
+
+	vk::PresentInfoKHR present(context->swapchain_release_semaphores[index], context->swapchain, index);
 	// Present swapchain image
-	return context->queue.presentKHR(present);
+	try
+	{
+		return context->queue.presentKHR(present);
+	}
+	catch (const vk::OutOfDateKHRError &)
+	{
+		return vk::Result::eErrorOutOfDateKHR;
+	}
 }
 
 uint32_t Renderer::onPreUpdate(float delta)
 {
+	VENT_PROFILE_ZONE("onPreUpdate");
+
+	JobSystem::get().runMainThreadJobs();
+
 	uint32_t index;
 
 	auto res = this->acquire_next_image(index);
 
-	// Handle outdated error in acquire.
-	if (res == vk::Result::eSuboptimalKHR || res == vk::Result::eErrorOutOfDateKHR)
+	// Handle outdated error in acquire. A suboptimal image is still acquired and gets handled on present.
+	if (res == vk::Result::eErrorOutOfDateKHR)
 	{
-		this->resize(context->swapchain_dimensions.width, context->swapchain_dimensions.height);
+		this->recreate_swapchain();
 		res = acquire_next_image(index);
 	}
 
@@ -163,8 +528,15 @@ uint32_t Renderer::onPreUpdate(float delta)
 }
 
 void Renderer::onPostUpdate(uint32_t &index) {
+	VENT_PROFILE_ZONE("Present");
+
 	auto res = this->present_image(index);
 
+	// Move on to the next frame in flight, its timeline value gets waited on by the next acquire.
+	context->frame_index = (context->frame_index + 1) % context->frames_in_flight;
+
+	this->limit_frame_rate();
+
 	// Handle Outdated error in present.
 	if (res == vk::Result::eSuboptimalKHR || res == vk::Result::eErrorOutOfDateKHR)
 	{
@@ -176,84 +548,260 @@ void Renderer::onPostUpdate(uint32_t &index) {
 	}
 }
 
-vk::Result Renderer::acquire_next_image(uint32_t &image)
+void Renderer::collect_frame_latencies()
 {
-	vk::Semaphore acquire_semaphore;
-	if (context->recycled_semaphores.empty())
+	// One counter read covers every frame in flight, the latency error is bounded by a single frame time.
+	const uint64_t completed = context->device.getSemaphoreCounterValue(context->graphics_timeline);
+	const uint64_t now = SDL_GetPerformanceCounter();
+	const double counter_to_ms = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+
+	for (auto &per_frame : context->per_frame)
 	{
-		acquire_semaphore = context->device.createSemaphore({});
+		if (per_frame.start_counter != 0 && per_frame.timeline_value <= completed)
+		{
+			stats.latency_ms += static_cast<double>(now - per_frame.start_counter) * counter_to_ms;
+			per_frame.start_counter = 0;
+		}
 	}
-	else
+
+	// Resources retired by frames that completed can go now.
+	release_retired_resources();
+}
+
+vk::Result Renderer::acquire_next_image(uint32_t &image)
+{
+	PerFrame &per_frame = context->per_frame[context->frame_index];
+
+	const double counter_to_ms = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+	const uint64_t frame_start = SDL_GetPerformanceCounter();
+
+	// Wait for the GPU to finish the frame that used this slot frames_in_flight frames ago.
+	// After this returns, it is safe to reuse or delete resources which were used by it.
+	// Normally, this doesn't really block at all, unless the CPU runs ahead of the GPU.
+	if (per_frame.timeline_value > 0)
 	{
-		acquire_semaphore = context->recycled_semaphores.back();
-		context->recycled_semaphores.pop_back();
+		wait_timeline(context->graphics_timeline, per_frame.timeline_value);
 	}
 
-	vk::Result res;
-	std::tie(res, image) = context->device.acquireNextImageKHR(context->swapchain, UINT64_MAX, acquire_semaphore);
+	const uint64_t timeline_reached = SDL_GetPerformanceCounter();
+	stats.timeline_wait_ms += static_cast<double>(timeline_reached - frame_start) * counter_to_ms;
 
-	if (res != vk::Result::eSuccess)
+	this->collect_frame_latencies();
+
+	vk::Result res = vk::Result::eSuccess;
+	if (context->headless)
 	{
-		context->recycled_semaphores.push_back(acquire_semaphore);
-		return res;
+		// The offscreen targets are owned by the frames in flight, nothing to acquire
+		image = context->frame_index;
 	}
-
-	// If we have outstanding fences for this swapchain image, wait for them to complete first.
-	// After begin frame returns, it is safe to reuse or delete resources which
-	// were used previously.
-	//
-	// We wait for fences which completes N frames earlier, so we do not stall,
-	// waiting for all GPU work to complete before this returns.
-	// Normally, this doesn't really block at all,
-	// since we're waiting for old frames to have been completed, but just in case.
-	if (context->per_frame[image].queue_submit_fence)
+	else
 	{
-		auto result = context->device.waitForFences(context->per_frame[image].queue_submit_fence, true, UINT64_MAX);
-		if (result != vk::Result::eSuccess)
-			return result;
-		context->device.resetFences(context->per_frame[image].queue_submit_fence);
+		try
+		{
+			std::tie(res, image) = context->device.acquireNextImageKHR(context->swapchain, UINT64_MAX, per_frame.swapchain_acquire_semaphore);
+		}
+		catch (const vk::OutOfDateKHRError &)
+		{
+			// Nothing was signalled, the slot stays untouched until the swapchain is recreated.
+			return vk::Result::eErrorOutOfDateKHR;
+		}
 	}
 
-	if (context->per_frame[image].primary_command_pool)
+	if (res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR)
 	{
-		context->device.resetCommandPool(context->per_frame[image].primary_command_pool);
+		return res;
 	}
 
-	// Recycle the old semaphore back into the semaphore manager.
-	vk::Semaphore old_semaphore = context->per_frame[image].swapchain_acquire_semaphore;
+	context->device.resetCommandPool(per_frame.primary_command_pool);
 
-	if (old_semaphore)
+	per_frame.swapchain_index = image;
+	per_frame.start_counter = frame_start;
+
+	if (last_frame_counter != 0)
 	{
-		context->recycled_semaphores.push_back(old_semaphore);
+		stats.frame_time_ms += static_cast<double>(frame_start - last_frame_counter) * counter_to_ms;
+		stats.frames++;
 	}
-
-	context->per_frame[image].swapchain_acquire_semaphore = acquire_semaphore;
+	last_frame_counter = frame_start;
 
 	return vk::Result::eSuccess;
 }
 
 vk::CommandBuffer Renderer::onPreDraw(uint32_t &swapchain_index) {
+	VENT_PROFILE_ZONE("onPreDraw");
+
+	// The uniform buffers are per frame in flight, the GPU may still read the other copies
+	uniform->setFrame(context->frame_index);
+
 	// Only update if needed
 	uniform->updateViewMatrix(camera);
 
 	vk::Framebuffer framebuffer = context->swapchain_framebuffers[swapchain_index];
 
-	vk::CommandBuffer cmd = context->per_frame[swapchain_index].primary_command_buffer;
+	vk::CommandBuffer cmd = context->per_frame[context->frame_index].primary_command_buffer;
 
 	vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 
 	cmd.begin(begin_info);
 
-	vk::ClearValue clear_values[2];
-	clear_values[0].color = vk::ClearColorValue(std::array<float, 4>({{0.1f, 0.0f, 0.2f, 1.0f}}));
+	// The previous frame on this slot completed in acquire, so its timestamps are ready to read
+	gpu_profiler->beginFrame(context->frame_index);
+	this->update_depth_prepass();
+	frame_scope = gpu_profiler->begin(cmd, "GPU frame");
+
+	// Take ownership of everything the transfer queue finished uploading since the last frame.
+	if (!context->pending_acquire_barriers.empty())
+	{
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, context->pending_acquire_barriers);
+		context->pending_acquire_barriers.clear();
+	}
+
+	// Transforms, draw list and its buffers, written on the host before the graph's cull passes read them
+	objectRenderer->prepareFrame(uniform);
+
+	if (render_mode == RenderMode::Shaded)
+	{
+		clear_values[0].color = vk::ClearColorValue(std::array<float, 4>({{0.1f, 0.0f, 0.2f, 1.0f}}));
+	}
+	else
+	{
+		// Overdraw adds up from black
+		clear_values[0].color = vk::ClearColorValue(std::array<float, 4>({{0.0f, 0.0f, 0.0f, 1.0f}}));
+	}
 	clear_values[1].depthStencil = vk::ClearDepthStencilValue(0.0f, 0);
+	frame_framebuffer = framebuffer;
+
+	if (recorder)
+	{
+		recorder->beginFrame(context->frame_index);
+	}
+
+	// Cull, draw phases and Hi-Z build behind the barriers the graph worked out, ending in the open main pass
+	frame_graph.execute(cmd);
+	if (!recorder)
+	{
+		return cmd;
+	}
+
+	// The overlay the caller records into until onPostDraw
+	vk::CommandBufferInheritanceInfo inheritance(main_render_pass, 0, framebuffer);
+	inheritance.pipelineStatistics = gpu_profiler->inheritedStatistics();
+
+	overlay = recorder->beginSecondary(inheritance);
+	this->bind_pass_state(overlay);
+	return overlay;
+}
+
+void Renderer::draw_objects(const vk::CommandBuffer &cmd, const vk::RenderPassBeginInfo &rp_begin, const uint32_t phase)
+{
+	// With the pre-pass the objects are drawn depth-only first, then shaded where their depth ended up in front
+	std::vector<vk::Pipeline> pipelines;
+	if (prepass_active && render_mode == RenderMode::Shaded)
+	{
+		pipelines = {context->depth_prepass_pipeline, context->depth_equal_pipeline};
+	}
+	else
+	{
+		pipelines = {this->main_pipeline()};
+	}
+
+	if (!recorder)
+	{
+		cmd.beginRenderPass(rp_begin, vk::SubpassContents::eInline);
+		this->set_viewport(cmd);
+		for (const vk::Pipeline pipeline : pipelines)
+		{
+			// Packets bind their pipeline themselves, only when it changes
+			objectRenderer->setPipeline(0, pipeline);
+			objectRenderer->render(cmd, uniform, phase);
+		}
+		return;
+	}
+
+	// The pass only executes secondaries now: the object draws split across the recorder threads
+	cmd.beginRenderPass(rp_begin, vk::SubpassContents::eSecondaryCommandBuffers);
+
+	vk::CommandBufferInheritanceInfo inheritance(rp_begin.renderPass, 0, rp_begin.framebuffer);
+	inheritance.pipelineStatistics = gpu_profiler->inheritedStatistics();
+
+	for (const vk::Pipeline pipeline : pipelines)
+	{
+		// Packets bind their pipeline themselves, only when it changes
+		objectRenderer->setPipeline(0, pipeline);
+
+		const auto &secondaries = recorder->record(inheritance, objectRenderer->drawCount(), [this, phase](const vk::CommandBuffer &secondary, const uint32_t begin, const uint32_t end) {
+			this->set_viewport(secondary);
+			objectRenderer->record(secondary, uniform, begin, end, phase);
+		});
+		cmd.executeCommands(secondaries);
+	}
+}
+
+void Renderer::setDepthPrepass(const DepthPrepass mode)
+{
+	depth_prepass = mode;
+	prepass_active = mode == DepthPrepass::On;
+	prepass_decision = 0;
+
+	if (mode != DepthPrepass::Auto)
+	{
+		return;
+	}
+
+	if (!gpu_profiler->supportsStatistics())
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Automatic depth pre-pass needs pipeline statistics queries, leaving it off");
+		return;
+	}
 
-	vk::RenderPassBeginInfo rp_begin(context->render_pass, framebuffer, {{0, 0}, {context->swapchain_dimensions.width, context->swapchain_dimensions.height}},
-									 clear_values);
+	// The frames in flight may still have been recorded with the pre-pass, measure one recorded after them
+	prepass_statistics = !gpu_profiler->isStatisticsEnabled();
+	gpu_profiler->setStatisticsEnabled(true);
+	prepass_decision = gpu_profiler->statisticsCount() + context->frames_in_flight + 1;
+}
+
+void Renderer::update_depth_prepass()
+{
+	if (prepass_decision == 0 || gpu_profiler->statisticsCount() < prepass_decision)
+	{
+		return;
+	}
 
-	cmd.beginRenderPass(rp_begin, vk::SubpassContents::eInline);
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, context->pipeline);
+	// Every fragment beyond one per pixel is shaded for nothing, which is what the pre-pass saves
+	const double pixels = static_cast<double>(context->swapchain_dimensions.width) * static_cast<double>(context->swapchain_dimensions.height);
+	const double overdraw = static_cast<double>(gpu_profiler->statistics().fragment_shader_invocations) / pixels;
+	prepass_active = overdraw > AUTO_PREPASS_OVERDRAW;
+	prepass_decision = 0;
+	SDL_Log("%.2f fragments per pixel, depth pre-pass %s", overdraw, prepass_active ? "on" : "off");
 
+	if (prepass_statistics)
+	{
+		gpu_profiler->setStatisticsEnabled(false);
+		prepass_statistics = false;
+	}
+}
+
+vk::Pipeline Renderer::main_pipeline() const
+{
+	switch (render_mode)
+	{
+	case RenderMode::Overdraw:
+		return context->overdraw_pipeline;
+	case RenderMode::OverdrawDepthTested:
+		return context->overdraw_depth_pipeline;
+	default:
+		return context->pipeline;
+	}
+}
+
+void Renderer::bind_pass_state(const vk::CommandBuffer &cmd) const
+{
+	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, this->main_pipeline());
+	this->set_viewport(cmd);
+}
+
+void Renderer::set_viewport(const vk::CommandBuffer &cmd) const
+{
 	vk::Viewport vp(0.0f, 0.0f, static_cast<float>(context->swapchain_dimensions.width), static_cast<float>(context->swapchain_dimensions.height), 0.0f, 1.0f);
 	// Set viewport dynamically
 	cmd.setViewport(0, vp);
@@ -261,28 +809,139 @@ vk::CommandBuffer Renderer::onPreDraw(uint32_t &swapchain_index) {
 	const vk::Rect2D scissor({0, 0}, {context->swapchain_dimensions.width, context->swapchain_dimensions.height});
 
 	cmd.setScissor(0, scissor);
+}
+
+void Renderer::measureRecordingScaling(const uint32_t max_threads, const uint32_t draw_count)
+{
+	context->device.waitIdle();
+
+	// May run before the first frame, the draw list has to exist
+	objectRenderer->setPipeline(0, this->main_pipeline());
+	objectRenderer->prepareFrame(uniform);
 
-	objectRenderer->render(cmd, uniform);
+	// Any framebuffer of the render pass will do, nothing gets executed
+	vk::CommandBufferInheritanceInfo inheritance(context->render_pass, 0, context->swapchain_framebuffers[0]);
+	const double counter_to_ms = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+	constexpr uint32_t iterations = 8;
 
-	return cmd;
+	double single_thread_ms = 0.0;
+	for (uint32_t threads = 1; threads <= max_threads; threads++)
+	{
+		// One range per thread, the job system spreads them
+		ParallelRecorder scaling_recorder(threads, 1);
+
+		// Best of a few runs, the first one also allocates the command buffers
+		double best_ms = 1e30;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			scaling_recorder.beginFrame(0);
+
+			const uint64_t start = SDL_GetPerformanceCounter();
+			scaling_recorder.record(inheritance, draw_count, [this](const vk::CommandBuffer &secondary, const uint32_t begin, const uint32_t end) {
+				this->set_viewport(secondary);
+				objectRenderer->record(secondary, uniform, begin, end);
+			});
+			best_ms = std::min(best_ms, static_cast<double>(SDL_GetPerformanceCounter() - start) * counter_to_ms);
+		}
+
+		if (threads == 1)
+		{
+			single_thread_ms = best_ms;
+		}
+		SDL_Log("Recording %u draws on %u threads: %.3f ms, %.2fx", draw_count, threads, best_ms, single_thread_ms / best_ms);
+	}
 }
 
-void Renderer::onPostDraw(const vk::CommandBuffer &cmd, uint32_t &swapchain_index) {
+void Renderer::onPostDraw(const vk::CommandBuffer &draw_cmd, uint32_t &swapchain_index) {
+	VENT_PROFILE_ZONE("onPostDraw");
+
+	const vk::CommandBuffer cmd = context->per_frame[context->frame_index].primary_command_buffer;
+	if (recorder)
+	{
+		draw_cmd.end();
+		cmd.executeCommands(draw_cmd);
+		overlay = nullptr;
+	}
+
 	cmd.endRenderPass();
+	gpu_profiler->endStatistics(cmd);
+
+	const InstancingStats &instancing = objectRenderer->getInstancingStats();
+	stats.draws += instancing.draws;
+	stats.draws_saved += instancing.saved();
+	stats.objects_culled += objectRenderer->getCullStats().culled();
+	gpu_profiler->end(cmd, render_pass_scope);
 
+	if (context->headless && readback_requested)
+	{
+		const vk::Extent2D extent{context->swapchain_dimensions.width, context->swapchain_dimensions.height};
+		if (!readback_buffer)
+		{
+			readback_buffer = std::make_unique<VulkanVertexBuffer>(context->device, extent.width * extent.height * 4, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU);
+		}
+
+		// The render pass left the target in eTransferSrcOptimal, the copy only has to wait for the color writes
+		const vk::Image image = offscreen_images[swapchain_index]->getTexture().image;
+		const vk::ImageMemoryBarrier barrier(vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eTransferSrcOptimal,
+											 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+		const vk::BufferImageCopy region(0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0}, {extent.width, extent.height, 1});
+		cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, readback_buffer->get_handle(), region);
+
+		// Make the copy visible to the host once the timeline passes this frame
+		const vk::BufferMemoryBarrier host_barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, readback_buffer->get_handle(), 0, VK_WHOLE_SIZE);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, host_barrier, nullptr);
+
+		readback_requested = false;
+		readback_value = context->graphics_timeline_value + 1;
+	}
+
+	gpu_profiler->end(cmd, frame_scope);
 	cmd.end();
 
-	uniform->uniform_buffer_general->flush();
+	// One flush for everything written on the host this frame, skipped entirely on coherent memory.
+	VulkanVertexBuffer::flush_pending();
+
+	PerFrame &per_frame = context->per_frame[context->frame_index];
+
+	// Binary semaphores ignore their value, only the timelines read it.
+	std::vector<vk::Semaphore> wait_semaphores;
+	std::vector<vk::PipelineStageFlags> wait_stages;
+	std::vector<uint64_t> wait_values;
+
+	if (!context->headless)
+	{
+		wait_semaphores.push_back(per_frame.swapchain_acquire_semaphore);
+		wait_stages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+		wait_values.push_back(0);
+	}
+
+	// Uploads handed over from the transfer queue have to land before their acquire barrier executes.
+	if (context->pending_transfer_value > 0)
+	{
+		wait_semaphores.push_back(context->transfer_timeline);
+		wait_stages.push_back(vk::PipelineStageFlagBits::eFragmentShader);
+		wait_values.push_back(context->pending_transfer_value);
+		context->pending_transfer_value = 0;
+	}
 
-	if (!context->per_frame[swapchain_index].swapchain_release_semaphore)
+	per_frame.timeline_value = ++context->graphics_timeline_value;
+
+	std::vector<vk::Semaphore> signal_semaphores{context->graphics_timeline};
+	std::vector<uint64_t> signal_values{per_frame.timeline_value};
+
+	if (!context->headless)
 	{
-		context->per_frame[swapchain_index].swapchain_release_semaphore = context->device.createSemaphore({});
+		signal_semaphores.push_back(context->swapchain_release_semaphores[swapchain_index]);
+		signal_values.push_back(0);
 	}
 
-	const vk::PipelineStageFlags wait_stage(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+	const vk::TimelineSemaphoreSubmitInfo timeline_info(wait_values, signal_values);
+
+	vk::SubmitInfo info(wait_semaphores, wait_stages, cmd, signal_semaphores);
+	info.pNext = &timeline_info;
 
-	const vk::SubmitInfo info(context->per_frame[swapchain_index].swapchain_acquire_semaphore, wait_stage, cmd,
-							  context->per_frame[swapchain_index].swapchain_release_semaphore);
 	// Submit command buffer to graphics queue
-	context->queue.submit(info, context->per_frame[swapchain_index].queue_submit_fence);
+	context->queue.submit(info);
 }
@@ -1,6 +1,4 @@
-#include "Vulkan_Base.hpp"
-
-#include "uniform/Vulkan_3D_Unifrom.hpp"
+﻿#include "Vulkan_Base.hpp"
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -158,21 +156,25 @@ void VKBase::createInstance()
 
 	const std::vector<vk::ExtensionProperties> instance_extensions = vk::enumerateInstanceExtensionProperties();
 
-	uint32_t instanceExtensionCount;
-	if (!SDL_Vulkan_GetInstanceExtensions(window.handle, &instanceExtensionCount, nullptr))
-	{
-		SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Failed to Vulkan Instance Extensions count from SDL");
-		return;
-	}
-	const char **enabledInstanceExtensions = new const char *[instanceExtensionCount];
-	if (!SDL_Vulkan_GetInstanceExtensions(window.handle, &instanceExtensionCount, enabledInstanceExtensions))
+	std::vector<const char *> active_instance_extensions;
+
+	// Headless rendering needs no surface extensions
+	if (!context->headless)
 	{
-		SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Failed to Vulkan Instance Extensions from SDL");
-		return;
+		uint32_t instanceExtensionCount;
+		if (!SDL_Vulkan_GetInstanceExtensions(window.handle, &instanceExtensionCount, nullptr))
+		{
+			SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Failed to Vulkan Instance Extensions count from SDL");
+			return;
+		}
+		active_instance_extensions.resize(instanceExtensionCount);
+		if (!SDL_Vulkan_GetInstanceExtensions(window.handle, &instanceExtensionCount, active_instance_extensions.data()))
+		{
+			SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Failed to Vulkan Instance Extensions from SDL");
+			return;
+		}
 	}
 
-	std::vector<const char *> active_instance_extensions(enabledInstanceExtensions, enabledInstanceExtensions + instanceExtensionCount);
-
 #ifdef VALIDATION_LAYERS
 	active_instance_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
@@ -240,6 +242,36 @@ void VKBase::createInstance()
 #endif
 }
 
+/// @brief Finds a queue family which supports transfers but not graphics, preferring one without compute as well.
+/// @return The queue family index, or -1 if the device only exposes transfers on graphics capable families.
+static int32_t find_transfer_queue_family(const std::vector<vk::QueueFamilyProperties2> &queue_family_properties)
+{
+	int32_t transfer_index = -1;
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(queue_family_properties.size()); i++)
+	{
+		const vk::QueueFlags flags = queue_family_properties[i].queueFamilyProperties.queueFlags;
+
+		if (!(flags & vk::QueueFlagBits::eTransfer) || (flags & vk::QueueFlagBits::eGraphics))
+		{
+			continue;
+		}
+
+		// A pure DMA queue is what we are after, async compute queues are only a fallback.
+		if (!(flags & vk::QueueFlagBits::eCompute))
+		{
+			return static_cast<int32_t>(i);
+		}
+
+		if (transfer_index < 0)
+		{
+			transfer_index = static_cast<int32_t>(i);
+		}
+	}
+
+	return transfer_index;
+}
+
 void VKBase::selectPhysicalDevice()
 {
 	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Selecting Physical GPU");
@@ -256,17 +288,21 @@ void VKBase::selectPhysicalDevice()
 			throw std::runtime_error("No queue family found.");
 		}
 
-		if (context->surface)
+		if (!context->headless)
 		{
-			context->instance.destroySurfaceKHR(context->surface);
+			if (context->surface)
+			{
+				context->instance.destroySurfaceKHR(context->surface);
+			}
+			context->surface = window.createSurface(context->instance);
+			if (!context->surface)
+				throw std::runtime_error("Failed to create window surface.");
 		}
-		context->surface = window.createSurface(context->instance);
-		if (!context->surface)
-			throw std::runtime_error("Failed to create window surface.");
 
 		for (uint32_t j = 0; j < static_cast<uint32_t>(queue_family_properties.size()); j++)
 		{
-			vk::Bool32 supports_present = context->gpu.getSurfaceSupportKHR(j, context->surface);
+			// Without a surface any graphics queue will do
+			vk::Bool32 supports_present = context->headless || context->gpu.getSurfaceSupportKHR(j, context->surface);
 
 			// Find a queue family which supports graphics and presentation.
 			if ((queue_family_properties[j].queueFamilyProperties.queueFlags & vk::QueueFlagBits::eGraphics) && supports_present)
@@ -275,12 +311,22 @@ void VKBase::selectPhysicalDevice()
 				break;
 			}
 		}
+
+		if (context->graphics_queue_index >= 0)
+		{
+			context->transfer_queue_index = find_transfer_queue_family(queue_family_properties);
+		}
 	}
 
 	if (context->graphics_queue_index < 0)
 	{
 		SDL_LogCritical(SDL_LOG_CATEGORY_RENDER, "Did not find suitable queue which supports graphics and presentation.");
 	}
+
+	if (context->transfer_queue_index >= 0)
+	{
+		SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Using dedicated transfer queue family %d for uploads", context->transfer_queue_index);
+	}
 }
 
 void VKBase::createDevice(const std::vector<const char *> &required_device_extensions)
@@ -301,12 +347,56 @@ void VKBase::createDevice(const std::vector<const char *> &required_device_exten
 		features.samplerAnisotropy = true;
 	}
 
+	// Optional, only used by the pipeline statistics instrumentation
+	context->pipeline_statistics_query = context->gpu.getFeatures().pipelineStatisticsQuery;
+	features.pipelineStatisticsQuery = context->pipeline_statistics_query;
+
+	// Optional, indirect draws fall back to fewer commands per call or to direct draws
+	context->multi_draw_indirect = context->gpu.getFeatures().multiDrawIndirect;
+	features.multiDrawIndirect = context->multi_draw_indirect;
+	context->draw_indirect_first_instance = context->gpu.getFeatures().drawIndirectFirstInstance;
+	features.drawIndirectFirstInstance = context->draw_indirect_first_instance;
+
 	float queue_priority = 1.0f;
 
-	// Create one queue
-	vk::DeviceQueueCreateInfo queue_info({}, context->graphics_queue_index, 1, &queue_priority);
+	// Create one graphics queue and, if the device has one, one transfer queue for uploads
+	std::vector<vk::DeviceQueueCreateInfo> queue_infos;
+	queue_infos.emplace_back(vk::DeviceQueueCreateFlags{}, context->graphics_queue_index, 1, &queue_priority);
+
+	if (context->transfer_queue_index >= 0)
+	{
+		queue_infos.emplace_back(vk::DeviceQueueCreateFlags{}, context->transfer_queue_index, 1, &queue_priority);
+	}
+
+	// Frame synchronization is built on timeline semaphores (core in Vulkan 1.2)
+	const auto supported_features = context->gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceVulkan13Features>();
+	if (!supported_features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore)
+	{
+		throw std::runtime_error("Device does not support timeline semaphores.");
+	}
 
-	const vk::DeviceCreateInfo device_info({}, queue_info, {}, required_device_extensions, &features);
+	vk::PhysicalDeviceVulkan12Features features12;
+	features12.timelineSemaphore = true;
+
+	// Lets the GPU profiler reset its query pools from the host
+	context->host_query_reset = supported_features.get<vk::PhysicalDeviceVulkan12Features>().hostQueryReset;
+	features12.hostQueryReset = context->host_query_reset;
+
+	context->draw_indirect_count = supported_features.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+	features12.drawIndirectCount = context->draw_indirect_count;
+
+	// The render graph records its barriers with vkCmdPipelineBarrier2 (core in Vulkan 1.3)
+	if (!supported_features.get<vk::PhysicalDeviceVulkan13Features>().synchronization2)
+	{
+		throw std::runtime_error("Device does not support synchronization2.");
+	}
+
+	vk::PhysicalDeviceVulkan13Features features13;
+	features13.synchronization2 = true;
+	features12.pNext = &features13;
+
+	vk::DeviceCreateInfo device_info({}, queue_infos, {}, required_device_extensions, &features);
+	device_info.pNext = &features12;
 
 	vkAssert(context->gpu.createDevice(&device_info, {}, &context->device), "Failed to Create Vulkan Device");
 	// initialize function pointers for device
@@ -317,6 +407,11 @@ void VKBase::createDevice(const std::vector<const char *> &required_device_exten
 #endif
 
 	context->queue = context->device.getQueue(context->graphics_queue_index, 0);
+
+	if (context->transfer_queue_index >= 0)
+	{
+		context->transfer_queue = context->device.getQueue(context->transfer_queue_index, 0);
+	}
 }
 
 void VKBase::createAllocator()
@@ -343,56 +438,138 @@ void VKBase::createCommandPool()
 {
 	vk::CommandPoolCreateInfo cmd_pool_info(vk::CommandPoolCreateFlagBits::eTransient, context->graphics_queue_index);
 	vkAssert(context->device.createCommandPool(&cmd_pool_info,{}, &context->command_pool), "Failed to create Command Pool");
+
+	if (context->transfer_queue_index >= 0)
+	{
+		vk::CommandPoolCreateInfo transfer_pool_info(vk::CommandPoolCreateFlagBits::eTransient, context->transfer_queue_index);
+		vkAssert(context->device.createCommandPool(&transfer_pool_info, {}, &context->transfer_command_pool), "Failed to create Transfer Command Pool");
+	}
 }
 
 void VKBase::createDescriptorPool()
 {
-	const std::array<vk::DescriptorPoolSize, 2> pool_sizes = {{{vk::DescriptorType::eUniformBuffer, 1000}, {vk::DescriptorType::eCombinedImageSampler, 1000}}};
+	const std::array<vk::DescriptorPoolSize, 4> pool_sizes = {{{vk::DescriptorType::eUniformBuffer, 1000}, {vk::DescriptorType::eStorageBuffer, 1000}, {vk::DescriptorType::eCombinedImageSampler, 1000},
+															   {vk::DescriptorType::eStorageImage, 100}}};
 
-	const vk::DescriptorPoolCreateInfo descriptor_pool_create_info({}, 2, pool_sizes);
+	const vk::DescriptorPoolCreateInfo descriptor_pool_create_info({}, 1000, pool_sizes);
 
 	vkAssert(context->device.createDescriptorPool(&descriptor_pool_create_info,{}, &context->descriptor_pool), "Failed to create DescriptorPool");
 }
 
 void VKBase::createDescriptorSetLayoutBinding()
 {
-	const std::array<vk::DescriptorSetLayoutBinding, 2> set_layout_bindings = {
-		{{0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex},
-		 {1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment}}};
+	// Set 0 is bound once per frame, every instance picks its record out of the object buffer through the instance buffer
+	const std::array<vk::DescriptorSetLayoutBinding, 3> frame_bindings = {
+		{{0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment},
+		 {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex},
+		 {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex}}};
+
+	vk::DescriptorSetLayoutCreateInfo frame_layout({}, frame_bindings);
+
+	context->frame_descriptor_set_layout = context->device.createDescriptorSetLayout(frame_layout);
+
+	// Set 1 only changes with the material
+	const std::array<vk::DescriptorSetLayoutBinding, 1> material_bindings = {
+		{{0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment}}};
 
-	vk::DescriptorSetLayoutCreateInfo descriptor_layout({}, set_layout_bindings);
+	vk::DescriptorSetLayoutCreateInfo material_layout({}, material_bindings);
 
-	context->descriptor_set_layout = context->device.createDescriptorSetLayout(descriptor_layout);
+	context->descriptor_set_layout = context->device.createDescriptorSetLayout(material_layout);
 
-	vk::PushConstantRange pushConstant(vk::ShaderStageFlagBits::eVertex, 0, sizeof(Ubo));
+	const std::array<vk::DescriptorSetLayout, 2> set_layouts = {context->frame_descriptor_set_layout, context->descriptor_set_layout};
 
 #if defined(ANDROID)
-	vk::PipelineLayoutCreateInfo pipeline_layout_create_info({}, 1, &context->descriptor_set_layout, pushConstant);
+	vk::PipelineLayoutCreateInfo pipeline_layout_create_info({}, static_cast<uint32_t>(set_layouts.size()), set_layouts.data());
 #else
-	vk::PipelineLayoutCreateInfo pipeline_layout_create_info({}, context->descriptor_set_layout, pushConstant);
+	vk::PipelineLayoutCreateInfo pipeline_layout_create_info({}, set_layouts);
 #endif
 
 	vkAssert(context->device.createPipelineLayout(&pipeline_layout_create_info, 0,context->pipeline_layout), "Failed to create Pipeline Layout");
 }
 
+void VKBase::createTimelines()
+{
+	context->graphics_timeline = create_timeline_semaphore();
+	context->graphics_timeline_value = 0;
+
+	if (context->transfer_queue_index >= 0)
+	{
+		context->transfer_timeline = create_timeline_semaphore();
+		context->transfer_timeline_value = 0;
+	}
+}
+
+vk::Semaphore create_timeline_semaphore()
+{
+	vk::SemaphoreTypeCreateInfo type_info(vk::SemaphoreType::eTimeline, 0);
+
+	vk::SemaphoreCreateInfo info;
+	info.pNext = &type_info;
+
+	return context->device.createSemaphore(info);
+}
+
+void wait_timeline(const vk::Semaphore &timeline, const uint64_t value)
+{
+	const vk::SemaphoreWaitInfo wait_info({}, timeline, value);
+	vkAssert(context->device.waitSemaphores(wait_info, UINT64_MAX), "Failed to wait on timeline semaphore");
+}
+
+void retire_resource(std::function<void()> destroy)
+{
+	// The frame being recorded may still use it, and it signals the next value
+	context->retired_resources.emplace_back(context->graphics_timeline_value + 1, std::move(destroy));
+}
+
+void release_retired_resources(const bool force)
+{
+	if (context->retired_resources.empty())
+	{
+		return;
+	}
+
+	// Retired in submission order, so everything behind the first pending entry is pending as well
+	const uint64_t completed = force ? UINT64_MAX : context->device.getSemaphoreCounterValue(context->graphics_timeline);
+	while (!context->retired_resources.empty() && context->retired_resources.front().first <= completed)
+	{
+		context->retired_resources.front().second();
+		context->retired_resources.pop_front();
+	}
+}
+
 void VKBase::initVulkan()
 {
+	context->headless = window.isHeadless();
+
 	this->createInstance();
 	this->selectPhysicalDevice();
 
 	context->swapchain_dimensions.width = window.width;
 	context->swapchain_dimensions.height = window.height;
 
-	this->createDevice({VK_KHR_SWAPCHAIN_EXTENSION_NAME});
+	if (context->headless)
+	{
+		// Offscreen color target format, UNORM so readbacks hold the values the shaders wrote
+		context->swapchain_dimensions.format = vk::Format::eR8G8B8A8Unorm;
+		this->createDevice({});
+	}
+	else
+	{
+		this->createDevice({VK_KHR_SWAPCHAIN_EXTENSION_NAME});
+	}
 	this->createAllocator();
 	this->createCommandPool();
 	this->createDescriptorPool();
 	this->createDescriptorSetLayoutBinding();
 	this->createDepthFormat();
+	this->createTimelines();
 }
 
 void VKBase::shutdownVulkan()
 {
+	// Deferred destroys may hand command buffers back to the pools
+	release_retired_resources(true);
+
 	if (context->descriptor_pool)
 	{
 		context->device.destroyDescriptorPool(context->descriptor_pool);
@@ -403,6 +580,23 @@ void VKBase::shutdownVulkan()
 		context->device.destroyCommandPool(context->command_pool);
 	}
 
+	if (context->transfer_command_pool)
+	{
+		context->device.destroyCommandPool(context->transfer_command_pool);
+	}
+
+	if (context->graphics_timeline)
+	{
+		context->device.destroySemaphore(context->graphics_timeline);
+		context->graphics_timeline = nullptr;
+	}
+
+	if (context->transfer_timeline)
+	{
+		context->device.destroySemaphore(context->transfer_timeline);
+		context->transfer_timeline = nullptr;
+	}
+
 	if (context->memory_allocator)
 	{
 		VmaTotalStatistics stats;
@@ -424,6 +618,12 @@ void VKBase::shutdownVulkan()
 		context->descriptor_set_layout = nullptr;
 	}
 
+	if (context->frame_descriptor_set_layout)
+	{
+		context->device.destroyDescriptorSetLayout(context->frame_descriptor_set_layout);
+		context->frame_descriptor_set_layout = nullptr;
+	}
+
 	if (context->pipeline_layout)
 	{
 		context->device.destroyPipelineLayout(context->pipeline_layout);
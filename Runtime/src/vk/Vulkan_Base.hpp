@@ -10,6 +10,8 @@
 #include <glm/glm.hpp>
 
 #include <cassert>
+#include <deque>
+#include <functional>
 #include <vector>
 
 #ifndef NDEBUG
@@ -62,7 +64,40 @@ const std::string to_string(vk::Result result)
     }
 }
 
-struct Ubo;
+/// Push constants of cull.comp.glsl and cull_occlusion.comp.glsl, all of the 128 bytes every device guarantees.
+struct CullPushConstants
+{
+    /// Frustum planes, xyz normal pointing inwards and w distance
+    glm::vec4 planes[6];
+
+    uint32_t instance_count = 0;
+    uint32_t batch_count = 0;
+
+    /// 0 culls instances, 1 writes the draw commands of the batches
+    uint32_t pass = 0;
+
+    /// Whether pass 1 compacts each run's commands and counts them, needs drawIndirectCount
+    uint32_t compact = 0;
+
+    /// Occlusion culling only: 0 early, 1 late. Each phase has its own region of the instance, command and count buffers.
+    uint32_t phase = 0;
+    uint32_t run_count = 0;
+
+    /// Size of the Hi-Z pyramid's level 0
+    uint32_t pyramid_width = 0;
+    uint32_t pyramid_height = 0;
+};
+
+static_assert(sizeof(CullPushConstants) == 128, "CullPushConstants has to fit the guaranteed push constant size");
+
+/// Push constants of hiz.comp.glsl, the level read and the level written
+struct HiZPushConstants
+{
+    uint32_t source_width = 0;
+    uint32_t source_height = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
 
 struct Vertex
 {
@@ -103,11 +138,14 @@ struct SwapchainDimensions
     vk::Format format = vk::Format::eUndefined;
 };
 
+/// Resources of one frame in flight. There are VulkanContext::frames_in_flight of these, independent of
+/// the swapchain image count, so the CPU runs at most that many frames ahead of the GPU.
 struct PerFrame
 {
     vk::Device device;
 
-    vk::Fence queue_submit_fence;
+    /// Graphics timeline value signalled by this frame's submit, 0 before its first use.
+    uint64_t timeline_value = 0;
 
     vk::CommandPool primary_command_pool;
 
@@ -115,11 +153,39 @@ struct PerFrame
 
     vk::Semaphore swapchain_acquire_semaphore;
 
-    vk::Semaphore swapchain_release_semaphore;
+    /// Swapchain image this frame renders to, valid between acquire and present.
+    uint32_t swapchain_index = 0;
+
+    /// Performance counter when the CPU started the frame, used to measure its latency.
+    uint64_t start_counter = 0;
 
     int32_t queue_index;
 };
 
+/// Frame pacing numbers, accumulated per frame and reported on shutdown.
+struct FrameStats
+{
+    uint64_t frames = 0;
+
+    /// Time between two frame starts on the CPU.
+    double frame_time_ms = 0.0;
+
+    /// Time from the CPU starting a frame until the timeline was seen past its value.
+    double latency_ms = 0.0;
+
+    /// Time the CPU blocked on the timeline before reusing a frame slot.
+    double timeline_wait_ms = 0.0;
+
+    /// Object draw calls issued, and the ones instancing saved.
+    uint64_t draws = 0;
+    uint64_t draws_saved = 0;
+
+    /// Objects the CPU frustum test dropped before the draw list was built.
+    uint64_t objects_culled = 0;
+};
+
+class GpuProfiler;
+
 struct VulkanContext
 {
     /// The Vulkan instance.
@@ -140,12 +206,27 @@ struct VulkanContext
     /// The swapchain dimensions.
     SwapchainDimensions swapchain_dimensions;
 
+    /// The present mode asked for, createSwapchain falls back if the surface does not support it.
+    vk::PresentModeKHR requested_present_mode = vk::PresentModeKHR::eFifo;
+
+    /// The present mode the current swapchain was created with.
+    vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+
     /// The surface we will render to.
     vk::SurfaceKHR surface;
 
+    /// Rendering into offscreen images, there is no surface or swapchain.
+    bool headless = false;
+
     /// The queue family index where graphics work will be submitted.
     int32_t graphics_queue_index = -1;
 
+    /// The dedicated transfer queue, only valid if transfer_queue_index is not -1.
+    vk::Queue transfer_queue;
+
+    /// The queue family index of a transfer-only queue, -1 if uploads have to go through the graphics queue.
+    int32_t transfer_queue_index = -1;
+
     /// The image view for each swapchain image.
     std::vector<vk::ImageView> swapchain_image_views;
 
@@ -155,26 +236,110 @@ struct VulkanContext
     /// The renderpass description.
     vk::RenderPass render_pass;
 
+    /// Keep the depth attachment after the main pass instead of discarding it, for the Hi-Z pyramid.
+    /// Set before createRenderPass.
+    bool keep_depth = false;
+
+    /// With keep_depth, the main pass split around the Hi-Z build: the early pass clears and stores both
+    /// attachments, the late pass loads them. Both are compatible with render_pass and share its framebuffers.
+    vk::RenderPass early_render_pass;
+    vk::RenderPass late_render_pass;
+
     vk::CommandPool command_pool;
 
+    vk::CommandPool transfer_command_pool;
+
+    /// Queue family ownership acquires for uploads finished on the transfer queue, recorded by the next frame.
+    std::vector<vk::ImageMemoryBarrier> pending_acquire_barriers;
+
+    /// Timeline semaphore signalled by every graphics queue submit, graphics and compute work alike.
+    /// Its value is the frame counter: everything submitted before value N is done once it reads N.
+    vk::Semaphore graphics_timeline;
+
+    /// Last value signalled on graphics_timeline.
+    uint64_t graphics_timeline_value = 0;
+
+    /// Timeline semaphore signalled by the transfer queue. Timelines can't be shared across queues,
+    /// as signals have to increase in execution order, so the graphics submits wait on this one.
+    vk::Semaphore transfer_timeline;
+
+    /// Last value signalled on transfer_timeline.
+    uint64_t transfer_timeline_value = 0;
+
+    /// transfer_timeline value the next graphics submit has to wait for, 0 if there is nothing to wait on.
+    uint64_t pending_transfer_value = 0;
+
+    /// Whether query pools can be reset with vkResetQueryPool from the host.
+    bool host_query_reset = false;
+
+    /// Whether the pipelineStatisticsQuery feature is enabled.
+    bool pipeline_statistics_query = false;
+
+    /// Indirect draw features: several commands per call, a GPU-side draw count, and a non-zero firstInstance
+    /// in the commands. Indirect submission needs at least the last one.
+    bool multi_draw_indirect = false;
+    bool draw_indirect_count = false;
+    bool draw_indirect_first_instance = false;
+
+    /// GPU timestamp profiler of the renderer, null while there is none. Lets uploads time themselves.
+    GpuProfiler *gpu_profiler = nullptr;
+
+    /// Destroy callbacks waiting for the graphics timeline to pass the paired value.
+    std::deque<std::pair<uint64_t, std::function<void()>>> retired_resources;
+
     /// The graphics pipeline.
     vk::Pipeline pipeline;
 
+    /// Debug overdraw variants of the graphics pipeline, with and without depth testing.
+    vk::Pipeline overdraw_pipeline;
+    vk::Pipeline overdraw_depth_pipeline;
+
+    /// Depth pre-pass: the position-only depth pipeline, and the graphics pipeline variant shading after it
+    /// without writing depth.
+    vk::Pipeline depth_prepass_pipeline;
+    vk::Pipeline depth_equal_pipeline;
+
     vk::PipelineLayout pipeline_layout;
 
+    /// Frustum culling compute pipeline, its layout and its per-frame set layout, see cull.comp.glsl.
+    vk::Pipeline cull_pipeline;
+    vk::PipelineLayout cull_pipeline_layout;
+    vk::DescriptorSetLayout cull_descriptor_set_layout;
+
+    /// Two-phase occlusion culling variant of the cull pipeline, set 1 adds the visibility history, camera and Hi-Z
+    /// pyramid. See cull_occlusion.comp.glsl.
+    vk::Pipeline occlusion_cull_pipeline;
+    vk::PipelineLayout occlusion_cull_pipeline_layout;
+    vk::DescriptorSetLayout occlusion_descriptor_set_layout;
+
+    /// Hi-Z pyramid reduction, one set per level: the level read and the level written. See hiz.comp.glsl.
+    vk::Pipeline hiz_pipeline;
+    vk::PipelineLayout hiz_pipeline_layout;
+    vk::DescriptorSetLayout hiz_descriptor_set_layout;
+
     /// The debug report callback.
     vk::DebugReportCallbackEXT debug_callback;
 
-    /// A set of semaphores that can be reused.
-    std::vector<vk::Semaphore> recycled_semaphores;
+    /// One release semaphore per swapchain image, signalled by the submit rendering to it and waited on by present.
+    std::vector<vk::Semaphore> swapchain_release_semaphores;
 
-    /// A set of per-frame data.
+    /// Number of frames the CPU may record ahead of the GPU.
+    uint32_t frames_in_flight = 2;
+
+    /// The frame in flight currently recorded, cycles through [0, frames_in_flight).
+    uint32_t frame_index = 0;
+
+    /// A set of per-frame data, one per frame in flight.
     std::vector<PerFrame> per_frame;
 
     VmaAllocator memory_allocator{VK_NULL_HANDLE};
 
     vk::DescriptorPool descriptor_pool;
 
+    /// Layout of the per-frame set 0: camera uniform buffer and object storage buffer.
+    vk::DescriptorSetLayout frame_descriptor_set_layout;
+
+    /// Layout of the per-material set 1: the texture sampler.
     vk::DescriptorSetLayout descriptor_set_layout;
 
     vk::Format depthFormat;
@@ -182,6 +347,18 @@ struct VulkanContext
 
 extern VulkanContext *context;
 
+/// Creates a timeline semaphore starting at 0.
+vk::Semaphore create_timeline_semaphore();
+
+/// Blocks the host until the timeline semaphore reaches value.
+void wait_timeline(const vk::Semaphore &timeline, uint64_t value);
+
+/// Defers destroy until the GPU finished everything submitted to the graphics queue so far, and the frame being recorded.
+void retire_resource(std::function<void()> destroy);
+
+/// Runs the deferred destroys whose work completed, or all of them if force is set (device idle).
+void release_retired_resources(bool force = false);
+
 class VKBase
 {
 private:
@@ -204,6 +381,8 @@ private:
 
     void createDepthFormat();
 
+    void createTimelines();
+
     [[nodiscard]] bool is_extension_supported(std::string const &requested_extension) const;
 
     vk::ShaderModule load_shader_module(const std::string_view &filename);
@@ -219,12 +398,34 @@ public:
 
     void teardown_per_frame(PerFrame &per_frame);
 
+    /// Creates context->frames_in_flight frame slots, they outlive swapchain recreation.
+    void createFrames(uint32_t frames_in_flight);
+
+    void destroyFrames();
+
     void createSwapchain();
 
     void createRenderPass();
 
     void createPipeline(const std::string_view &vertexShaderFilename, const std::string_view &fragmentShaderFilename);
 
+    /// Additive overdraw visualization variants of createPipeline, fragmentShaderFilename outputs one fragment's weight.
+    void createOverdrawPipelines(const std::string_view &vertexShaderFilename, const std::string_view &fragmentShaderFilename);
+
+    /// Creates context->depth_prepass_pipeline from the position-only depthShaderFilename, and context->depth_equal_pipeline
+    /// from the shaders of createPipeline.
+    void createDepthPrepassPipelines(const std::string_view &depthShaderFilename, const std::string_view &vertexShaderFilename,
+                                     const std::string_view &fragmentShaderFilename);
+
+    /// Creates a compute pipeline from one shader, the caller owns it.
+    vk::Pipeline createComputePipeline(const std::string_view &computeShaderFilename, const vk::PipelineLayout &layout);
+
+    /// Creates context->cull_pipeline with its layouts: six storage buffers in set 0 and CullPushConstants.
+    void createCullPipeline(const std::string_view &computeShaderFilename);
+
+    /// Creates the occlusion cull and Hi-Z pipelines with their layouts, after createCullPipeline.
+    void createOcclusionPipelines(const std::string_view &cullShaderFilename, const std::string_view &pyramidShaderFilename);
+
     void destroyRenderpass();
 
     void destroySwapchain();
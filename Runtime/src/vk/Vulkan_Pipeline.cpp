@@ -23,11 +23,18 @@ vk::ShaderModule VKBase::load_shader_module(const std::string_view &filename)
 	return context->device.createShaderModule(createInfo);
 }
 
-void VKBase::createPipeline(const std::string_view &vertexShaderFilename, const std::string_view &fragmentShaderFilename)
+/// Builds a graphics pipeline for the model vertex layout. Only the shaders, depth and blend state differ between variants.
+/// Without a fragment shader only the position attribute is read, for depth-only pipelines.
+static vk::Pipeline build_pipeline(const vk::ShaderModule vertex, const vk::ShaderModule fragment, const vk::PipelineDepthStencilStateCreateInfo &depth_stencil,
+								   const vk::PipelineColorBlendAttachmentState &blend_attachment)
 {
 	auto bindingDescriptions = Vertex::getBindingDescription();
 	auto attributeDescriptions = Vertex::getAttributeDescriptions();
 	vk::PipelineVertexInputStateCreateInfo vertex_input({}, bindingDescriptions, attributeDescriptions);
+	if (!fragment)
+	{
+		vertex_input.vertexAttributeDescriptionCount = 1;
+	}
 
 	const vk::PipelineInputAssemblyStateCreateInfo input_assembly({}, vk::PrimitiveTopology::eTriangleList);
 
@@ -37,18 +44,8 @@ void VKBase::createPipeline(const std::string_view &vertexShaderFilename, const
 	raster.frontFace = vk::FrontFace::eClockwise;
 	raster.lineWidth = 1.0f;
 
-	// vulkan pipeline color blend state
-	vk::PipelineColorBlendAttachmentState blend_attachment;
-	blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-
 	vk::PipelineViewportStateCreateInfo viewport({}, 1, nullptr, 1, nullptr);
 
-	// Disable all depth testing.
-	vk::PipelineDepthStencilStateCreateInfo depth_stencil;
-	depth_stencil.depthTestEnable = true;
-	depth_stencil.depthWriteEnable = true;
-	depth_stencil.depthCompareOp = vk::CompareOp::eGreater;
-
 	vk::PipelineMultisampleStateCreateInfo multisample({}, vk::SampleCountFlagBits::e1);
 
 	// vulkan pipeline color blend state
@@ -60,10 +57,11 @@ void VKBase::createPipeline(const std::string_view &vertexShaderFilename, const
 	const vk::PipelineDynamicStateCreateInfo dynamic({}, dynamics);
 
 	const std::array<vk::PipelineShaderStageCreateInfo, 2> shader_stages{
-		vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, load_shader_module(vertexShaderFilename), "main"),
-		vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, load_shader_module(fragmentShaderFilename), "main")};
+		vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertex, "main"),
+		vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragment, "main")};
 
 	vk::GraphicsPipelineCreateInfo pipe({}, shader_stages);
+	pipe.stageCount = fragment ? 2 : 1;
 	pipe.pVertexInputState = &vertex_input;
 	pipe.pInputAssemblyState = &input_assembly;
 	pipe.pRasterizationState = &raster;
@@ -77,19 +75,185 @@ void VKBase::createPipeline(const std::string_view &vertexShaderFilename, const
 	pipe.renderPass = context->render_pass;
 	pipe.layout = context->pipeline_layout;
 
-	context->pipeline = context->device.createGraphicsPipeline(nullptr, pipe).value;
+	return context->device.createGraphicsPipeline(nullptr, pipe).value;
+}
+
+void VKBase::createPipeline(const std::string_view &vertexShaderFilename, const std::string_view &fragmentShaderFilename)
+{
+	// vulkan pipeline color blend state
+	vk::PipelineColorBlendAttachmentState blend_attachment;
+	blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+
+	// Reverse-Z depth testing.
+	vk::PipelineDepthStencilStateCreateInfo depth_stencil;
+	depth_stencil.depthTestEnable = true;
+	depth_stencil.depthWriteEnable = true;
+	depth_stencil.depthCompareOp = vk::CompareOp::eGreater;
+
+	const vk::ShaderModule vertex = load_shader_module(vertexShaderFilename);
+	const vk::ShaderModule fragment = load_shader_module(fragmentShaderFilename);
+
+	context->pipeline = build_pipeline(vertex, fragment, depth_stencil, blend_attachment);
 
 	// Pipeline is baked, we can delete the shader modules now.
-	context->device.destroyShaderModule(shader_stages[0].module);
-	context->device.destroyShaderModule(shader_stages[1].module);
+	context->device.destroyShaderModule(vertex);
+	context->device.destroyShaderModule(fragment);
+}
+
+void VKBase::createOverdrawPipelines(const std::string_view &vertexShaderFilename, const std::string_view &fragmentShaderFilename)
+{
+	// Every fragment adds its constant color on top, so the brightness counts the fragments per pixel
+	vk::PipelineColorBlendAttachmentState blend_attachment;
+	blend_attachment.blendEnable = true;
+	blend_attachment.srcColorBlendFactor = vk::BlendFactor::eOne;
+	blend_attachment.dstColorBlendFactor = vk::BlendFactor::eOne;
+	blend_attachment.colorBlendOp = vk::BlendOp::eAdd;
+	blend_attachment.srcAlphaBlendFactor = vk::BlendFactor::eZero;
+	blend_attachment.dstAlphaBlendFactor = vk::BlendFactor::eOne;
+	blend_attachment.alphaBlendOp = vk::BlendOp::eAdd;
+	blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+
+	const vk::ShaderModule vertex = load_shader_module(vertexShaderFilename);
+	const vk::ShaderModule fragment = load_shader_module(fragmentShaderFilename);
 
+	// Every rasterized fragment, regardless of depth
+	vk::PipelineDepthStencilStateCreateInfo depth_stencil;
+	depth_stencil.depthTestEnable = false;
+	depth_stencil.depthWriteEnable = false;
+	context->overdraw_pipeline = build_pipeline(vertex, fragment, depth_stencil, blend_attachment);
+
+	// Only fragments passing the depth test in submission order, the fragments the shaded pipeline actually shades
+	depth_stencil.depthTestEnable = true;
+	depth_stencil.depthWriteEnable = true;
+	depth_stencil.depthCompareOp = vk::CompareOp::eGreater;
+	context->overdraw_depth_pipeline = build_pipeline(vertex, fragment, depth_stencil, blend_attachment);
+
+	context->device.destroyShaderModule(vertex);
+	context->device.destroyShaderModule(fragment);
+}
+
+void VKBase::createDepthPrepassPipelines(const std::string_view &depthShaderFilename, const std::string_view &vertexShaderFilename,
+										 const std::string_view &fragmentShaderFilename)
+{
+	// Depth only, the color attachment stays untouched
+	vk::PipelineColorBlendAttachmentState blend_attachment;
+	blend_attachment.colorWriteMask = {};
+
+	vk::PipelineDepthStencilStateCreateInfo depth_stencil;
+	depth_stencil.depthTestEnable = true;
+	depth_stencil.depthWriteEnable = true;
+	depth_stencil.depthCompareOp = vk::CompareOp::eGreater;
+
+	const vk::ShaderModule depth = load_shader_module(depthShaderFilename);
+	context->depth_prepass_pipeline = build_pipeline(depth, nullptr, depth_stencil, blend_attachment);
+	context->device.destroyShaderModule(depth);
+
+	// The shaded pass after it: the depth buffer already holds the nearest depth, only the fragments at exactly
+	// that depth pass. Reverse-Z, so greater-or-equal instead of equal, which is the same test here.
+	blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+	depth_stencil.depthWriteEnable = false;
+	depth_stencil.depthCompareOp = vk::CompareOp::eGreaterOrEqual;
+
+	const vk::ShaderModule vertex = load_shader_module(vertexShaderFilename);
+	const vk::ShaderModule fragment = load_shader_module(fragmentShaderFilename);
+	context->depth_equal_pipeline = build_pipeline(vertex, fragment, depth_stencil, blend_attachment);
+
+	context->device.destroyShaderModule(vertex);
+	context->device.destroyShaderModule(fragment);
+}
+
+vk::Pipeline VKBase::createComputePipeline(const std::string_view &computeShaderFilename, const vk::PipelineLayout &layout)
+{
+	const vk::ShaderModule compute = load_shader_module(computeShaderFilename);
+
+	const vk::PipelineShaderStageCreateInfo stage({}, vk::ShaderStageFlagBits::eCompute, compute, "main");
+	const vk::ComputePipelineCreateInfo pipe({}, stage, layout);
+
+	const vk::Pipeline pipeline = context->device.createComputePipeline(nullptr, pipe).value;
+
+	context->device.destroyShaderModule(compute);
+	return pipeline;
+}
+
+void VKBase::createCullPipeline(const std::string_view &computeShaderFilename)
+{
+	// Objects, cull instances, batches, visible instances, indirect commands and draw counts
+	std::array<vk::DescriptorSetLayoutBinding, 6> bindings;
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i] = vk::DescriptorSetLayoutBinding(i, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	const vk::DescriptorSetLayoutCreateInfo set_layout({}, bindings);
+	context->cull_descriptor_set_layout = context->device.createDescriptorSetLayout(set_layout);
+
+	const vk::PushConstantRange push_constant(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants));
+	const vk::PipelineLayoutCreateInfo layout({}, context->cull_descriptor_set_layout, push_constant);
+	context->cull_pipeline_layout = context->device.createPipelineLayout(layout);
+
+	context->cull_pipeline = this->createComputePipeline(computeShaderFilename, context->cull_pipeline_layout);
+}
+
+void VKBase::createOcclusionPipelines(const std::string_view &cullShaderFilename, const std::string_view &pyramidShaderFilename)
+{
+	// Set 1 of the occlusion cull: visibility history, camera and the Hi-Z pyramid
+	const std::array<vk::DescriptorSetLayoutBinding, 3> occlusion_bindings = {
+		{{0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+		 {1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+		 {2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute}}};
+
+	const vk::DescriptorSetLayoutCreateInfo occlusion_layout({}, occlusion_bindings);
+	context->occlusion_descriptor_set_layout = context->device.createDescriptorSetLayout(occlusion_layout);
+
+	const std::array<vk::DescriptorSetLayout, 2> cull_set_layouts = {context->cull_descriptor_set_layout, context->occlusion_descriptor_set_layout};
+	const vk::PushConstantRange cull_push_constant(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants));
+	const vk::PipelineLayoutCreateInfo cull_layout({}, cull_set_layouts, cull_push_constant);
+	context->occlusion_cull_pipeline_layout = context->device.createPipelineLayout(cull_layout);
+
+	context->occlusion_cull_pipeline = this->createComputePipeline(cullShaderFilename, context->occlusion_cull_pipeline_layout);
+
+	// The level read and the level written
+	const std::array<vk::DescriptorSetLayoutBinding, 2> pyramid_bindings = {
+		{{0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute},
+		 {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}}};
+
+	const vk::DescriptorSetLayoutCreateInfo pyramid_layout({}, pyramid_bindings);
+	context->hiz_descriptor_set_layout = context->device.createDescriptorSetLayout(pyramid_layout);
+
+	const vk::PushConstantRange pyramid_push_constant(vk::ShaderStageFlagBits::eCompute, 0, sizeof(HiZPushConstants));
+	const vk::PipelineLayoutCreateInfo layout({}, context->hiz_descriptor_set_layout, pyramid_push_constant);
+	context->hiz_pipeline_layout = context->device.createPipelineLayout(layout);
+
+	context->hiz_pipeline = this->createComputePipeline(pyramidShaderFilename, context->hiz_pipeline_layout);
 }
 
 void VKBase::destroyPipeline()
 {
-	if (context->pipeline)
+	for (vk::Pipeline *pipeline : {&context->pipeline, &context->overdraw_pipeline, &context->overdraw_depth_pipeline, &context->depth_prepass_pipeline,
+								   &context->depth_equal_pipeline, &context->cull_pipeline, &context->occlusion_cull_pipeline, &context->hiz_pipeline})
+	{
+		if (*pipeline)
+		{
+			context->device.destroyPipeline(*pipeline);
+			*pipeline = nullptr;
+		}
+	}
+
+	for (vk::PipelineLayout *layout : {&context->cull_pipeline_layout, &context->occlusion_cull_pipeline_layout, &context->hiz_pipeline_layout})
 	{
-		context->device.destroyPipeline(context->pipeline);
-		context->pipeline = nullptr;
+		if (*layout)
+		{
+			context->device.destroyPipelineLayout(*layout);
+			*layout = nullptr;
+		}
 	}
-}
\ No newline at end of file
+
+	for (vk::DescriptorSetLayout *layout : {&context->cull_descriptor_set_layout, &context->occlusion_descriptor_set_layout, &context->hiz_descriptor_set_layout})
+	{
+		if (*layout)
+		{
+			context->device.destroyDescriptorSetLayout(*layout);
+			*layout = nullptr;
+		}
+	}
+}
@@ -18,7 +18,8 @@ void VKBase::createRenderPass()
 	// The image layout will be undefined when the render pass begins.
 	attachments[0].initialLayout = vk::ImageLayout::eUndefined;
 	// After the render pass is complete, we will transition to ePresentSrcKHR layout.
-	attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+	// Offscreen targets go to eTransferSrcOptimal instead, ready for a readback copy.
+	attachments[0].finalLayout = context->headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
 
 	// Depth
 
@@ -28,8 +29,8 @@ void VKBase::createRenderPass()
 	attachments[1].samples = vk::SampleCountFlagBits::e1;
 	// When starting the frame, we want tiles to be cleared.
 	attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-	// When ending the frame, we want tiles to be written out.
-	attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+	// Depth is thrown away after the frame, unless something reads it afterwards.
+	attachments[1].storeOp = context->keep_depth ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
 	// Don't care about stencil since we're not using it.
 	attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 	attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
@@ -70,13 +71,54 @@ void VKBase::createRenderPass()
 	vk::RenderPassCreateInfo rp_info({}, attachments, subpass, dependency);
 
 	context->render_pass = context->device.createRenderPass(rp_info);
+
+	if (!context->keep_depth)
+	{
+		return;
+	}
+
+	// Early pass: clears like render_pass, but leaves color in attachment layout for the late pass
+	// and depth readable by the Hi-Z build.
+	std::array<vk::AttachmentDescription, 2> early = {attachments[0], attachments[1]};
+	early[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	early[1].storeOp = vk::AttachmentStoreOp::eStore;
+	early[1].finalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+	// The depth writes have to land before the pyramid build samples them.
+	const vk::SubpassDependency depth_out(0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eLateFragmentTests, vk::PipelineStageFlagBits::eComputeShader,
+										  vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::AccessFlagBits::eShaderRead);
+	const std::array<vk::SubpassDependency, 2> early_dependencies = {dependency, depth_out};
+
+	context->early_render_pass = context->device.createRenderPass(vk::RenderPassCreateInfo({}, early, subpass, early_dependencies));
+
+	// Late pass: continues on what the early pass left.
+	std::array<vk::AttachmentDescription, 2> late = {attachments[0], attachments[1]};
+	late[0].loadOp = vk::AttachmentLoadOp::eLoad;
+	late[0].initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	late[1].loadOp = vk::AttachmentLoadOp::eLoad;
+	late[1].initialLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+	// Color and depth written by the early pass, and the pyramid build done reading depth before it is written again.
+	vk::SubpassDependency resume;
+	resume.srcSubpass = VK_SUBPASS_EXTERNAL;
+	resume.dstSubpass = 0;
+	resume.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader;
+	resume.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+	resume.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	resume.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentRead |
+						   vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+	context->late_render_pass = context->device.createRenderPass(vk::RenderPassCreateInfo({}, late, subpass, resume));
 }
 
 void VKBase::destroyRenderpass()
 {
-	if (context->render_pass)
+	for (vk::RenderPass *render_pass : {&context->render_pass, &context->early_render_pass, &context->late_render_pass})
 	{
-		context->device.destroyRenderPass(context->render_pass);
-		context->render_pass = nullptr;
+		if (*render_pass)
+		{
+			context->device.destroyRenderPass(*render_pass);
+			*render_pass = nullptr;
+		}
 	}
 }
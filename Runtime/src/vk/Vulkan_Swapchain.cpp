@@ -1,5 +1,38 @@
 #include "Vulkan_Base.hpp"
 
+#include <algorithm>
+
+/// Picks the requested present mode if supported, otherwise the closest one with the same intent.
+/// Uncapped modes fall back to each other before settling for FIFO, which must be supported by all implementations.
+static vk::PresentModeKHR choose_present_mode(const vk::PresentModeKHR requested, const std::vector<vk::PresentModeKHR> &available)
+{
+	std::vector<vk::PresentModeKHR> chain;
+	switch (requested)
+	{
+	case vk::PresentModeKHR::eMailbox:
+		chain = {vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate};
+		break;
+	case vk::PresentModeKHR::eImmediate:
+		chain = {vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eMailbox};
+		break;
+	case vk::PresentModeKHR::eFifoRelaxed:
+		chain = {vk::PresentModeKHR::eFifoRelaxed};
+		break;
+	default:
+		break;
+	}
+
+	for (const auto mode : chain)
+	{
+		if (std::find(available.begin(), available.end(), mode) != available.end())
+		{
+			return mode;
+		}
+	}
+
+	return vk::PresentModeKHR::eFifo;
+}
+
 void VKBase::createSwapchain()
 {
 
@@ -58,8 +91,11 @@ void VKBase::createSwapchain()
 		swapchain_size = surface_properties.currentExtent;
 	}
 
-	// FIFO must be supported by all implementations.
-	vk::PresentModeKHR swapchain_present_mode = vk::PresentModeKHR::eFifo;
+	vk::PresentModeKHR swapchain_present_mode = choose_present_mode(context->requested_present_mode, context->gpu.getSurfacePresentModesKHR(context->surface));
+	if (swapchain_present_mode != context->requested_present_mode)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Present mode %s not supported, using %s", vk::to_string(context->requested_present_mode).c_str(), vk::to_string(swapchain_present_mode).c_str());
+	}
 
 	// Determine the number of vk::Image's to use in the swapchain.
 	// Ideally, we desire to own 1 image at a time, the rest of the images can
@@ -71,6 +107,13 @@ void VKBase::createSwapchain()
 		desired_swapchain_images = surface_properties.maxImageCount;
 	}
 
+	// Mailbox needs an image to present, one queued and one to render into, or it degrades to FIFO behaviour.
+	if (swapchain_present_mode == vk::PresentModeKHR::eMailbox && desired_swapchain_images < 3 &&
+		(surface_properties.maxImageCount == 0 || surface_properties.maxImageCount >= 3))
+	{
+		desired_swapchain_images = 3;
+	}
+
 	// Figure out a suitable surface transform.
 	vk::SurfaceTransformFlagBitsKHR pre_transform =
 		(surface_properties.supportedTransforms & vk::SurfaceTransformFlagBitsKHR::eIdentity) ? vk::SurfaceTransformFlagBitsKHR::eIdentity : surface_properties.currentTransform;
@@ -121,33 +164,29 @@ void VKBase::createSwapchain()
 			context->device.destroyImageView(image_view);
 		}
 
-		size_t image_count = context->device.getSwapchainImagesKHR(old_swapchain).size();
-
-		for (size_t i = 0; i < image_count; i++)
+		for (auto semaphore : context->swapchain_release_semaphores)
 		{
-			teardown_per_frame(context->per_frame[i]);
+			context->device.destroySemaphore(semaphore);
 		}
 
+		context->swapchain_release_semaphores.clear();
 		context->swapchain_image_views.clear();
 
 		context->device.destroySwapchainKHR(old_swapchain);
 	}
 
 	context->swapchain_dimensions = {swapchain_size.width, swapchain_size.height, format.format};
+	context->present_mode = swapchain_present_mode;
 
 	/// The swapchain images.
 	std::vector<vk::Image> swapchain_images = context->device.getSwapchainImagesKHR(context->swapchain);
 	size_t image_count = swapchain_images.size();
 
-	// Initialize per-frame resources.
-	// Every swapchain image has its own command pool and fence manager.
-	// This makes it very easy to keep track of when we can reset command buffers and such.
-	context->per_frame.clear();
-	context->per_frame.resize(image_count);
-
+	// Command pools belong to the frames in flight, see createFrames.
+	// Only the present wait is tied to the image, as it lasts until the image comes back from the presentation engine.
 	for (size_t i = 0; i < image_count; i++)
 	{
-		init_per_frame(context->per_frame[i]);
+		context->swapchain_release_semaphores.push_back(context->device.createSemaphore({}));
 	}
 
 	vk::ImageViewCreateInfo view_info;
@@ -169,9 +208,40 @@ void VKBase::createSwapchain()
 	}
 }
 
+void VKBase::createFrames(const uint32_t frames_in_flight)
+{
+	if (frames_in_flight == 0)
+	{
+		throw std::runtime_error("At least one frame in flight is required.");
+	}
+
+	destroyFrames();
+
+	// Every frame in flight has its own command pool and remembers the graphics timeline value it signals.
+	// This makes it very easy to keep track of when we can reset command buffers and such.
+	context->frames_in_flight = frames_in_flight;
+	context->frame_index = 0;
+	context->per_frame.resize(frames_in_flight);
+
+	for (auto &per_frame : context->per_frame)
+	{
+		init_per_frame(per_frame);
+	}
+}
+
+void VKBase::destroyFrames()
+{
+	for (auto &per_frame : context->per_frame)
+	{
+		teardown_per_frame(per_frame);
+	}
+
+	context->per_frame.clear();
+}
+
 void VKBase::init_per_frame(PerFrame &per_frame)
 {
-	per_frame.queue_submit_fence = context->device.createFence({vk::FenceCreateFlagBits::eSignaled});
+	per_frame.swapchain_acquire_semaphore = context->device.createSemaphore({});
 
 	vk::CommandPoolCreateInfo cmd_pool_info(vk::CommandPoolCreateFlagBits::eTransient, context->graphics_queue_index);
 	per_frame.primary_command_pool = context->device.createCommandPool(cmd_pool_info);
@@ -185,13 +255,6 @@ void VKBase::init_per_frame(PerFrame &per_frame)
 
 void VKBase::teardown_per_frame(PerFrame &per_frame)
 {
-	if (per_frame.queue_submit_fence)
-	{
-		context->device.destroyFence(per_frame.queue_submit_fence);
-
-		per_frame.queue_submit_fence = nullptr;
-	}
-
 	if (per_frame.primary_command_buffer)
 	{
 		context->device.freeCommandBuffers(per_frame.primary_command_pool, per_frame.primary_command_buffer);
@@ -213,13 +276,7 @@ void VKBase::teardown_per_frame(PerFrame &per_frame)
 		per_frame.swapchain_acquire_semaphore = nullptr;
 	}
 
-	if (per_frame.swapchain_release_semaphore)
-	{
-		context->device.destroySemaphore(per_frame.swapchain_release_semaphore);
-
-		per_frame.swapchain_release_semaphore = nullptr;
-	}
-
+	per_frame.timeline_value = 0;
 	per_frame.device = nullptr;
 	per_frame.queue_index = -1;
 }
@@ -232,6 +289,15 @@ void VKBase::destroySwapchain()
 		image_view = nullptr;
 	}
 
+	context->swapchain_image_views.clear();
+
+	for (auto semaphore : context->swapchain_release_semaphores)
+	{
+		context->device.destroySemaphore(semaphore);
+	}
+
+	context->swapchain_release_semaphores.clear();
+
 	if (context->swapchain)
 	{
 		context->device.destroySwapchainKHR(context->swapchain);
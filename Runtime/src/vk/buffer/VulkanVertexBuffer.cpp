@@ -1,5 +1,10 @@
 #include "VulkanVertexBuffer.hpp"
 
+#include <algorithm>
+
+/// Non-coherent persistently mapped buffers with writes that still have to be flushed
+static std::vector<VulkanVertexBuffer *> dirty_buffers;
+
 VulkanVertexBuffer::VulkanVertexBuffer(
     vk::Device const &device,
     vk::DeviceSize size,
@@ -43,6 +48,10 @@ VulkanVertexBuffer::VulkanVertexBuffer(
         {
             mapped_data = static_cast<uint8_t *>(allocation_info.pMappedData);
         }
+
+        VkMemoryPropertyFlags memory_properties;
+        vmaGetAllocationMemoryProperties(context->memory_allocator, allocation, &memory_properties);
+        coherent = (memory_properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
     }
     catch (const std::exception &e)
     {
@@ -70,9 +79,83 @@ void VulkanVertexBuffer::unmap()
     }
 }
 
-void VulkanVertexBuffer::flush() const
+void VulkanVertexBuffer::mark_dirty(const size_t offset, const size_t size)
+{
+    if (coherent)
+    {
+        return;
+    }
+
+    if (dirty_begin >= dirty_end)
+    {
+        dirty_begin = offset;
+        dirty_end = offset + size;
+    }
+    else
+    {
+        dirty_begin = std::min<VkDeviceSize>(dirty_begin, offset);
+        dirty_end = std::max<VkDeviceSize>(dirty_end, offset + size);
+    }
+
+    if (!queued)
+    {
+        dirty_buffers.push_back(this);
+        queued = true;
+    }
+}
+
+void VulkanVertexBuffer::flush()
+{
+    if (dirty_begin < dirty_end)
+    {
+        vmaFlushAllocation(context->memory_allocator, allocation, dirty_begin, dirty_end - dirty_begin);
+    }
+
+    dirty_begin = 0;
+    dirty_end = 0;
+}
+
+void VulkanVertexBuffer::invalidate()
+{
+    if (!coherent)
+    {
+        vmaInvalidateAllocation(context->memory_allocator, allocation, 0, VK_WHOLE_SIZE);
+    }
+}
+
+void VulkanVertexBuffer::flush_pending()
 {
-    vmaFlushAllocation(context->memory_allocator, allocation, 0, size);
+    if (dirty_buffers.empty())
+    {
+        return;
+    }
+
+    std::vector<VmaAllocation> allocations;
+    std::vector<VkDeviceSize> offsets;
+    std::vector<VkDeviceSize> sizes;
+    allocations.reserve(dirty_buffers.size());
+    offsets.reserve(dirty_buffers.size());
+    sizes.reserve(dirty_buffers.size());
+
+    for (auto *buffer : dirty_buffers)
+    {
+        if (buffer->dirty_begin < buffer->dirty_end)
+        {
+            allocations.push_back(buffer->allocation);
+            offsets.push_back(buffer->dirty_begin);
+            sizes.push_back(buffer->dirty_end - buffer->dirty_begin);
+        }
+
+        buffer->dirty_begin = 0;
+        buffer->dirty_end = 0;
+        buffer->queued = false;
+    }
+    dirty_buffers.clear();
+
+    if (!allocations.empty())
+    {
+        vmaFlushAllocations(context->memory_allocator, static_cast<uint32_t>(allocations.size()), allocations.data(), offsets.data(), sizes.data());
+    }
 }
 
 void VulkanVertexBuffer::update(void *data, size_t size, size_t offset)
@@ -84,13 +167,16 @@ void VulkanVertexBuffer::update(const uint8_t *data, const size_t size, const si
 {
     if (persistent)
     {
+        // Flushing is deferred to flush_pending, which batches all buffers written this frame.
         std::copy(data, data + size, mapped_data + offset);
-        flush();
+        mark_dirty(offset, size);
     }
     else
     {
+        // Memory has to stay mapped while it is flushed, so this path can't be deferred.
         map();
         std::copy(data, data + size, mapped_data + offset);
+        mark_dirty(offset, size);
         flush();
         unmap();
     }
@@ -98,6 +184,11 @@ void VulkanVertexBuffer::update(const uint8_t *data, const size_t size, const si
 
 VulkanVertexBuffer::~VulkanVertexBuffer()
 {
+    if (queued)
+    {
+        dirty_buffers.erase(std::remove(dirty_buffers.begin(), dirty_buffers.end(), this), dirty_buffers.end());
+    }
+
     if (handle != VK_NULL_HANDLE && allocation != VK_NULL_HANDLE)
     {
         unmap();
@@ -15,6 +15,16 @@ private:
 	/// Whether the buffer has been mapped with vmaMapMemory
 	bool mapped{false};
 
+	/// Whether the memory is HOST_COHERENT, writes are visible to the device without flushing
+	bool coherent{false};
+
+	/// Byte range written since the last flush, empty if dirty_begin >= dirty_end
+	VkDeviceSize dirty_begin{0};
+	VkDeviceSize dirty_end{0};
+
+	/// Whether the buffer is queued for the next flush_pending
+	bool queued{false};
+
 public:
 	VulkanVertexBuffer(vk::Device const &device,
 					   vk::DeviceSize size,
@@ -40,10 +50,21 @@ public:
 
 	VulkanVertexBuffer &operator=(VulkanVertexBuffer &&) = delete;
 
-	void flush() const;
+	/// Flushes the range written since the last flush right away, a no-op on coherent memory.
+	void flush();
+
+	/// Flushes the dirty ranges of all non-coherent buffers with a single vmaFlushAllocations call.
+	/// Called once per frame before submit.
+	static void flush_pending();
+
+	/// Makes device writes visible to the host before reading through map(), a no-op on coherent memory.
+	void invalidate();
 
 	uint8_t *map();
 
+	/// Records a range written through map() directly, so the next flush covers it.
+	void mark_dirty(size_t offset, size_t size);
+
 	void unmap();
 
 	void update(const uint8_t *data, size_t size, size_t offset = 0);
@@ -71,4 +92,9 @@ public:
 	VmaAllocation get_allocation() const {
 		return allocation;
 	}
+
+	bool is_coherent() const
+	{
+		return coherent;
+	}
 };
@@ -1,45 +1,77 @@
 #include "Vulkan_Image.hpp"
-#include "../uniform/Vulkan_3D_Unifrom.hpp"
+
+#include "../../profiler/CpuProfiler.hpp"
+#include "../../profiler/GpuProfiler.hpp"
+
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 VulkanImage::VulkanImage(const vk::Format &format, const uint32_t &width, const uint32_t &height)
+    : VulkanImage(format, width, height, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc)
+{
+}
+
+VulkanImage::VulkanImage(const vk::Format &format, const uint32_t &width, const uint32_t &height, const vk::ImageUsageFlags &usage)
 {
     texture.extent.width = width;
     texture.extent.height = height;
     texture.mip_levels = 1;
-    this->createImage(format, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc);
-    this->createSampleAndView(format, true);
+    this->createImage(format, usage);
+    this->createSampleAndView(format, static_cast<bool>(usage & vk::ImageUsageFlagBits::eDepthStencilAttachment));
+}
+
+VulkanImage::VulkanImage(const std::string_view &path) : VulkanImage(decode(path))
+{
 }
 
-VulkanImage::VulkanImage(const vk::DescriptorBufferInfo &buffer_descriptor, const std::string_view &path)
+ImageData VulkanImage::decode(const std::string_view &path)
 {
+    VENT_PROFILE_ZONE("Decode texture");
+
+    ImageData image;
 
     int32_t width, height, channels;
     u_char *data = stbi_load(path.data(), &width, &height, &channels, STBI_rgb_alpha);
     if (!data)
     {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Could not load image data");
+        return image;
+    }
+
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    image.pixels = {data, stbi_image_free};
+    return image;
+}
+
+VulkanImage::VulkanImage(const ImageData &image)
+{
+    VENT_PROFILE_ZONE("Upload texture");
+
+    if (!image.pixels)
+    {
         return;
     }
 
-    texture.extent.width = width;
-    texture.extent.height = height;
+    texture.extent.width = image.width;
+    texture.extent.height = image.height;
     texture.mip_levels = 1;
 
-    this->createAndUpload(data, width, height, vk::Format::eR8G8B8A8Srgb);
+    this->createAndUpload(image.pixels.get(), image.width, image.height, vk::Format::eR8G8B8A8Srgb);
     this->createSampleAndView(vk::Format::eR8G8B8A8Srgb, false);
-    stbi_image_free(data);
-    this->createDescriptorSet(buffer_descriptor);
+    this->createDescriptorSet();
 }
 
 VulkanImage::~VulkanImage()
 {
-    context->device.waitIdle();
-    context->device.destroyImageView(texture.view);
-    vmaDestroyImage(context->memory_allocator, static_cast<VkImage>(texture.image), texture.allocation);
-    context->device.destroySampler(texture.sampler);
+    // Frames in flight may still sample the image, so it goes once the graphics timeline passed them instead of stalling the device.
+    retire_resource([texture = texture]()
+                    {
+        context->device.destroyImageView(texture.view);
+        vmaDestroyImage(context->memory_allocator, static_cast<VkImage>(texture.image), texture.allocation);
+        context->device.destroySampler(texture.sampler); });
 }
 
 void VulkanImage::createSampleAndView(const vk::Format &format, const bool depth)
@@ -120,12 +152,11 @@ void VulkanImage::createAndUpload(u_char *pdata, uint32_t width, uint32_t height
 {
     const auto size = width * height * STBI_rgb_alpha;
 
-    auto staging_buffer = std::make_unique<VulkanVertexBuffer>(context->device, size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    auto staging_buffer = std::make_shared<VulkanVertexBuffer>(context->device, size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-    uint8_t *data;
-    vmaMapMemory(context->memory_allocator, staging_buffer->get_allocation(), reinterpret_cast<void **>(&data));
-    memcpy(data, pdata, size);
-    vmaUnmapMemory(context->memory_allocator, staging_buffer->get_allocation());
+    // The copy is submitted right away, so the staging data can't wait for the per-frame flush.
+    staging_buffer->update(pdata, size);
+    staging_buffer->flush();
 
     // Setup buffer copy regions for each mip level
     std::vector<vk::BufferImageCopy> buffer_copy_regions(texture.mip_levels);
@@ -143,9 +174,15 @@ void VulkanImage::createAndUpload(u_char *pdata, uint32_t width, uint32_t height
     // Create optimal tiled target image on the device
     this->createImage(format, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
 
-    const vk::CommandBuffer copy_command = context->device.allocateCommandBuffers({context->command_pool, vk::CommandBufferLevel::ePrimary, 1}).front();
+    // Uploads go through the dedicated transfer queue if the device has one, so they don't compete with rendering.
+    const bool dedicated_transfer = context->transfer_queue_index >= 0;
+    const vk::CommandPool pool = dedicated_transfer ? context->transfer_command_pool : context->command_pool;
+
+    const vk::CommandBuffer copy_command = context->device.allocateCommandBuffers({pool, vk::CommandBufferLevel::ePrimary, 1}).front();
     copy_command.begin(vk::CommandBufferBeginInfo());
 
+    const uint32_t upload_scope = context->gpu_profiler ? context->gpu_profiler->beginUpload(copy_command, dedicated_transfer) : GpuProfiler::INVALID_SCOPE;
+
     // Image memory barriers for the texture image
 
     // The sub resource range describes the regions of the image that will be transitioned using the memory barriers below
@@ -175,24 +212,64 @@ void VulkanImage::createAndUpload(u_char *pdata, uint32_t width, uint32_t height
     // Copy mip levels from staging buffer
     copy_command.copyBufferToImage(staging_buffer->get_handle(), texture.image, vk::ImageLayout::eTransferDstOptimal, buffer_copy_regions);
 
+    if (context->gpu_profiler)
+    {
+        context->gpu_profiler->endUpload(copy_command, upload_scope);
+    }
+
     // Once the data has been uploaded we transfer the texture image to the shader read layout, so it can be sampled from
     image_memory_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
     image_memory_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
     image_memory_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
     image_memory_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 
-    // Insert a memory dependency at the proper pipeline stages that will execute the image layout transition
-    // Source pipeline stage stage is copy command exection (VK_PIPELINE_STAGE_TRANSFER_BIT)
-    // Destination pipeline stage fragment shader access (VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
-    copy_command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, image_memory_barrier);
-
     // Store current layout for later reuse
     texture.image_layout = vk::ImageLayout::eShaderReadOnlyOptimal;
 
-    flush_command_buffer(copy_command, context->queue, true);
+    if (!dedicated_transfer)
+    {
+        // Insert a memory dependency at the proper pipeline stages that will execute the image layout transition
+        // Source pipeline stage stage is copy command exection (VK_PIPELINE_STAGE_TRANSFER_BIT)
+        // Destination pipeline stage fragment shader access (VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+        copy_command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, image_memory_barrier);
+
+        flush_command_buffer(copy_command, context->queue, context->command_pool, true);
+
+        if (context->gpu_profiler)
+        {
+            context->gpu_profiler->resolveUpload(upload_scope, "Texture upload");
+        }
+        return;
+    }
+
+    // Release the image from the transfer queue family, the layout transition is part of the ownership transfer.
+    // Access masks on the destination side are ignored for a release, the matching acquire on the graphics queue makes the writes visible.
+    image_memory_barrier.dstAccessMask = {};
+    image_memory_barrier.srcQueueFamilyIndex = static_cast<uint32_t>(context->transfer_queue_index);
+    image_memory_barrier.dstQueueFamilyIndex = static_cast<uint32_t>(context->graphics_queue_index);
+
+    copy_command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, image_memory_barrier);
+
+    // The host doesn't wait for the copy. The next frame's submit waits for it on the transfer timeline before its acquire,
+    // so once that frame completed the staging buffer, the command buffer and the timestamps are free.
+    const uint64_t transfer_value = flush_command_buffer(copy_command, context->transfer_queue, context->transfer_command_pool, false, false);
+
+    retire_resource([staging_buffer, copy_command, upload_scope]() {
+        context->device.freeCommandBuffers(context->transfer_command_pool, copy_command);
+        if (context->gpu_profiler)
+        {
+            context->gpu_profiler->resolveUpload(upload_scope, "Texture upload");
+        }
+    });
+
+    image_memory_barrier.srcAccessMask = {};
+    image_memory_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    context->pending_acquire_barriers.push_back(image_memory_barrier);
+    context->pending_transfer_value = std::max(context->pending_transfer_value, transfer_value);
 }
 
-void VulkanImage::createDescriptorSet(const vk::DescriptorBufferInfo &buffer_descriptor)
+void VulkanImage::createDescriptorSet()
 {
     const vk::DescriptorSetAllocateInfo alloc_info(context->descriptor_pool, 1, &context->descriptor_set_layout);
 
@@ -203,54 +280,52 @@ void VulkanImage::createDescriptorSet(const vk::DescriptorBufferInfo &buffer_des
     image_descriptor.sampler = texture.sampler;
     image_descriptor.imageLayout = texture.image_layout;
 
-    std::array<vk::WriteDescriptorSet, 2> write_descriptor_sets = {
-        {// Binding 0 : Vertex shader uniform buffer
-         {descriptor_set, 0, {}, vk::DescriptorType::eUniformBufferDynamic, {}, buffer_descriptor},
-         // Binding 1 : Fragment shader texture sampler
-         //	Fragment shader: layout (binding = 1) uniform sampler2D samplerColor;
-         {descriptor_set, 1, {}, vk::DescriptorType::eCombinedImageSampler, image_descriptor}}};
+    // Binding 0 : Fragment shader texture sampler
+    //	Fragment shader: layout (set = 1, binding = 0) uniform sampler2D samplerColor;
+    const vk::WriteDescriptorSet write_descriptor_set(descriptor_set, 0, {}, vk::DescriptorType::eCombinedImageSampler, image_descriptor);
 
-    context->device.updateDescriptorSets(write_descriptor_sets, {});
+    context->device.updateDescriptorSets(write_descriptor_set, {});
 }
 
-void VulkanImage::bind(const vk::CommandBuffer &buffer, const uint32_t &index) const
+void VulkanImage::bind(const vk::CommandBuffer &buffer) const
 {
-    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, context->pipeline_layout, 0, descriptor_set, index * sizeof(Vulkan_3D_Unifrom::ubo_vs));
+    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, context->pipeline_layout, 1, descriptor_set, {});
 }
 
-void VulkanImage::flush_command_buffer(const vk::CommandBuffer &command_buffer, vk::Queue &queue, bool free, vk::Semaphore signalSemaphore) const
+uint64_t VulkanImage::flush_command_buffer(const vk::CommandBuffer &command_buffer, const vk::Queue &queue, const vk::CommandPool &pool, bool free, const bool wait) const
 {
     if (!command_buffer)
     {
-        return;
+        return 0;
     }
 
     command_buffer.end();
 
-    vk::SubmitInfo submit_info({}, {}, command_buffer);
-    if (signalSemaphore)
-    {
-        submit_info.setSignalSemaphores(signalSemaphore);
-    }
+    // Each queue signals its own timeline, the value tells the host and other queues when the work is done
+    const bool transfer = context->transfer_queue && queue == context->transfer_queue;
+    const vk::Semaphore timeline = transfer ? context->transfer_timeline : context->graphics_timeline;
+    const uint64_t value = transfer ? ++context->transfer_timeline_value : ++context->graphics_timeline_value;
+
+    const vk::TimelineSemaphoreSubmitInfo timeline_info({}, value);
 
-    // Create fence to ensure that the command buffer has finished executing
-    vk::Fence fence = context->device.createFence({});
+    vk::SubmitInfo submit_info({}, {}, command_buffer, timeline);
+    submit_info.pNext = &timeline_info;
 
     // Submit to the queue
-    queue.submit(submit_info, fence);
+    queue.submit(submit_info);
 
-    // Wait for the fence to signal that command buffer has finished executing
-    vk::Result result = context->device.waitForFences(fence, true, 100000000000);
-    if (result != vk::Result::eSuccess)
+    if (!wait)
     {
-        SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Failed to flush Command Buffer");
-        abort();
+        return value;
     }
 
-    context->device.destroyFence(fence);
+    // Wait for the timeline to signal that command buffer has finished executing
+    wait_timeline(timeline, value);
 
-    if (context->command_pool && free)
+    if (pool && free)
     {
-        context->device.freeCommandBuffers(context->command_pool, command_buffer);
+        context->device.freeCommandBuffers(pool, command_buffer);
     }
-}
\ No newline at end of file
+
+    return value;
+}
@@ -6,6 +6,16 @@
 #include <memory>
 #include <vector>
 
+/// Decoded RGBA8 pixels. Decoding doesn't touch Vulkan, so it can run on any thread.
+struct ImageData
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /// Null if decoding failed
+    std::unique_ptr<u_char, void (*)(void *)> pixels{nullptr, nullptr};
+};
+
 class VulkanImage
 {
 private:
@@ -19,18 +29,30 @@ private:
 
     void createAndUpload(u_char *data, uint32_t width, uint32_t height, const vk::Format &format);
 
-    void createDescriptorSet(const vk::DescriptorBufferInfo &buffer_descriptor);
+    void createDescriptorSet();
 
-    void flush_command_buffer(const vk::CommandBuffer &command_buffer, vk::Queue &queue, bool free, vk::Semaphore signalSemaphore = VK_NULL_HANDLE) const;
+    /// Submits the command buffer and returns the timeline value it signalled on its queue. With wait, blocks the host
+    /// until it finished and frees it if free is set, else the caller frees it once the value passed.
+    uint64_t flush_command_buffer(const vk::CommandBuffer &command_buffer, const vk::Queue &queue, const vk::CommandPool &pool, bool free, bool wait = true) const;
 
 public:
+    /// Depth attachment
     VulkanImage(const vk::Format &format, const uint32_t &width, const uint32_t &height);
 
-    VulkanImage(const vk::DescriptorBufferInfo &buffer_descriptor, const std::string_view &path);
+    /// Render target with the given usage, a depth image if the usage contains eDepthStencilAttachment.
+    VulkanImage(const vk::Format &format, const uint32_t &width, const uint32_t &height, const vk::ImageUsageFlags &usage);
+
+    VulkanImage(const std::string_view &path);
+
+    /// Uploads pixels decoded earlier, e.g. by a job.
+    explicit VulkanImage(const ImageData &image);
+
+    static ImageData decode(const std::string_view &path);
 
     ~VulkanImage();
 
-    void bind(const vk::CommandBuffer &buffer, const uint32_t &index) const;
+    /// Binds the texture as the material set (set 1).
+    void bind(const vk::CommandBuffer &buffer) const;
 
     const Texture &getTexture() const { return texture; };
 };
@@ -1,10 +1,55 @@
 #include "Vulkan_Mesh.hpp"
 
+#include "../../profiler/CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/// Box of the vertices and the sphere around its center enclosing them
+static MeshBounds computeBounds(const Vertex *vertices, const size_t count)
+{
+    MeshBounds bounds;
+    if (count == 0)
+    {
+        return bounds;
+    }
+
+    bounds.min = bounds.max = vertices[0].pos;
+    for (size_t i = 0; i < count; i++)
+    {
+        bounds.min = glm::min(bounds.min, vertices[i].pos);
+        bounds.max = glm::max(bounds.max, vertices[i].pos);
+    }
+
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius_squared = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        const glm::vec3 offset = vertices[i].pos - center;
+        radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+    }
+    bounds.sphere = glm::vec4(center, std::sqrt(radius_squared));
+    return bounds;
+}
+
 Vulkan_Mesh::Vulkan_Mesh(const std::string &path)
 {
+    VENT_PROFILE_ZONE("Load mesh");
+
     if (loader.load(path))
     {
         this->createBuffers(loader.getVertices(), loader.getIndices());
+
+        // Every mesh of the file is a submesh with its own bounds, so culling and picking see its parts
+        const std::vector<Vertex> &vertices = loader.getVertices();
+        submeshes.clear();
+        for (const auto &range : loader.getMeshRanges())
+        {
+            if (range.index_count > 0)
+            {
+                submeshes.push_back({range.first_index, range.index_count, 0, computeBounds(vertices.data() + range.first_vertex, range.vertex_count)});
+            }
+        }
     }
 }
 
@@ -26,6 +71,8 @@ Vulkan_Mesh::~Vulkan_Mesh()
 
 void Vulkan_Mesh::createBuffers(std::vector<Vertex> &pvertices, std::vector<uint32_t> &pindices)
 {
+    bounds = computeBounds(pvertices.data(), pvertices.size());
+
     // vertex
 
     vertexCount = static_cast<uint32_t>(pvertices.size() * sizeof(Vertex));
@@ -41,6 +88,9 @@ void Vulkan_Mesh::createBuffers(std::vector<Vertex> &pvertices, std::vector<uint
 
     index_buffer = std::make_unique<VulkanVertexBuffer>(context->device, index_buffer_size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
     index_buffer->update(pindices.data(), index_buffer_size);
+
+    submeshes.clear();
+    submeshes.push_back({0, index_count, 0, bounds});
 }
 
 uint32_t Vulkan_Mesh::get_memory_type(uint32_t bits, vk::MemoryPropertyFlags properties, vk::Bool32 *memory_type_found)
@@ -74,26 +124,29 @@ uint32_t Vulkan_Mesh::get_memory_type(uint32_t bits, vk::MemoryPropertyFlags pro
     }
 }
 
-void Vulkan_Mesh::bind(const vk::CommandBuffer &commandBuffer, const uint32_t &index) const
+void Vulkan_Mesh::bind(const vk::CommandBuffer &commandBuffer) const
 {
-    if (image)
-    {
-        image->bind(commandBuffer, index);
-    }
-
     vk::DeviceSize offset = 0;
     commandBuffer.bindVertexBuffers(0, vertex_buffer->get_handle(), offset);
     commandBuffer.bindIndexBuffer(index_buffer->get_handle(), 0, vk::IndexType::eUint32);
 }
 
-void Vulkan_Mesh::setTexture(const vk::DescriptorBufferInfo &buffer_descriptor, const std::string &path)
+void Vulkan_Mesh::bindMaterial(const vk::CommandBuffer &commandBuffer) const
+{
+    if (image)
+    {
+        image->bind(commandBuffer);
+    }
+}
+
+void Vulkan_Mesh::setTexture(const std::string &path)
 {
-    image = std::make_unique<VulkanImage>(buffer_descriptor, path);
+    image = std::make_unique<VulkanImage>(path);
 }
 
-void Vulkan_Mesh::draw(const vk::CommandBuffer &commandBuffer) const
+void Vulkan_Mesh::setTexture(const ImageData &decoded)
 {
-    commandBuffer.drawIndexed(index_count, 1, 0, 0, 0);
+    image = std::make_unique<VulkanImage>(decoded);
 }
 
 std::array<vk::VertexInputAttributeDescription, 3> Vertex::getAttributeDescriptions()
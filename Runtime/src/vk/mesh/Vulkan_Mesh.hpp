@@ -11,6 +11,26 @@
 #include <vector>
 #include <string>
 
+/// Local space bounds of a mesh, computed when its buffers are created
+struct MeshBounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    /// Center of the box and the distance to its farthest vertex
+    glm::vec4 sphere = glm::vec4(0.0f);
+};
+
+/// Part of a mesh drawn on its own, a range of the mesh's vertex and index buffers
+struct Submesh
+{
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    int32_t vertex_offset = 0;
+
+    MeshBounds bounds;
+};
+
 class Vulkan_Mesh : public GameObject
 {
 private:
@@ -21,7 +41,11 @@ private:
     std::unique_ptr<VulkanImage> image;
 
     uint32_t vertexCount;
-    uint32_t index_count;
+    uint32_t index_count = 0;
+
+    MeshBounds bounds;
+
+    std::vector<Submesh> submeshes;
 
     void createBuffers(std::vector<Vertex> &pvertices, std::vector<uint32_t> &pindices);
 
@@ -35,8 +59,20 @@ public:
 
     static uint32_t get_memory_type(uint32_t bits, vk::MemoryPropertyFlags properties, vk::Bool32 *memory_type_found = nullptr);
 
-    void setTexture(const vk::DescriptorBufferInfo &buffer_descriptor, const std::string &path);
+    void setTexture(const std::string &path);
+
+    void setTexture(const ImageData &decoded);
+
+    /// The material the mesh binds, meshes sharing one can skip rebinding it.
+    [[nodiscard]] const VulkanImage *getMaterial() const { return image.get(); }
+
+    void bind(const vk::CommandBuffer &commandBuffer) const;
+    void bindMaterial(const vk::CommandBuffer &commandBuffer) const;
+
+    [[nodiscard]] uint32_t getIndexCount() const { return index_count; }
+
+    [[nodiscard]] const MeshBounds &getBounds() const { return bounds; }
 
-    void bind(const vk::CommandBuffer &commandBuffer, const uint32_t &index) const;
-    void draw(const vk::CommandBuffer &commandBuffer) const;
+    /// One per mesh of a loaded file, else one covering all indices. None if the buffers couldn't be created.
+    [[nodiscard]] const std::vector<Submesh> &getSubmeshes() const { return submeshes; }
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Vulkan_Mesh.hpp"
+#include "../../../jobs/JobSystem.hpp"
 
 #include <string>
 #include <vector>
@@ -13,6 +14,16 @@
 
 class MeshFormatLoader
 {
+public:
+    /// Where one mesh of the file ended up in the shared vertices and indices
+    struct MeshRange
+    {
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
 protected:
     struct Material
     {
@@ -46,6 +57,9 @@ protected:
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
 
+    /// Indexed like the scene's meshes
+    std::vector<MeshRange> _ranges;
+
     std::vector<Material> _Materials;
 
 public:
@@ -61,59 +75,68 @@ public:
             return false;
         }
 
-        const auto mesh_count = scene->mNumMeshes;
+        const uint32_t mesh_count = scene->mNumMeshes;
         const aiVector3D Zero3D(0, 0, 0);
 
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
-
-        uint32_t NumVertices = 0;
-        uint32_t NumIndicies = 0;
+        // Every mesh writes to its own slice, prefix sums of the counts give the offsets
+        std::vector<uint32_t> vertex_offsets(mesh_count + 1, 0);
+        std::vector<uint32_t> index_offsets(mesh_count + 1, 0);
 
-        for (auto i = 0; i < mesh_count; i++)
+        for (uint32_t i = 0; i < mesh_count; i++)
         {
             const auto *mesh = scene->mMeshes[i];
 
-            NumVertices += mesh->mNumVertices;
-
+            uint32_t triangles = 0;
             for (u_int32_t o = 0; o < mesh->mNumFaces; o++)
             {
-                const aiFace &face = mesh->mFaces[o];
-                NumIndicies += face.mNumIndices;
+                // Triangulation leaves points and lines behind, they aren't drawn
+                if (mesh->mFaces[o].mNumIndices == 3)
+                {
+                    triangles++;
+                }
             }
-        }
-
-        vertices.reserve(NumVertices);
-        indices.reserve(NumIndicies);
-
-        for (auto i = 0; i < mesh_count; i++)
-        {
-            const auto *mesh = scene->mMeshes[i];
 
-            for (uint32_t x = 0; x < mesh->mNumVertices; x++)
-            {
-                const aiVector3D *pos = &(mesh->mVertices[x]);
-                const aiVector3D *normal = &(mesh->mNormals[x]);
-                const aiVector3D *uv = mesh->HasTextureCoords(0) ? &(mesh->mTextureCoords[0][x]) : &Zero3D;
-
-                Vertex vertex;
-                vertex.pos = glm::vec3(pos->x, pos->y, pos->z);
-                vertex.uv = glm::vec2(uv->x, uv->y);
-                vertex.normal = glm::vec3(normal->x, normal->y, normal->z);
+            vertex_offsets[i + 1] = vertex_offsets[i] + mesh->mNumVertices;
+            index_offsets[i + 1] = index_offsets[i] + triangles * 3;
+        }
 
-                vertices.push_back(vertex);
-            }
+        std::vector<Vertex> vertices(vertex_offsets[mesh_count]);
+        std::vector<uint32_t> indices(index_offsets[mesh_count]);
 
-            for (u_int32_t o = 0; o < mesh->mNumFaces; o++)
+        JobSystem::get().parallelFor(mesh_count, 1, [&](const uint32_t first, const uint32_t last) {
+            for (uint32_t i = first; i < last; i++)
             {
-                const aiFace &face = mesh->mFaces[o];
-                if (face.mNumIndices != 3)  break;
-
-                indices.push_back(face.mIndices[0]);
-                indices.push_back(face.mIndices[1]);
-                indices.push_back(face.mIndices[2]);
+                const auto *mesh = scene->mMeshes[i];
+                const uint32_t base_vertex = vertex_offsets[i];
+
+                for (uint32_t x = 0; x < mesh->mNumVertices; x++)
+                {
+                    const aiVector3D *pos = &(mesh->mVertices[x]);
+                    const aiVector3D *normal = &(mesh->mNormals[x]);
+                    const aiVector3D *uv = mesh->HasTextureCoords(0) ? &(mesh->mTextureCoords[0][x]) : &Zero3D;
+
+                    Vertex &vertex = vertices[base_vertex + x];
+                    vertex.pos = glm::vec3(pos->x, pos->y, pos->z);
+                    vertex.uv = glm::vec2(uv->x, uv->y);
+                    vertex.normal = glm::vec3(normal->x, normal->y, normal->z);
+                }
+
+                // Face indices are local to the mesh, all meshes share one vertex buffer
+                uint32_t index = index_offsets[i];
+                for (u_int32_t o = 0; o < mesh->mNumFaces; o++)
+                {
+                    const aiFace &face = mesh->mFaces[o];
+                    if (face.mNumIndices != 3)
+                    {
+                        continue;
+                    }
+
+                    indices[index++] = base_vertex + face.mIndices[0];
+                    indices[index++] = base_vertex + face.mIndices[1];
+                    indices[index++] = base_vertex + face.mIndices[2];
+                }
             }
-        }
+        });
 
         // std::vector<uint32_t> remap(mesh_count); // allocate temporary memory fovertices.size(), vertices.data(), rr,  the remap table
         // size_t vertex_count = meshopt_generateVertexRemap(remap.data(), nullptr, mesh_count, vertices.data(), mesh_count, sizeof(Vertex));
@@ -127,8 +150,14 @@ public:
         // meshopt_optimizeVertexCache(indices.data(), indices.data(), mesh_count, vertex_count);
         // meshopt_optimizeOverdraw(indices.data(), indices.data(), mesh_count, &real_vertices[0].pos.x, vertex_count, sizeof(glm::vec3), 1.05f);
         // meshopt_optimizeVertexFetch(real_vertices.data(), indices.data(), mesh_count, real_vertices.data(), vertex_count, sizeof(Vertex));
-        _vertices = vertices;
-        _indices = indices;
+        _vertices = std::move(vertices);
+        _indices = std::move(indices);
+
+        _ranges.resize(mesh_count);
+        for (uint32_t i = 0; i < mesh_count; i++)
+        {
+            _ranges[i] = {vertex_offsets[i], vertex_offsets[i + 1] - vertex_offsets[i], index_offsets[i], index_offsets[i + 1] - index_offsets[i]};
+        }
 
         return true;
 
@@ -138,4 +167,7 @@ public:
     std::vector<Vertex> &getVertices() { return _vertices; }
 
     std::vector<uint32_t> &getIndices() { return _indices; }
+
+    /// One per mesh of the file, in file order. The indices already point at the shared vertices.
+    [[nodiscard]] const std::vector<MeshRange> &getMeshRanges() const { return _ranges; }
 };
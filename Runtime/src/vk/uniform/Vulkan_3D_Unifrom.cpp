@@ -1,6 +1,6 @@
 #include "Vulkan_3D_Unifrom.hpp"
 
-#define ZOOM -2.5
+#include <algorithm>
 
 [[nodiscard]] inline glm::mat4 reverse_depth_projection_matrix_lh(const float field_of_view, const float aspect_ratio, const float near_plane, const float far_plane) noexcept
 {
@@ -28,40 +28,188 @@
     return v;
 }
 
-Vulkan_3D_Unifrom::Vulkan_3D_Unifrom(Camera &camera)
+Vulkan_3D_Unifrom::Vulkan_3D_Unifrom(Camera &camera, const uint32_t frames_in_flight)
 {
-    this->uniform_buffer_general = std::make_unique<VulkanVertexBuffer>(context->device, sizeof(ubo_vs) * 1000, vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // Every frame in flight gets its own copy of the buffers, so the CPU never writes what the GPU still reads
+    std::vector<vk::DescriptorSetLayout> layouts(frames_in_flight, context->frame_descriptor_set_layout);
+    const vk::DescriptorSetAllocateInfo alloc_info(context->descriptor_pool, layouts);
+    descriptor_sets = context->device.allocateDescriptorSets(alloc_info);
 
-    this->updateViewMatrix(camera);
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        camera_buffers.push_back(std::make_unique<VulkanVertexBuffer>(context->device, sizeof(CameraUbo), vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU));
+    }
+    object_buffers.resize(frames_in_flight);
+    slot_capacities.resize(frames_in_flight, 0);
+    instance_buffers.resize(frames_in_flight);
+    instance_slot_capacities.resize(frames_in_flight, 0);
+    instance_capacity = 1000;
+    stale_objects.resize(frames_in_flight);
+
+    this->reserveObjects(1000);
+
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        this->setFrame(i);
+        this->updateViewMatrix(camera);
+    }
+    this->setFrame(0);
 }
 
 Vulkan_3D_Unifrom::~Vulkan_3D_Unifrom()
 {
-    this->uniform_buffer_general.reset();
+    camera_buffers.clear();
+    object_buffers.clear();
+    instance_buffers.clear();
+}
+
+void Vulkan_3D_Unifrom::reserveObjects(const uint32_t count)
+{
+    if (count > object_capacity)
+    {
+        uint32_t capacity = std::max(object_capacity, 1000u);
+        while (capacity < count)
+        {
+            capacity *= 2;
+        }
+        object_capacity = capacity;
+    }
+
+    // Other frames may still be in flight with their buffers, they catch up in setFrame
+    this->growSlot(frame);
+}
+
+void Vulkan_3D_Unifrom::growSlot(const uint32_t slot)
+{
+    if (slot_capacities[slot] >= object_capacity && instance_slot_capacities[slot] >= instance_capacity)
+    {
+        return;
+    }
+
+    if (instance_slot_capacities[slot] < instance_capacity)
+    {
+        instance_buffers[slot] = std::make_unique<VulkanVertexBuffer>(context->device, sizeof(uint32_t) * instance_capacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        instance_slot_capacities[slot] = instance_capacity;
+    }
+
+    if (slot_capacities[slot] >= object_capacity)
+    {
+        this->updateDescriptorSet(slot);
+        return;
+    }
+
+    auto buffer = std::make_unique<VulkanVertexBuffer>(context->device, sizeof(ObjectData) * object_capacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    if (object_buffers[slot])
+    {
+        // Only changed objects get written each frame, so the existing records have to move over.
+        buffer->update(object_buffers[slot]->map(), sizeof(ObjectData) * slot_capacities[slot]);
+    }
+
+    object_buffers[slot] = std::move(buffer);
+    slot_capacities[slot] = object_capacity;
+    this->updateDescriptorSet(slot);
+}
+
+void Vulkan_3D_Unifrom::updateDescriptorSet(const uint32_t slot) const
+{
+    const vk::DescriptorBufferInfo camera_descriptor(camera_buffers[slot]->get_handle(), 0, sizeof(CameraUbo));
+    const vk::DescriptorBufferInfo object_descriptor(object_buffers[slot]->get_handle(), 0, VK_WHOLE_SIZE);
+    const vk::DescriptorBufferInfo instance_descriptor(instance_buffers[slot]->get_handle(), 0, VK_WHOLE_SIZE);
+
+    const std::array<vk::WriteDescriptorSet, 3> write_descriptor_sets = {
+        {// Binding 0 : Vertex shader camera uniform buffer
+         {descriptor_sets[slot], 0, {}, vk::DescriptorType::eUniformBuffer, {}, camera_descriptor},
+         // Binding 1 : Vertex shader object storage buffer, indexed through the instance buffer
+         {descriptor_sets[slot], 1, {}, vk::DescriptorType::eStorageBuffer, {}, object_descriptor},
+         // Binding 2 : Vertex shader instance storage buffer, indexed by gl_InstanceIndex
+         {descriptor_sets[slot], 2, {}, vk::DescriptorType::eStorageBuffer, {}, instance_descriptor}}};
+
+    context->device.updateDescriptorSets(write_descriptor_sets, {});
+}
+
+void Vulkan_3D_Unifrom::setFrame(const uint32_t frame_index)
+{
+    // The previous frame on this slot completed, so its descriptor set and buffers can be replaced
+    frame = frame_index;
+    this->growSlot(frame);
 }
 
 void Vulkan_3D_Unifrom::updateViewMatrix(Camera &camera)
 {
     vk::Extent2D extent = {context->swapchain_dimensions.width, context->swapchain_dimensions.height};
-    ubo_vs.projection = reverse_depth_projection_matrix_lh(60.0f, (float)extent.width / (float)extent.height, 0.1f, 10000.0f);
+    camera_ubo.projection = reverse_depth_projection_matrix_lh(60.0f, (float)extent.width / (float)extent.height, 0.1f, 10000.0f);
     const auto look_at = camera.position + direction_from_rotation(camera.rotation);
 
-    glm::mat4 view_matrix = glm::lookAt(camera.position, look_at, glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo_vs.view = view_matrix;
-    ubo_vs.view_pos = glm::vec4(0.0f, 0.0f, -ZOOM, 0.0f);
+    camera_ubo.view = glm::lookAt(camera.position, look_at, glm::vec3(0.0f, 1.0f, 0.0f));
+    camera_ubo.view_pos = glm::vec4(camera.position, 1.0f);
 
-    uniform_buffer_general->convert_and_update(ubo_vs);
+    camera_buffers[frame]->convert_and_update(camera_ubo);
 }
 
-void Vulkan_3D_Unifrom::updateTransMatrix(const std::unique_ptr<Vulkan_Mesh> &object, const uint32_t &index)
+void Vulkan_3D_Unifrom::updateObjects(const glm::mat4 *world, const glm::mat4 *normal, const std::vector<uint32_t> &indices)
 {
-    glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), object->position);
-    glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), object->scale);
+    // Records changed while other frames were current are still missing from this frame's copy
+    auto &stale = stale_objects[frame];
+    stale.insert(stale.end(), indices.begin(), indices.end());
+
+    for (uint32_t i = 0; i < stale_objects.size(); i++)
+    {
+        if (i != frame)
+        {
+            stale_objects[i].insert(stale_objects[i].end(), indices.begin(), indices.end());
+        }
+    }
+
+    if (stale.empty())
+    {
+        return;
+    }
 
-    ubo_vs.trans = glm::rotate(ubo_vs.trans, glm::radians(object->rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    ubo_vs.trans = glm::rotate(ubo_vs.trans, glm::radians(object->rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo_vs.trans = glm::rotate(ubo_vs.trans, glm::radians(object->rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo_vs.view = ubo_vs.view * scaleMatrix * translationMatrix * ubo_vs.trans;
+    auto *objects = reinterpret_cast<ObjectData *>(object_buffers[frame]->map());
 
-    uniform_buffer_general->convert_and_update(ubo_vs, index * sizeof(ubo_vs));
-}
\ No newline at end of file
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (const uint32_t i : stale)
+    {
+        objects[i].model = world[i];
+        objects[i].normal = normal[i];
+
+        first = std::min(first, i);
+        last = std::max(last, i);
+    }
+    stale.clear();
+
+    object_buffers[frame]->mark_dirty(first * sizeof(ObjectData), (last - first + 1) * sizeof(ObjectData));
+}
+
+void Vulkan_3D_Unifrom::reserveInstances(const uint32_t count)
+{
+    if (count > instance_capacity)
+    {
+        uint32_t capacity = instance_capacity;
+        while (capacity < count)
+        {
+            capacity *= 2;
+        }
+        instance_capacity = capacity;
+    }
+    this->growSlot(frame);
+}
+
+void Vulkan_3D_Unifrom::updateInstances(const std::vector<uint32_t> &objects)
+{
+    this->reserveInstances(static_cast<uint32_t>(objects.size()));
+
+    if (objects.empty())
+    {
+        return;
+    }
+
+    instance_buffers[frame]->update(reinterpret_cast<const uint8_t *>(objects.data()), objects.size() * sizeof(uint32_t));
+}
+
+void Vulkan_3D_Unifrom::bind(const vk::CommandBuffer &buffer) const
+{
+    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, context->pipeline_layout, 0, descriptor_sets[frame], {});
+}
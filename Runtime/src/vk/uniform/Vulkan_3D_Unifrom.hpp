@@ -7,34 +7,85 @@
 #include "../mesh/Vulkan_Mesh.hpp"
 
 #include <memory>
+#include <vector>
 
-struct Ubo
+/// Per-frame camera data, set 0 binding 0
+struct CameraUbo
 {
     glm::mat4 projection;
     glm::mat4 view;
-    glm::mat4 trans;
     glm::vec4 view_pos;
-    float lod_bias = 0.0f;
 };
 
+/// Per-object record in the object storage buffer, set 0 binding 1 (std430 layout)
+struct ObjectData
+{
+    glm::mat4 model;
+    glm::mat4 normal;
+};
+
+static_assert(sizeof(ObjectData) == 128, "ObjectData has to match the std430 layout in model.vert.glsl");
+
 class Vulkan_3D_Unifrom
 {
 private:
+    uint32_t object_capacity = 0;
+
+    /// Frame in flight the updates and binds go to
+    uint32_t frame = 0;
+
+    std::vector<vk::DescriptorSet> descriptor_sets;
+
+    /// Per frame in flight, objects that changed since that frame's copy was last written
+    std::vector<std::vector<uint32_t>> stale_objects;
+
+    /// Object buffer capacity of each frame in flight, lags behind object_capacity until the slot is current again
+    std::vector<uint32_t> slot_capacities;
+
+    uint32_t instance_capacity = 0;
+
+    /// Instance buffer capacity of each frame in flight, like slot_capacities
+    std::vector<uint32_t> instance_slot_capacities;
+
+    void updateDescriptorSet(uint32_t slot) const;
+
+    void growSlot(uint32_t slot);
+
 public:
-    Ubo ubo_vs;
+    CameraUbo camera_ubo;
+
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> camera_buffers;
+
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> object_buffers;
 
-    std::unique_ptr<VulkanVertexBuffer> uniform_buffer_general;
+    /// Object index of every instance, set 0 binding 2. Rewritten every frame, so growing doesn't copy.
+    std::vector<std::unique_ptr<VulkanVertexBuffer>> instance_buffers;
 
-    explicit Vulkan_3D_Unifrom(Camera &camera);
+    Vulkan_3D_Unifrom(Camera &camera, uint32_t frames_in_flight);
     ~Vulkan_3D_Unifrom();
 
-    Vulkan_3D_Unifrom(const Vulkan_3D_Unifrom &) = default;
+    Vulkan_3D_Unifrom(const Vulkan_3D_Unifrom &) = delete;
 
     Vulkan_3D_Unifrom &operator=(const Vulkan_3D_Unifrom &) = delete;
 
+    /// Grows the object buffers so they hold at least count records. Only the current frame's buffer is reallocated
+    /// right away, the others follow when they become current and the GPU is done with them.
+    void reserveObjects(uint32_t count);
+
+    /// Grows the current frame's instance buffer to hold at least count entries.
+    void reserveInstances(uint32_t count);
+
+    /// Writes the object index of every instance of the frame, instance i of a draw reads entry firstInstance + i.
+    void updateInstances(const std::vector<uint32_t> &objects);
+
+    /// Selects the copy of the buffers owned by the given frame in flight, which must have completed on the GPU.
+    void setFrame(uint32_t frame_index);
+
     void updateViewMatrix(Camera &camera);
 
-    void updateTransMatrix(const std::unique_ptr<Vulkan_Mesh> &object, const uint32_t &index);
+    /// Writes the listed objects plus whatever the current frame's copy missed while other frames were current.
+    void updateObjects(const glm::mat4 *world, const glm::mat4 *normal, const std::vector<uint32_t> &indices);
 
-    [[nodiscard]] vk::Buffer getBuffer() const { return uniform_buffer_general->get_handle(); }
+    /// Binds the camera, object and instance buffers (set 0) once for all draws of the frame.
+    void bind(const vk::CommandBuffer &buffer) const;
 };